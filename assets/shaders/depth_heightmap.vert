@@ -0,0 +1,44 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(std140, set = 0, binding = 0) uniform SceneObjectUbo
+{
+    mat4 model;
+} transform;
+
+layout(std140, set = 1, binding = 0) uniform CameraUbo
+{
+    mat4 view;
+    mat4 proj;
+    mat4 projview;
+    vec3 cam_pos;
+} camera;
+
+// See `mxn::vk::terrain_renderer`
+layout(set = 5, binding = 0) uniform usampler2DArray heights;
+
+// Per instance; see `mxn::vk::terrain_renderer::instance`
+layout(location = 0) in ivec2 in_chunk;
+layout(location = 1) in uint in_layer;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+// Mirror `mxn::heightmap`
+const int WIDTH = 32;
+const float WORLD_SIZE = 32.0;
+const float HEIGHT_SCALE = 0.00001;
+
+// Vertex shader for depth prepass, for heightmap chunks
+void main()
+{
+    ivec2 texel = ivec2(gl_VertexIndex % WIDTH, gl_VertexIndex / WIDTH);
+    float height = float(texelFetch(heights, ivec3(texel, in_layer), 0).r) * HEIGHT_SCALE;
+    vec3 position = vec3(vec2(in_chunk) * WORLD_SIZE + vec2(texel), height);
+
+    // TODO: Calculate on CPU
+    mat4 mvp = camera.projview * transform.model;
+    gl_Position = mvp * vec4(position, 1.0);
+}
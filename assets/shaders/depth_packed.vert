@@ -0,0 +1,39 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(std140, set = 0, binding = 0) uniform SceneObjectUbo
+{
+    mat4 model;
+} transform;
+
+layout(std140, set = 1, binding = 0) uniform CameraUbo
+{
+    mat4 view;
+    mat4 proj;
+    mat4 projview;
+    vec3 cam_pos;
+} camera;
+
+// See `mxn::vk::mesh_pushconst`
+layout(push_constant) uniform MeshPushConstants
+{
+    layout(offset = 32) vec4 quant_origin;
+    vec4 quant_scale;
+} mesh;
+
+// Signed-normalised within the mesh's bounds
+layout(location = 0) in vec3 in_position;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+// Vertex shader for depth prepass, for the packed and terrain vertex formats
+void main()
+{
+    // TODO: Calculate on CPU
+    mat4 mvp = camera.projview * transform.model;
+    vec3 pos = mesh.quant_origin.xyz + in_position * mesh.quant_scale.xyz;
+    gl_Position = mvp * vec4(pos, 1.0);
+}
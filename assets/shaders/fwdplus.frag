@@ -90,7 +90,14 @@ void main()
 	}
 
 	vec3 normal;
-	if (material.has_normal_map > 0)
+	if (material.has_normal_map > 1)
+	{
+		// Two-channel (BC5) map; Z is implied by unit length
+		vec2 xy = texture(normal_sampler, frag_tex_coord).rg * 2.0 - 1.0;
+		float z = sqrt(max(1.0 - dot(xy, xy), 0.0));
+		normal = applyNormalMap(frag_normal, vec3(xy, z) * 0.5 + 0.5);
+	}
+	else if (material.has_normal_map > 0)
 	{
 		normal = applyNormalMap(frag_normal, texture(normal_sampler, frag_tex_coord).rgb);
 	}
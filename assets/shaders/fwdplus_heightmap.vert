@@ -0,0 +1,70 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(std140, set = 0, binding = 0) uniform SceneObjectUbo
+{
+    mat4 model;
+} transform;
+
+layout(std140, set = 1, binding = 0) uniform CameraUbo
+{
+    mat4 view;
+    mat4 proj;
+    mat4 projview;
+    vec3 cam_pos;
+} camera;
+
+// See `mxn::vk::terrain_renderer`
+layout(set = 5, binding = 0) uniform usampler2DArray heights;
+
+// Per instance; see `mxn::vk::terrain_renderer::instance`
+layout(location = 0) in ivec2 in_chunk;
+layout(location = 1) in uint in_layer;
+
+layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec2 frag_tex_coord;
+layout(location = 2) out vec3 frag_normal;
+layout(location = 3) out vec3 frag_pos_world;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+// Mirror `mxn::heightmap`
+const int WIDTH = 32;
+const float WORLD_SIZE = 32.0;
+const float HEIGHT_SCALE = 0.00001;
+
+float height_at(ivec2 texel)
+{
+    return float(texelFetch(heights, ivec3(texel, in_layer), 0).r) * HEIGHT_SCALE;
+}
+
+// Vertex shader for heightmap chunks, displaced from their layer of `heights`
+void main()
+{
+    ivec2 texel = ivec2(gl_VertexIndex % WIDTH, gl_VertexIndex / WIDTH);
+    vec3 position = vec3(vec2(in_chunk) * WORLD_SIZE + vec2(texel), height_at(texel));
+
+    // Central differences, falling back to one-sided ones at the edges, as
+    // `mxn::vk::model::from_heightmap()` does
+    ivec2 lo = max(texel - 1, 0), hi = min(texel + 1, WIDTH - 1);
+    float dx = (height_at(ivec2(hi.x, texel.y)) - height_at(ivec2(lo.x, texel.y))) /
+        float(hi.x - lo.x);
+    float dy = (height_at(ivec2(texel.x, hi.y)) - height_at(ivec2(texel.x, lo.y))) /
+        float(hi.y - lo.y);
+    vec3 normal = normalize(vec3(-dx, -dy, 1.0));
+
+    // TODO: Calculate up-front, in CPU
+    mat4 invtransmodel =  transpose(inverse(transform.model));
+    mat4 mvp = camera.projview * transform.model;
+
+    gl_Position = mvp * vec4(position, 1.0);
+    frag_color = vec3(1.0);
+    frag_tex_coord = vec2(0.0);
+
+    // TODO: Do everything view or projection space
+    frag_normal = normalize((invtransmodel * vec4(normal, 0.0)).xyz);
+    frag_pos_world = vec3(transform.model * vec4(position, 1.0));
+}
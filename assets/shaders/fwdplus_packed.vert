@@ -0,0 +1,68 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(std140, set = 0, binding = 0) uniform SceneObjectUbo
+{
+    mat4 model;
+} transform;
+
+layout(std140, set = 1, binding = 0) uniform CameraUbo
+{
+    mat4 view;
+    mat4 proj;
+    mat4 projview;
+    vec3 cam_pos;
+} camera;
+
+// See `mxn::vk::mesh_pushconst`
+layout(push_constant) uniform MeshPushConstants
+{
+    layout(offset = 32) vec4 quant_origin;
+    vec4 quant_scale;
+} mesh;
+
+// Signed-normalised within the mesh's bounds
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_color;
+layout(location = 2) in vec2 in_tex_coord;
+// Octahedral-encoded
+layout(location = 3) in vec2 in_normal;
+
+layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec2 frag_tex_coord;
+layout(location = 2) out vec3 frag_normal;
+layout(location = 3) out vec3 frag_pos_world;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+// Inverse of the octahedral encoding in vk/model.cpp
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Vertex shader for the packed vertex format
+void main()
+{
+    vec3 position = mesh.quant_origin.xyz + in_position * mesh.quant_scale.xyz;
+    vec3 normal = oct_decode(in_normal);
+
+    // TODO: Calculate up-front, in CPU
+    mat4 invtransmodel =  transpose(inverse(transform.model));
+    mat4 mvp = camera.projview * transform.model;
+
+    gl_Position = mvp * vec4(position, 1.0);
+    frag_color = in_color;
+    frag_tex_coord = in_tex_coord;
+
+    // TODO: Do everything view or projection space
+    frag_normal = normalize((invtransmodel * vec4(normal, 0.0)).xyz);
+    frag_pos_world = vec3(transform.model * vec4(position, 1.0));
+}
@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// See `mxn::vk::terrain_renderer`
+layout(set = 5, binding = 0) uniform usampler2DArray heights;
+
+// Per instance; see `mxn::vk::terrain_renderer::instance`
+layout(location = 0) in ivec2 in_chunk;
+layout(location = 1) in uint in_layer;
+
+// Model space, before `transform.model`
+layout(location = 0) out vec3 out_position;
+layout(location = 1) out vec2 out_texel;
+layout(location = 2) out uint out_layer;
+
+// Mirror `mxn::heightmap`
+const int WIDTH = 32;
+const float WORLD_SIZE = 32.0;
+const float HEIGHT_SCALE = 0.00001;
+
+// In the order of the quad domain's corners; see heightmap.tese
+const ivec2 CORNERS[4] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+
+// Vertex shader for tessellated heightmap chunks, emitting the corners of one
+// quad patch per heightmap cell. Shared by the depth pre-pass and render pass
+void main()
+{
+    int cell = gl_VertexIndex / 4;
+    ivec2 texel = ivec2(cell % (WIDTH - 1), cell / (WIDTH - 1)) + CORNERS[gl_VertexIndex % 4];
+    float height = float(texelFetch(heights, ivec3(texel, in_layer), 0).r) * HEIGHT_SCALE;
+
+    out_position = vec3(vec2(in_chunk) * WORLD_SIZE + vec2(texel), height);
+    out_texel = vec2(texel);
+    out_layer = in_layer;
+}
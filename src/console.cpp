@@ -71,6 +71,9 @@ void mxn::console::toggle() noexcept
 
 void mxn::console::draw()
 {
+	// Trim even while closed, lest the producer run out of room
+	const uint64_t h = head.load(std::memory_order_acquire), t = trim(h);
+
 	if (!is_open) return;
 
 	ImGui::SetNextWindowSize(ImVec2(520, 600), ImGuiCond_FirstUseEver);
@@ -96,17 +99,22 @@ void mxn::console::draw()
 
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4.0f, 1.0f));
 
+	if (const auto d = dropped.load(std::memory_order_relaxed); d > 0)
+		ImGui::TextDisabled("(%zu lines dropped)", d);
+
+	// Lines from `t` to `h` stay put until the next call to `trim()`
 	ImGuiListClipper clipper;
-	log_mtx.lock();
-	clipper.Begin(entries.size());
+	clipper.Begin(static_cast<int>(h - t));
 
 	while (clipper.Step())
 	{
 		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
 		{
+			const auto& l = lines[(t + i) % LINE_CAPACITY];
+			const char* const begin = text.data() + l.begin % TEXT_CAPACITY;
 			ImVec4 colour = ImVec4(0.8f, 0.8f, 0.8f, 1.0f);
 
-			switch (entries[i].level)
+			switch (l.level)
 			{
 			case quill::LogLevel::Info:
 				colour.x = mxn::GREEN_F[0];
@@ -142,11 +150,10 @@ void mxn::console::draw()
 			}
 
 			ImGui::PushStyleColor(ImGuiCol_Text, colour);
-			ImGui::TextUnformatted(entries[i].text.c_str());
+			ImGui::TextUnformatted(begin, begin + l.length);
 			ImGui::PopStyleColor();
 		}
 	}
-	log_mtx.unlock();
 
 	if (scroll_to_bottom ||
 		(auto_scroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY()))
@@ -233,20 +240,78 @@ void mxn::console::write(const fmt::memory_buffer& rec, std::chrono::nanoseconds
 {
 	// Split the given buffer by newlines for the ImGui clipper
 
-	size_t next = 0, last = 0;
-	const std::string string(rec.begin(), rec.size() - 1);
-	std::string token;
+	size_t next = 0;
+	std::string_view string(rec.data(), rec.size() - 1);
+
+	while ((next = string.find('\n')) != std::string_view::npos)
+	{
+		push_line(string.substr(0, next), level);
+		string.remove_prefix(next + 1);
+	}
+
+	push_line(string, level);
+}
+
+void mxn::console::push_line(std::string_view str, const quill::LogLevel level) noexcept
+{
+	str = str.substr(0, MAX_LINE_LENGTH);
+
+	const uint64_t h = head.load(std::memory_order_relaxed);
+	uint64_t begin = text_head;
+
+	// Lines never straddle the end of `text`, so that each can be drawn whole
+	if (begin % TEXT_CAPACITY + str.size() > TEXT_CAPACITY)
+		begin += TEXT_CAPACITY - begin % TEXT_CAPACITY;
+
+	if (h - tail.load(std::memory_order_acquire) >= LINE_CAPACITY ||
+		begin + str.size() - text_tail.load(std::memory_order_acquire) > TEXT_CAPACITY)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	memcpy(text.data() + begin % TEXT_CAPACITY, str.data(), str.size());
+	lines[h % LINE_CAPACITY] = { .begin = begin,
+								 .length = static_cast<uint32_t>(str.size()),
+								 .level = level };
+	text_head = begin + str.size();
+	head.store(h + 1, std::memory_order_release);
+}
 
-	const std::scoped_lock lock(log_mtx);
+uint64_t mxn::console::trim(const uint64_t h) noexcept
+{
+	// Keep a quarter of each ring free, so that bursts of output aren't dropped
+	static constexpr uint64_t KEEP_LINES = LINE_CAPACITY / 4 * 3,
+							  KEEP_BYTES = TEXT_CAPACITY / 4 * 3;
+
+	const uint64_t old = tail.load(std::memory_order_relaxed);
+	uint64_t t = old;
 
-	while ((next = string.find('\n', last)) != std::string::npos)
+	const auto end_of = [this](const uint64_t i) -> uint64_t {
+		const auto& l = lines[i % LINE_CAPACITY];
+		return l.begin + l.length;
+	};
+
+	if (clear_requested.exchange(false, std::memory_order_relaxed))
+	{
+		t = h;
+	}
+	else if (t < h)
 	{
-		entries.push_back({ .text = string.substr(last, next - last),
-							.level = level });
-		last = next + 1;
+		t = std::max(t, h - std::min(h, KEEP_LINES));
+
+		const uint64_t end = end_of(h - 1);
+
+		while (t < h && end - lines[t % LINE_CAPACITY].begin > KEEP_BYTES) t++;
 	}
 
-	entries.push_back({ .text = string.substr(last), .level = level });
+	if (t == old) return t;
+
+	// Free the text before the first live line, or all of it if none remain
+	text_tail.store(
+		t < h ? lines[t % LINE_CAPACITY].begin : end_of(h - 1), std::memory_order_release);
+	tail.store(t, std::memory_order_release);
+	return t;
 }
 
 void mxn::console::run_command(const std::string& string)
@@ -291,8 +356,8 @@ void mxn::console::run_command(const std::string& string)
 
 void mxn::console::clear_storage()
 {
-	const std::scoped_lock lock(log_mtx);
-	entries.clear();
+	// Only the consumer may free lines, so leave it to `draw()`
+	clear_requested = true;
 	history.clear();
 }
 
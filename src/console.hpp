@@ -7,11 +7,13 @@
 
 #include "preproc.hpp"
 
+#include <array>
+#include <atomic>
 #include <concurrentqueue/concurrentqueue.h>
-#include <mutex>
 #include <functional>
 #include <quill/Quill.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct ImGuiInputTextCallbackData;
@@ -23,11 +25,12 @@ namespace mxn
 	public:
 		using command_t = std::function<void(const std::vector<std::string>&)>;
 
-		struct entry final
-		{
-			const std::string text;
-			const quill::LogLevel level;
-		};
+		/// How many lines of output the console can hold at once.
+		static constexpr size_t LINE_CAPACITY = 1 << 14;
+		/// How many bytes of text the console can hold at once.
+		static constexpr size_t TEXT_CAPACITY = 1 << 21;
+		/// Longer lines are truncated.
+		static constexpr size_t MAX_LINE_LENGTH = 1 << 12;
 
 	private:
 		struct command final
@@ -46,24 +49,55 @@ namespace mxn
 		int history_pos = -1;
 		bool auto_scroll = true, scroll_to_bottom = true;
 
-		/// Locked by the Quill backend during writes and by `draw()`.
-		std::mutex log_mtx;
-		
+		/// @brief One line of output, whose characters lie in `text`.
+		struct line final
+		{
+			/// Where the line starts, counted in bytes ever written to `text`.
+			uint64_t begin = 0;
+			uint32_t length = 0;
+			quill::LogLevel level = quill::LogLevel::None;
+		};
+
+		// Everything written to the Quill logger is kept in two ring buffers,
+		// with the Quill backend as the only producer and `draw()` as the only
+		// consumer, so neither ever waits on the other. Positions only grow,
+		// and are reduced modulo capacity on access. Lines from `tail` up to
+		// `head` are live; the producer owns `head` and the consumer `tail`.
+		// If a ring fills up before the consumer frees space, lines are
+		// dropped rather than overwritten, since the consumer may be reading
+		// them.
+
+		std::array<line, LINE_CAPACITY> lines;
+		std::array<char, TEXT_CAPACITY> text;
+		std::atomic<uint64_t> head = 0, tail = 0;
+		/// Bytes of `text` before this position are free for the producer.
+		std::atomic<uint64_t> text_tail = 0;
+		/// Only touched by the producer.
+		uint64_t text_head = 0;
+		/// Lines which found the rings full.
+		std::atomic<size_t> dropped = 0;
+		/// Set by `clear_storage()`; `draw()` frees every line when it sees it.
+		std::atomic<bool> clear_requested = false;
+
 		/// Commands submitted by the render thread, pending execution.
 		moodycamel::ConcurrentQueue<std::string> cmd_queue;
 
 		/// Allow user to quickly re-run past commands.
 		std::vector<std::string> history;
 
-		/// Stores everything written to the Quill logger.
-		std::vector<entry> entries;
-
 		std::vector<command> commands;
 
 		void run_command(const std::string& key);
 		void clear_storage();
 		int text_edit(ImGuiInputTextCallbackData* const);
 
+		/// @brief Producer-side; copy one line into the rings, or drop it.
+		void push_line(std::string_view, quill::LogLevel) noexcept;
+		/// @brief Consumer-side; free old lines so that the producer always
+		/// has room, and honour `clear_requested`.
+		/// @returns The position of the first live line.
+		uint64_t trim(uint64_t head) noexcept;
+
 		void write(const fmt::memory_buffer&, std::chrono::nanoseconds, quill::LogLevel) override;
 
 		/// @brief Called periodically, or when no more LOG_* writes remain to process.
@@ -8,8 +8,12 @@
 #include "log.hpp"
 
 #include <filesystem>
+#include <future>
+#include <memory>
 #include <physfs.h>
+#include <span>
 #include <string>
+#include <vector>
 
 namespace mxn
 {
@@ -32,16 +36,76 @@ namespace mxn
 
 	void vfs_init(const std::string& argv0);
 	void vfs_deinit();
+	/// @param append If `false`, `path` takes precedence over everything
+	/// already mounted, rather than the reverse.
 	void vfs_mount(
-		const std::filesystem::path& path, const std::filesystem::path& mount_point);
+		const std::filesystem::path& path, const std::filesystem::path& mount_point,
+		bool append = true);
 
 	[[nodiscard]] bool vfs_exists(const std::filesystem::path&) noexcept;
 	[[nodiscard]] bool vfs_isdir(const std::filesystem::path&) noexcept;
 	[[nodiscard]] uint32_t vfs_count(const std::filesystem::path&) noexcept;
 
+	/// @brief Read a whole file into `out`, reusing its capacity, so that a
+	/// buffer kept across many reads stops allocating. Costs one metadata
+	/// lookup. Failures are logged, and leave `out` empty.
+	bool vfs_read(const std::filesystem::path&, std::vector<unsigned char>& out);
+	/// @copydoc vfs_read(const std::filesystem::path&, std::vector<unsigned char>&)
+	bool vfs_read(const std::filesystem::path&, std::string& out);
 	std::vector<unsigned char> vfs_read(const std::filesystem::path&);
 	std::string vfs_readstr(const std::filesystem::path& path);
 	void vfs_recur(const std::filesystem::path&, void* userdata, vfs_enumerator);
 
+	/// @brief A whole file's bytes, read-only; see `vfs_map()`.
+	/// Copies share the same memory, which lives as long as any of them.
+	class vfs_mapping final
+	{
+	public:
+		vfs_mapping() noexcept = default;
+		/// @brief Adopt bytes which did not come from a file.
+		explicit vfs_mapping(std::vector<unsigned char>&&);
+
+		[[nodiscard]] const unsigned char* data() const noexcept { return view.data(); }
+		[[nodiscard]] size_t size() const noexcept { return view.size(); }
+		[[nodiscard]] bool empty() const noexcept { return view.empty(); }
+		/// @returns `false` if the bytes were read into a buffer instead.
+		[[nodiscard]] bool mapped() const noexcept { return is_mapped; }
+
+		operator std::span<const unsigned char>() const noexcept { return view; }
+
+	private:
+		std::shared_ptr<const void> owner;
+		std::span<const unsigned char> view;
+		bool is_mapped = false;
+
+		friend vfs_mapping vfs_map_direct(const std::filesystem::path&);
+	};
+
+	/// @brief Memory-map a file if it is a loose file on disk, or stored
+	/// uncompressed in a zip archive, so that its pages are only read as they
+	/// are touched. Otherwise, fall back to `vfs_read()`.
+	/// If the file was prefetched, the prefetched result is used (waiting for
+	/// it if need be) and then forgotten.
+	/// The bytes start on a boundary of at least `alignof(std::max_align_t)`.
+	/// Failures are logged, and give an empty mapping.
+	[[nodiscard]] vfs_mapping vfs_map(const std::filesystem::path&);
+	/// @brief `vfs_map()`, ignoring prefetched results; what the I/O pool uses.
+	[[nodiscard]] vfs_mapping vfs_map_direct(const std::filesystem::path&);
+
+	/// @brief `vfs_map()` a file on a pool of I/O threads, which also read in
+	/// all of its pages. Requests for a path already being read share its
+	/// result instead of reading it again, as does the first request for a
+	/// prefetched path.
+	/// @note Only call between `vfs_init()` and `vfs_deinit()`.
+	[[nodiscard]] std::shared_future<vfs_mapping> vfs_read_async(
+		const std::filesystem::path&);
+
+	/// @brief Start reading, in the background, every file listed in a
+	/// manifest (one VFS path per line; blank lines and those starting with
+	/// '#' are skipped). Each result is held until the first `vfs_map()` or
+	/// `vfs_read_async()` of its path, which takes it over.
+	/// @returns How many reads were started.
+	size_t vfs_prefetch(const std::filesystem::path& manifest);
+
 	void ccmd_file(const std::string& path);
 } // namespace mxn
@@ -0,0 +1,216 @@
+/**
+ * @file file_map.cpp
+ * @brief Memory-mapped reads from the virtual file system.
+ */
+
+#include "file.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stdfs = std::filesystem;
+
+/// Mapped views must start on boundaries at least this coarse, so that callers
+/// can reinterpret their bytes as any type (e.g. SPIR-V words, or vertices).
+static constexpr size_t MAP_ALIGNMENT = alignof(std::max_align_t);
+
+/// @brief The stored entries of a zip archive, as views into one mapping of
+/// the whole archive, keyed by their paths within it.
+struct zip_index final
+{
+	std::shared_ptr<const unsigned char> archive;
+	std::unordered_map<std::string, std::span<const unsigned char>> stored;
+};
+
+static std::mutex zip_indices_mtx;
+/// Keyed by real path. Archives are assumed not to change while mounted.
+static std::unordered_map<std::string, std::shared_ptr<const zip_index>> zip_indices;
+
+static std::shared_ptr<const unsigned char> map_real_file(
+	const stdfs::path&, size_t& size);
+static std::shared_ptr<const zip_index> index_zip(const stdfs::path&);
+
+mxn::vfs_mapping::vfs_mapping(std::vector<unsigned char>&& bytes)
+{
+	auto buf = std::make_shared<const std::vector<unsigned char>>(std::move(bytes));
+	view = *buf;
+	owner = std::move(buf);
+}
+
+mxn::vfs_mapping mxn::vfs_map_direct(const stdfs::path& path)
+{
+	const char* const real_dir = PHYSFS_getRealDir(path.c_str());
+
+	if (real_dir == nullptr) return vfs_mapping(vfs_read(path));
+
+	// Make the path relative to the directory or archive providing it
+	std::string rel = path.lexically_normal().generic_string();
+	std::string mount = PHYSFS_getMountPoint(real_dir);
+	rel.erase(0, rel.find_first_not_of('/'));
+	mount.erase(0, mount.find_first_not_of('/'));
+
+	if (rel.starts_with(mount)) rel.erase(0, mount.size());
+
+	vfs_mapping ret;
+	std::error_code ec;
+
+	if (stdfs::is_directory(real_dir, ec))
+	{
+		size_t size = 0;
+
+		if (auto map = map_real_file(stdfs::path(real_dir) / rel, size); map != nullptr)
+		{
+			ret.view = { map.get(), size };
+			ret.owner = std::move(map);
+			ret.is_mapped = true;
+			return ret;
+		}
+	}
+	else if (stdfs::is_regular_file(real_dir, ec))
+	{
+		std::shared_ptr<const zip_index> index;
+
+		{
+			const std::scoped_lock lock(zip_indices_mtx);
+			auto& cached = zip_indices[real_dir];
+
+			if (cached == nullptr) cached = index_zip(real_dir);
+
+			index = cached;
+		}
+
+		if (const auto iter = index->stored.find(rel); iter != index->stored.end())
+		{
+			ret.view = iter->second;
+			ret.owner = std::move(index);
+			ret.is_mapped = true;
+			return ret;
+		}
+	}
+
+	return vfs_mapping(vfs_read(path));
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+/// @returns Null if the file is empty, not a regular file, or not mappable.
+static std::shared_ptr<const unsigned char> map_real_file(
+	const stdfs::path& path, size_t& size)
+{
+#ifdef _WIN32
+	(void)path;
+	(void)size;
+	return nullptr;
+#else
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) return nullptr;
+
+	struct stat st = {};
+	void* addr = MAP_FAILED;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		size = static_cast<size_t>(st.st_size);
+		addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+
+	// The mapping outlives the descriptor
+	close(fd);
+
+	if (addr == MAP_FAILED) return nullptr;
+
+	return std::shared_ptr<const unsigned char>(
+		static_cast<const unsigned char*>(addr), [len = size](const unsigned char* p) {
+			munmap(const_cast<unsigned char*>(p), len);
+		});
+#endif
+}
+
+static uint16_t read_u16(const unsigned char* const p) noexcept
+{
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const unsigned char* const p) noexcept
+{
+	return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+		   (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/// @brief Find every entry of a zip archive which can be viewed in place,
+/// i.e. stored rather than compressed, unencrypted, and suitably aligned.
+/// Anything unusual (e.g. Zip64) is left to PhysFS.
+static std::shared_ptr<const zip_index> index_zip(const stdfs::path& path)
+{
+	static constexpr uint32_t SIG_EOCD = 0x06054b50, SIG_CENTRAL = 0x02014b50,
+							  SIG_LOCAL = 0x04034b50;
+	static constexpr size_t EOCD_SIZE = 22, CENTRAL_SIZE = 46, LOCAL_SIZE = 30,
+							MAX_COMMENT = 0xFFFF;
+
+	auto ret = std::make_shared<zip_index>();
+	size_t size = 0;
+	ret->archive = map_real_file(path, size);
+
+	if (ret->archive == nullptr || size < EOCD_SIZE) return ret;
+
+	const unsigned char* const base = ret->archive.get();
+	const unsigned char* eocd = nullptr;
+
+	// The end of central directory record may be followed by a comment
+	for (size_t i = size - EOCD_SIZE; size - i <= EOCD_SIZE + MAX_COMMENT; i--)
+	{
+		if (read_u32(base + i) == SIG_EOCD)
+		{
+			eocd = base + i;
+			break;
+		}
+
+		if (i == 0) break;
+	}
+
+	if (eocd == nullptr) return ret;
+
+	const size_t entry_c = read_u16(eocd + 10);
+	size_t cursor = read_u32(eocd + 16);
+
+	for (size_t i = 0; i < entry_c; i++)
+	{
+		if (cursor + CENTRAL_SIZE > size || read_u32(base + cursor) != SIG_CENTRAL) break;
+
+		const unsigned char* const entry = base + cursor;
+		const uint16_t flags = read_u16(entry + 8), method = read_u16(entry + 10);
+		const uint32_t csize = read_u32(entry + 20), usize = read_u32(entry + 24);
+		const uint16_t name_len = read_u16(entry + 28);
+		const size_t local = read_u32(entry + 42);
+
+		cursor += CENTRAL_SIZE + name_len + read_u16(entry + 30) + read_u16(entry + 32);
+
+		if (cursor > size) break;
+
+		if (method != 0 || (flags & 1) != 0 || csize != usize || csize == 0 ||
+			csize == UINT32_MAX || local + LOCAL_SIZE > size ||
+			read_u32(base + local) != SIG_LOCAL)
+			continue;
+
+		const size_t offset =
+			local + LOCAL_SIZE + read_u16(base + local + 26) + read_u16(base + local + 28);
+
+		// The archive's mapping is page-aligned, so only the offset matters
+		if (offset + csize > size || offset % MAP_ALIGNMENT != 0) continue;
+
+		ret->stored.emplace(
+			std::string(reinterpret_cast<const char*>(entry + CENTRAL_SIZE), name_len),
+			std::span(base + offset, csize));
+	}
+
+	return ret;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file file_watch.cpp
+ * @brief Reports changes to files under watched directories.
+ */
+
+#include "file_watch.hpp"
+
+#include "log.hpp"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace mxn;
+
+namespace stdfs = std::filesystem;
+
+file_watcher::file_watcher()
+{
+#ifdef __linux__
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (fd < 0) MXN_ERRF("Failed to start watching files: {}", strerror(errno));
+#else
+	MXN_WARN("File watching is unsupported on this platform.");
+#endif
+}
+
+file_watcher::~file_watcher()
+{
+#ifdef __linux__
+	if (fd >= 0) close(fd);
+#endif
+}
+
+void file_watcher::watch(const stdfs::path& dir, const stdfs::path& mount_point)
+{
+#ifdef __linux__
+	if (fd < 0) return;
+
+	const int wd = inotify_add_watch(
+		fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+
+	if (wd < 0)
+	{
+		MXN_WARNF("Failed to watch directory: {} ({})", dir.string(), strerror(errno));
+		return;
+	}
+
+	dirs[wd] = { .real = dir, .virt = mount_point };
+
+	std::error_code ec;
+
+	for (const auto& entry : stdfs::directory_iterator(dir, ec))
+	{
+		if (entry.is_directory(ec))
+			watch(entry.path(), mount_point / entry.path().filename());
+	}
+#else
+	(void)dir;
+	(void)mount_point;
+#endif
+}
+
+std::vector<stdfs::path> file_watcher::poll()
+{
+	std::vector<stdfs::path> ret;
+
+#ifdef __linux__
+	if (fd < 0) return ret;
+
+	alignas(inotify_event) char buf[4096];
+	ssize_t len = 0;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+	{
+		for (const char* p = buf; p < buf + len;)
+		{
+			const auto* const event = reinterpret_cast<const inotify_event*>(p);
+			p += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_IGNORED)
+			{
+				dirs.erase(event->wd);
+				continue;
+			}
+
+			const auto iter = dirs.find(event->wd);
+
+			if (iter == dirs.end() || event->len == 0) continue;
+
+			// Copied, since watching may rehash `dirs`
+			const watched_dir parent = iter->second;
+
+			if (event->mask & IN_ISDIR)
+			{
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					watch(parent.real / event->name, parent.virt / event->name);
+			}
+			else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+			{
+				ret.push_back(parent.virt / event->name);
+			}
+		}
+	}
+
+	// Editors often write a file more than once per save
+	std::sort(ret.begin(), ret.end());
+	ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+#endif
+
+	return ret;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file file_watch.hpp
+ * @brief Reports changes to files under watched directories.
+ */
+
+#pragma once
+
+#include "preproc.hpp"
+
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+namespace mxn
+{
+	/// @brief Watches real directories, recursively, for files being written
+	/// or moved into place, and reports them by their virtual file system path.
+	/// Backed by inotify; elsewhere, watching does nothing.
+	/// @note Not thread-safe.
+	class file_watcher final
+	{
+	public:
+		file_watcher();
+		~file_watcher();
+		DELETE_COPIERS_AND_MOVERS(file_watcher)
+
+		/// @brief Watch `dir` and all its subdirectories, including those
+		/// created later. Changes under `dir` are reported under `mount_point`.
+		void watch(
+			const std::filesystem::path& dir, const std::filesystem::path& mount_point);
+
+		/// @brief Virtual paths of files changed since the last call, each once.
+		/// Never blocks.
+		[[nodiscard]] std::vector<std::filesystem::path> poll();
+
+	private:
+		struct watched_dir final
+		{
+			std::filesystem::path real, virt;
+		};
+
+		int fd = -1;
+		/// Keyed by watch descriptor.
+		std::unordered_map<int, watched_dir> dirs;
+	};
+} // namespace mxn
@@ -0,0 +1,321 @@
+/**
+ * @file ktx.cpp
+ * @brief Reading and writing of KTX2 texture containers.
+ */
+
+#include "ktx.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+
+using namespace mxn;
+
+static constexpr size_t HEADER_SIZE = 80, LEVEL_INDEX_ENTRY_SIZE = 24;
+
+/// Khronos Data Format colour models and channel IDs.
+/// @sa https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html
+enum : uint8_t
+{
+	DF_MODEL_RGBSDA = 1,
+	DF_MODEL_BC1A = 128,
+	DF_MODEL_BC3 = 130,
+	DF_MODEL_BC4 = 131,
+	DF_MODEL_BC5 = 132,
+	DF_MODEL_BC7 = 134,
+
+	DF_CHANNEL_R = 0,
+	DF_CHANNEL_G = 1,
+	DF_CHANNEL_B = 2,
+	DF_CHANNEL_BC1A_ALPHA = 15,
+	DF_CHANNEL_BC3_ALPHA = 15,
+	DF_CHANNEL_A = 15,
+
+	DF_PRIMARIES_BT709 = 1,
+	DF_TRANSFER_LINEAR = 1
+};
+
+struct dfd_sample final
+{
+	uint8_t channel;
+	uint16_t bit_offset;
+	uint8_t bit_length;
+	uint32_t upper;
+};
+
+template<typename T>
+[[nodiscard]] static T read_le(std::span<const unsigned char> data, size_t offset);
+template<typename T>
+static void write_le(std::vector<unsigned char>& out, T val);
+
+/// @brief Build a basic Data Format Descriptor for the given format.
+[[nodiscard]] static std::vector<unsigned char> make_dfd(ktx::format);
+/// @returns How many bytes mip level `level` of an image of this format and
+/// size occupies, at the least.
+[[nodiscard]] static uint64_t level_size(
+	uint32_t fmt, uint32_t width, uint32_t height, size_t level) noexcept;
+
+uint32_t ktx::block_size(const uint32_t fmt) noexcept
+{
+	switch (static_cast<format>(fmt))
+	{
+	case format::R8G8B8A8_UNORM: return 4;
+	case format::BC1_RGB_UNORM:
+	case format::BC1_RGBA_UNORM:
+	case format::BC4_UNORM: return 8;
+	case format::BC3_UNORM:
+	case format::BC5_UNORM:
+	case format::BC7_UNORM: return 16;
+	default: return 0;
+	}
+}
+
+bool ktx::is_block_compressed(const uint32_t fmt) noexcept
+{
+	return block_size(fmt) != 0 && static_cast<format>(fmt) != format::R8G8B8A8_UNORM;
+}
+
+std::optional<ktx::texture> ktx::parse(
+	const std::span<const unsigned char> data, std::string& error)
+{
+	if (data.size() < HEADER_SIZE ||
+		!std::equal(IDENTIFIER.begin(), IDENTIFIER.end(), data.begin()))
+	{
+		error = "not a KTX2 file";
+		return std::nullopt;
+	}
+
+	texture ret = {};
+	ret.vk_format = read_le<uint32_t>(data, 12);
+	ret.width = read_le<uint32_t>(data, 20);
+	ret.height = read_le<uint32_t>(data, 24);
+
+	const uint32_t depth = read_le<uint32_t>(data, 28),
+				   layer_c = read_le<uint32_t>(data, 32),
+				   face_c = read_le<uint32_t>(data, 36),
+				   level_c = read_le<uint32_t>(data, 40),
+				   supercompression = read_le<uint32_t>(data, 44);
+
+	if (block_size(ret.vk_format) == 0)
+	{
+		error = "unsupported pixel format " + std::to_string(ret.vk_format);
+		return std::nullopt;
+	}
+
+	if (supercompression != 0)
+	{
+		error = "supercompressed data is unsupported";
+		return std::nullopt;
+	}
+
+	if (depth != 0 || layer_c > 1 || face_c != 1 || ret.width == 0 || ret.height == 0)
+	{
+		error = "only single 2D images are supported";
+		return std::nullopt;
+	}
+
+	if (level_c == 0)
+	{
+		error = "file contains no mip levels";
+		return std::nullopt;
+	}
+
+	// A full mip chain ends at 1x1
+	if (level_c > static_cast<uint32_t>(std::bit_width(std::max(ret.width, ret.height))))
+	{
+		error = "more mip levels than a full chain has";
+		return std::nullopt;
+	}
+
+	if (data.size() < HEADER_SIZE + LEVEL_INDEX_ENTRY_SIZE * level_c)
+	{
+		error = "truncated level index";
+		return std::nullopt;
+	}
+
+	ret.levels.resize(level_c);
+
+	for (size_t i = 0; i < level_c; i++)
+	{
+		const size_t entry = HEADER_SIZE + LEVEL_INDEX_ENTRY_SIZE * i;
+		auto& lvl = ret.levels[i];
+		lvl.offset = read_le<uint64_t>(data, entry);
+		lvl.length = read_le<uint64_t>(data, entry + 8);
+
+		// Compare against what remains, so that nothing is ever summed
+		if (lvl.offset > data.size() || lvl.length > data.size() - lvl.offset ||
+			lvl.offset % block_size(ret.vk_format) != 0)
+		{
+			error = "level " + std::to_string(i) + " lies out of bounds or misaligned";
+			return std::nullopt;
+		}
+
+		if (lvl.length < level_size(ret.vk_format, ret.width, ret.height, i))
+		{
+			error = "level " + std::to_string(i) + " is too short for its dimensions";
+			return std::nullopt;
+		}
+	}
+
+	return ret;
+}
+
+std::vector<unsigned char> ktx::write(
+	const format fmt, const uint32_t width, const uint32_t height,
+	const std::vector<std::vector<unsigned char>>& levels)
+{
+	const uint32_t level_c = static_cast<uint32_t>(levels.size());
+	const std::vector<unsigned char> dfd = make_dfd(fmt);
+	const size_t dfd_offset = HEADER_SIZE + LEVEL_INDEX_ENTRY_SIZE * level_c;
+	const uint64_t align = std::lcm<uint64_t>(block_size(static_cast<uint32_t>(fmt)), 4);
+
+	// Level data is stored smallest mip first
+	std::vector<uint64_t> offsets(level_c);
+	uint64_t cursor = dfd_offset + dfd.size();
+
+	for (size_t i = level_c; i-- > 0;)
+	{
+		cursor = (cursor + align - 1) / align * align;
+		offsets[i] = cursor;
+		cursor += levels[i].size();
+	}
+
+	std::vector<unsigned char> ret;
+	ret.reserve(cursor);
+	ret.insert(ret.end(), IDENTIFIER.begin(), IDENTIFIER.end());
+
+	write_le<uint32_t>(ret, static_cast<uint32_t>(fmt));
+	write_le<uint32_t>(ret, 1); // Type size; 1 for block-compressed formats
+	write_le<uint32_t>(ret, width);
+	write_le<uint32_t>(ret, height);
+	write_le<uint32_t>(ret, 0); // Depth
+	write_le<uint32_t>(ret, 0); // Layer count
+	write_le<uint32_t>(ret, 1); // Face count
+	write_le<uint32_t>(ret, level_c);
+	write_le<uint32_t>(ret, 0); // Supercompression scheme
+
+	write_le<uint32_t>(ret, static_cast<uint32_t>(dfd_offset));
+	write_le<uint32_t>(ret, static_cast<uint32_t>(dfd.size()));
+	write_le<uint32_t>(ret, 0); // Key/value data offset
+	write_le<uint32_t>(ret, 0); // Key/value data length
+	write_le<uint64_t>(ret, 0); // Supercompression global data offset
+	write_le<uint64_t>(ret, 0); // Supercompression global data length
+
+	for (size_t i = 0; i < level_c; i++)
+	{
+		write_le<uint64_t>(ret, offsets[i]);
+		write_le<uint64_t>(ret, levels[i].size());
+		write_le<uint64_t>(ret, levels[i].size()); // Uncompressed length
+	}
+
+	ret.insert(ret.end(), dfd.begin(), dfd.end());
+
+	for (size_t i = level_c; i-- > 0;)
+	{
+		ret.resize(offsets[i], 0);
+		ret.insert(ret.end(), levels[i].begin(), levels[i].end());
+	}
+
+	return ret;
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+template<typename T>
+static T read_le(const std::span<const unsigned char> data, const size_t offset)
+{
+	T ret = 0;
+
+	for (size_t i = 0; i < sizeof(T); i++)
+		ret |= static_cast<T>(data[offset + i]) << (i * 8);
+
+	return ret;
+}
+
+template<typename T>
+static void write_le(std::vector<unsigned char>& out, const T val)
+{
+	for (size_t i = 0; i < sizeof(T); i++)
+		out.push_back(static_cast<unsigned char>((val >> (i * 8)) & 0xFF));
+}
+
+static uint64_t level_size(
+	const uint32_t fmt, const uint32_t width, const uint32_t height,
+	const size_t level) noexcept
+{
+	const uint64_t w = std::max(width >> level, 1u), h = std::max(height >> level, 1u);
+
+	if (!ktx::is_block_compressed(fmt)) return w * h * ktx::block_size(fmt);
+
+	return ((w + 3) / 4) * ((h + 3) / 4) * ktx::block_size(fmt);
+}
+
+static std::vector<unsigned char> make_dfd(const ktx::format fmt)
+{
+	uint8_t model = DF_MODEL_RGBSDA, block_dim = 3;
+	std::vector<dfd_sample> samples;
+
+	switch (fmt)
+	{
+	case ktx::format::R8G8B8A8_UNORM:
+		block_dim = 0;
+		samples = { { DF_CHANNEL_R, 0, 7, 255 },
+					{ DF_CHANNEL_G, 8, 7, 255 },
+					{ DF_CHANNEL_B, 16, 7, 255 },
+					{ DF_CHANNEL_A, 24, 7, 255 } };
+		break;
+	case ktx::format::BC1_RGB_UNORM:
+		model = DF_MODEL_BC1A;
+		samples = { { DF_CHANNEL_R, 0, 63, UINT32_MAX } };
+		break;
+	case ktx::format::BC1_RGBA_UNORM:
+		// Both samples cover the whole block; the second marks it as punch-through
+		model = DF_MODEL_BC1A;
+		samples = { { DF_CHANNEL_R, 0, 63, UINT32_MAX },
+					{ DF_CHANNEL_BC1A_ALPHA, 0, 63, UINT32_MAX } };
+		break;
+	case ktx::format::BC3_UNORM:
+		model = DF_MODEL_BC3;
+		samples = { { DF_CHANNEL_BC3_ALPHA, 0, 63, UINT32_MAX },
+					{ DF_CHANNEL_R, 64, 63, UINT32_MAX } };
+		break;
+	case ktx::format::BC4_UNORM:
+		model = DF_MODEL_BC4;
+		samples = { { DF_CHANNEL_R, 0, 63, UINT32_MAX } };
+		break;
+	case ktx::format::BC5_UNORM:
+		model = DF_MODEL_BC5;
+		samples = { { DF_CHANNEL_R, 0, 63, UINT32_MAX },
+					{ DF_CHANNEL_G, 64, 63, UINT32_MAX } };
+		break;
+	case ktx::format::BC7_UNORM:
+		model = DF_MODEL_BC7;
+		samples = { { DF_CHANNEL_R, 0, 127, UINT32_MAX } };
+		break;
+	}
+
+	const uint32_t block_bytes = 24 + 16 * static_cast<uint32_t>(samples.size());
+	std::vector<unsigned char> ret;
+
+	write_le<uint32_t>(ret, 4 + block_bytes); // Total size
+	write_le<uint32_t>(ret, 0); // Vendor ID (Khronos), descriptor type (basic)
+	write_le<uint32_t>(ret, 2 | (block_bytes << 16)); // Version 1.3, block size
+	write_le<uint32_t>(
+		ret, model | (DF_PRIMARIES_BT709 << 8) | (DF_TRANSFER_LINEAR << 16));
+	write_le<uint32_t>(ret, block_dim | (block_dim << 8));
+	write_le<uint32_t>(ret, ktx::block_size(static_cast<uint32_t>(fmt)));
+	write_le<uint32_t>(ret, 0);
+
+	for (const auto& s : samples)
+	{
+		write_le<uint32_t>(
+			ret, s.bit_offset | (static_cast<uint32_t>(s.bit_length) << 16) |
+					 (static_cast<uint32_t>(s.channel) << 24));
+		write_le<uint32_t>(ret, 0); // Sample position
+		write_le<uint32_t>(ret, 0); // Lower
+		write_le<uint32_t>(ret, s.upper);
+	}
+
+	return ret;
+}
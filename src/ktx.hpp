@@ -0,0 +1,66 @@
+/**
+ * @file ktx.hpp
+ * @brief Reading and writing of KTX2 texture containers.
+ *
+ * Only the subset of the format which Machinate produces and consumes is supported:
+ * single 2D images (no arrays, cubemaps or 3D textures), without supercompression.
+ * @sa https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace mxn::ktx
+{
+	constexpr std::array<unsigned char, 12> IDENTIFIER = {
+		0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+	};
+
+	/// @brief Values of `VkFormat` which Machinate knows how to describe.
+	/// Kept here so that tools need not include Vulkan headers.
+	enum class format : uint32_t
+	{
+		R8G8B8A8_UNORM = 37,
+		BC1_RGB_UNORM = 131,
+		BC1_RGBA_UNORM = 133,
+		BC3_UNORM = 137,
+		BC4_UNORM = 139,
+		BC5_UNORM = 141,
+		BC7_UNORM = 145
+	};
+
+	struct level final
+	{
+		/// Both relative to the start of the file.
+		uint64_t offset = 0, length = 0;
+	};
+
+	struct texture final
+	{
+		uint32_t vk_format = 0, width = 0, height = 0;
+		/// Level 0 is the full-resolution image.
+		std::vector<level> levels;
+	};
+
+	/// @returns Bytes per 4x4 block for block-compressed formats, bytes per
+	/// texel otherwise, and 0 if `fmt` is not one of `ktx::format`.
+	[[nodiscard]] uint32_t block_size(uint32_t fmt) noexcept;
+	[[nodiscard]] bool is_block_compressed(uint32_t fmt) noexcept;
+
+	/// @brief Validate the header and level index of a KTX2 file in memory.
+	/// @param error Receives a description of the problem if parsing fails.
+	[[nodiscard]] std::optional<texture> parse(
+		std::span<const unsigned char> data, std::string& error);
+
+	/// @brief Serialise a complete KTX2 file.
+	/// @param levels Image data per mip level, level 0 first.
+	[[nodiscard]] std::vector<unsigned char> write(
+		format, uint32_t width, uint32_t height,
+		const std::vector<std::vector<unsigned char>>& levels);
+} // namespace mxn::ktx
@@ -2,18 +2,26 @@
 
 #include "console.hpp"
 #include "file.hpp"
+#include "file_watch.hpp"
 #include "log.hpp"
 #include "media.hpp"
 #include "script.hpp"
+#include "script_arena.hpp"
+#include "script_gc.hpp"
+#include "script_pool.hpp"
 #include "src/defines.hpp"
 #include "string.hpp"
 #include "time.hpp"
 #include "vk/context.hpp"
+#include "vk/model.hpp"
+#include "vk/upload.hpp"
+#include "world.hpp"
 
 #include <SDL2/SDL.h>
 #include <Tracy.hpp>
 #include <imgui_impl_sdl.h>
 #include <imgui_impl_vulkan.h>
+#include <magic_enum.hpp>
 #include <sol/sol.hpp>
 
 int main(const int arg_c, const char* const argv[])
@@ -45,8 +53,33 @@ int main(const int arg_c, const char* const argv[])
 	mxn::vfs_init(argv[0]);
 	mxn::vfs_mount("assets", "/");
 
-	sol::state lua;
+#ifdef MXN_HOTRELOAD
+	// Both take precedence over the build tree's assets; recompiled shaders go
+	// to the latter, which is emptied first so as not to shadow newer builds
+	const auto hotreload_path = std::filesystem::path(mxn::user_path) / "hotreload";
+	std::filesystem::remove_all(hotreload_path);
+	std::filesystem::create_directories(hotreload_path / "shaders");
+	mxn::vfs_mount(MXN_ASSET_SOURCE_DIR, "/", false);
+	mxn::vfs_mount(hotreload_path, "/", false);
+
+	mxn::file_watcher asset_watcher;
+	asset_watcher.watch(MXN_ASSET_SOURCE_DIR, "/");
+#endif
+
+	// Warm the page cache with whatever the first frames are known to need
+	if (mxn::vfs_exists("/prefetch.txt")) mxn::vfs_prefetch("/prefetch.txt");
+
+	mxn::lua::arena lua_mem("Client", 256 * 1024 * 1024);
+	sol::state lua = mxn::lua::make_state(lua_mem);
 	mxn::lua::setup_state(lua);
+	mxn::lua::gc_pacer lua_pacer("Client");
+	lua_pacer.attach(lua);
+	auto lua_gc_budget = std::chrono::microseconds(1000);
+
+	// Fixed rather than derived from the hardware, so that simulations
+	// partitioned across lanes play out identically on every machine
+	static constexpr uint32_t LUA_LANE_COUNT = 4;
+	mxn::lua::state_pool lua_lanes(LUA_LANE_COUNT, 64 * 1024 * 1024);
 
 	mxn::media_context media;
 	mxn::window main_window("Machinate");
@@ -55,6 +88,40 @@ int main(const int arg_c, const char* const argv[])
 	mxn::camera camera;
 	mxn::vk::ubo<mxn::vk::camera> vk_cam(vulkan, "MXN: UBO, Camera");
 
+	// Every model under /meshes is drawn each frame, with placeholder textures
+	std::vector<mxn::vk::model> models;
+
+	if (mxn::vfs_exists("/meshes"))
+		models = mxn::vk::model_importer(vulkan, { "/meshes" }).join();
+
+	const auto& default_mat = vulkan.acquire_material({}, {}, "Default");
+
+	// The world's terrain: a flat square of chunks around the origin, until
+	// worlds can be loaded. All of it is uploaded in one submission
+	static constexpr int TERRAIN_RADIUS = 2;
+	std::vector<mxn::heightmap> heightmaps;
+
+	for (int y = -TERRAIN_RADIUS; y <= TERRAIN_RADIUS; y++)
+		for (int x = -TERRAIN_RADIUS; x <= TERRAIN_RADIUS; x++)
+			heightmaps.push_back({ .position = { x, y } });
+
+	{
+		mxn::vk::upload_batch batch(vulkan);
+
+		for (const auto& hmap : heightmaps)
+			if (!vulkan.terrain.set(vulkan, batch, hmap))
+				MXN_WARNF(
+					"No room for terrain chunk {}, {}", hmap.position.x, hmap.position.y);
+	}
+
+	// None are generated yet, but scripts can already look for them
+	std::vector<mxn::world_chunk> world_chunks;
+
+	// None of these may be resized or freed while bound
+	mxn::lua::bind_view(lua, "point_lights", vulkan.point_lights());
+	mxn::lua::bind_view(lua, "heightmaps", heightmaps);
+	mxn::lua::bind_view(lua, "world_chunks", world_chunks);
+
 	// Script backend initialisation
 
 	bool running = true;
@@ -70,8 +137,56 @@ int main(const int arg_c, const char* const argv[])
 							   MXN_LOG(
 								   "Print information about the Vulkan renderer or this "
 								   "system's Vulkan implementation.");
-							   MXN_LOG("Usage: vkdiag ext|gpu|queue");
+							   MXN_LOG("Usage: vkdiag cache|ext|gpu|queue");
 						   } });
+	console->add_command(
+		{ .key = "cluster_cull",
+		  .func = [&](const std::vector<std::string>& args) -> void {
+			  if (args.size() < 2)
+			  {
+				  MXN_LOGF(
+					  "Cluster culling: {}", magic_enum::enum_name(vulkan.cull_mode.load()));
+				  return;
+			  }
+
+			  const auto mode = magic_enum::enum_cast<mxn::vk::cluster_cull>(args[1]);
+
+			  if (!mode.has_value())
+			  {
+				  MXN_LOG("Usage: cluster_cull gpu|cpu|off");
+				  return;
+			  }
+
+			  vulkan.cull_mode = mode.value();
+		  },
+		  .help = [](const std::vector<std::string>&) -> void {
+			  MXN_LOG("Choose how meshlets are culled, or print the current choice.");
+			  MXN_LOG("Usage: cluster_cull gpu|cpu|off");
+		  } });
+	console->add_command(
+		{ .key = "terrain_tess",
+		  .func = [&](const std::vector<std::string>& args) -> void {
+			  if (args.size() < 2)
+			  {
+				  MXN_LOGF(
+					  "Terrain tessellation: {}",
+					  vulkan.tessellate_terrain.load() ? "on" : "off");
+				  return;
+			  }
+
+			  if (args[1] != "on" && args[1] != "off")
+			  {
+				  MXN_LOG("Usage: terrain_tess on|off");
+				  return;
+			  }
+
+			  vulkan.tessellate_terrain = args[1] == "on";
+		  },
+		  .help = [](const std::vector<std::string>&) -> void {
+			  MXN_LOG("Toggle subdivision of terrain near the camera, or print whether "
+					  "it is on. Has no effect if the GPU lacks tessellation shaders.");
+			  MXN_LOG("Usage: terrain_tess on|off");
+		  } });
 	console->add_command(
 		{ .key = "file",
 		  .func = [&](const std::vector<std::string>& args) -> void {
@@ -109,10 +224,68 @@ int main(const int arg_c, const char* const argv[])
 	console->add_command(
 		{ .key = "lua_heap",
 		  .func = [&](const std::vector<std::string>&) -> void {
-			  MXN_LOGF("Client Lua heap size: {}B", lua.memory_used());
+			  lua_mem.report(lua);
+			  lua_lanes.report_memory();
 		  },
 		  .help = [&](const std::vector<std::string>&) -> void {
-			  MXN_LOG("Report on the heap sizes in bytes of all Lua states.");
+			  MXN_LOG("Report on the heap usage, peak, and budget in bytes of all "
+					  "Lua states.");
+		  } });
+	console->add_command(
+		{ .key = "lua_gc",
+		  .func = [&](const std::vector<std::string>& args) -> void {
+			  if (args.size() >= 3 && (args[1] == "budget" || args[1] == "lane_budget"))
+			  {
+				  const auto us = std::chrono::microseconds(
+					  std::strtoul(args[2].c_str(), nullptr, 10));
+
+				  if (args[1] == "budget")
+					  lua_gc_budget = us;
+				  else
+					  lua_lanes.gc_budget = us;
+			  }
+
+			  MXN_LOGF(
+				  "Lua GC budgets: {}us per frame (client), {}us per tick (lanes)",
+				  lua_gc_budget.count(), lua_lanes.gc_budget.count());
+			  lua_pacer.report();
+			  lua_lanes.report_gc();
+		  },
+		  .help = [](const std::vector<std::string>&) -> void {
+			  MXN_LOG("Report Lua garbage collection pauses, or set the time each "
+					  "state may spend collecting per frame or tick.");
+			  MXN_LOG("Usage: lua_gc [budget|lane_budget <microseconds>]");
+		  } });
+	console->add_command(
+		{ .key = "lua_lanes",
+		  .func = [&](const std::vector<std::string>& args) -> void {
+			  if (args.size() >= 3 && args[1] == "run")
+			  {
+				  lua_lanes.run_file(args[2]);
+				  return;
+			  }
+
+			  if (args.size() >= 2 && args[1] == "tick")
+			  {
+				  const auto count =
+					  args.size() >= 3 ? std::strtoul(args[2].c_str(), nullptr, 10) : 1ul;
+
+				  for (unsigned long i = 0; i < count; i++) lua_lanes.tick();
+
+				  for (const auto& msg : lua_lanes.take_messages())
+					  MXN_LOGF("Lua lane {}: {}", msg.from, msg.data);
+
+				  return;
+			  }
+
+			  MXN_LOGF(
+				  "{} Lua lanes, {} ticks run.", lua_lanes.lane_count(),
+				  lua_lanes.ticks_run());
+		  },
+		  .help = [](const std::vector<std::string>&) -> void {
+			  MXN_LOG("Run a script in every simulation Lua lane, or tick all lanes "
+					  "and print what they sent to the host.");
+			  MXN_LOG("Usage: lua_lanes run <path> | lua_lanes tick [count]");
 		  } });
 	console->add_command({ .key = "sound",
 						   .func = [&](const std::vector<std::string>& args) -> void {
@@ -149,6 +322,7 @@ int main(const int arg_c, const char* const argv[])
 
 		do
 		{
+			vulkan.reload_shaders();
 			main_window.new_imgui_frame();
 
 			if (draw_imgui_metrics) ImGui::ShowMetricsWindow(&draw_imgui_metrics);
@@ -163,7 +337,14 @@ int main(const int arg_c, const char* const argv[])
 
 			vulkan.set_camera(vk_cam);
 
+			for (const auto& model : models) vulkan.cull_clusters(model);
+
 			vulkan.start_render_record();
+			vulkan.bind_material(default_mat);
+			vulkan.record_terrain();
+
+			for (const auto& model : models) vulkan.record_draw(model);
+
 			vulkan.end_render_record();
 
 			const auto& sema_depth = vulkan.submit_prepass({});
@@ -216,10 +397,49 @@ int main(const int arg_c, const char* const argv[])
 		} // while (SDL_PollEvent(&event) != 0)
 
 		console->run_pending_commands();
+
+#ifdef MXN_HOTRELOAD
+		for (const auto& path : asset_watcher.poll())
+		{
+			const auto ext = path.extension();
+
+			if (ext == ".lua" || ext == ".tl")
+			{
+				mxn::lua::reload_file(lua, path);
+				lua_lanes.reload_file(path);
+			}
+			else if (path.parent_path() == "/shaders" && ext != ".spv")
+			{
+				const auto spv = path.filename().string() + ".spv";
+				const auto cmd = fmt::format(
+					"glslc \"{}{}\" -o \"{}\"", MXN_ASSET_SOURCE_DIR, path.string(),
+					(hotreload_path / "shaders" / spv).string());
+
+				if (std::system(cmd.c_str()) == 0)
+					vulkan.request_shader_reload(spv);
+				else
+					MXN_ERRF("Failed to recompile shader: {}", path.string());
+			}
+		}
+#endif
+
+		// Collect script garbage for a fixed budget per iteration (see `lua_gc`),
+		// however long the rest of the iteration took
+		lua_pacer.step(lua, lua_gc_budget);
+		lua_pacer.plot();
+		lua_mem.plot(lua);
 	} while (running);
 
 	render_thread.join();
 
+	// The state outlives what these point into
+	mxn::lua::unbind_view(lua, "point_lights");
+	mxn::lua::unbind_view(lua, "heightmaps");
+	mxn::lua::unbind_view(lua, "world_chunks");
+
+	for (auto& model : models) model.destroy(vulkan);
+
+	vulkan.release_material(default_mat);
 	vk_cam.destroy(vulkan);
 
 	MXN_LOGF("Runtime duration: {}", mxn::runtime_s());
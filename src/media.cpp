@@ -13,14 +13,28 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 #include <Tracy.hpp>
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cctype>
 #include <imgui_impl_sdl.h>
 #include <imgui_impl_vulkan.h>
 #include <stdexcept>
+#include <string_view>
 
 static constexpr uint32_t SDL_INIT_FLAGS =
 	SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO;
 
+/// Extensions of the formats which SDL_audiolib's decoders can handle.
+static constexpr std::array<std::string_view, 11> AUDIO_EXTENSIONS = {
+	".flac", ".it", ".mid", ".midi", ".mod", ".mp3",
+	".ogg", ".opus", ".s3m", ".wav", ".xm"
+};
+
+/// @returns `true` if `path` has an extension listed in `AUDIO_EXTENSIONS`,
+/// regardless of case.
+[[nodiscard]] static bool is_audio_file(const std::filesystem::path& path);
+
 mxn::window::window(const std::string& name, int res_x, int res_y) noexcept
 {
 	assert(SDL_WasInit(SDL_INIT_FLAGS) == SDL_INIT_FLAGS);
@@ -66,7 +80,7 @@ void mxn::window::handle_event(const SDL_Event& event) noexcept
 	}
 }
 
-PHYSFS_EnumerateCallbackResult mxn::media_context::load_audio_memory(
+PHYSFS_EnumerateCallbackResult mxn::media_context::collect_files(
 	void* data, const char* orig_dir, const char* fname)
 {
 	char p[256];
@@ -74,26 +88,16 @@ PHYSFS_EnumerateCallbackResult mxn::media_context::load_audio_memory(
 	strcat(p, "/");
 	strcat(p, fname);
 
-	const std::filesystem::path path(p);
-
 	if (vfs_isdir(p))
 	{
-		vfs_recur(p, data, load_audio_memory);
+		vfs_recur(p, data, collect_files);
 		return PHYSFS_ENUM_OK;
 	}
 
-	const auto buf = vfs_read(path);
-
-	SDL_RWops* rw = SDL_RWFromConstMem(
-		reinterpret_cast<const void*>(buf.data()),
-		buf.size() * sizeof(decltype(buf)::value_type));
+	if (is_audio_file(p))
+		reinterpret_cast<std::vector<std::string>*>(data)->emplace_back(p);
 
-	if (Aulib::Decoder::decoderFor(rw) == nullptr)
-		return PHYSFS_ENUM_OK;
-
-	auto audiomem = reinterpret_cast<decltype(media_context::audiomem)*>(data);
-	(*audiomem)[path.string()] = buf;
-	return PHYSFS_ENUM_STOP;
+	return PHYSFS_ENUM_OK;
 }
 
 mxn::media_context::media_context()
@@ -115,7 +119,19 @@ mxn::media_context::media_context()
 
 	alive = true;
 
-	vfs_recur("", reinterpret_cast<void*>(&audiomem), load_audio_memory);
+	// Only list audio files here; they are read in parallel on the VFS I/O
+	// threads, and checked for decodability by the worker, so that startup
+	// needn't wait. Other files are left to their own loaders, so that this
+	// doesn't take reads which `vfs_prefetch()` issued on their behalf
+	std::vector<std::string> files;
+	vfs_recur("", reinterpret_cast<void*>(&files), collect_files);
+	audio_pending.reserve(files.size());
+
+	for (auto& file : files)
+	{
+		auto future = vfs_read_async(file);
+		audio_pending.emplace_back(std::move(file), std::move(future));
+	}
 
 	audio_worker = std::thread([&]() -> void {
 		tracy::SetThreadName("MXN: Audio Worker");
@@ -123,6 +139,7 @@ mxn::media_context::media_context()
 		while (alive)
 		{
 			audio_mutex.lock();
+			resolve_audio();
 
 			sfx.erase(std::remove_if(
 				sfx.begin(), sfx.end(),
@@ -168,6 +185,9 @@ void mxn::media_context::stop_all_sound()
 void mxn::media_context::play_sound(const std::filesystem::path& path,
 	float volume, float pan)
 {
+	std::scoped_lock lock(audio_mutex);
+	resolve_audio();
+
 	const auto mem = audiomem.find(path.string());
 	if (mem == audiomem.end())
 	{
@@ -177,7 +197,7 @@ void mxn::media_context::play_sound(const std::filesystem::path& path,
 
 	SDL_RWops* rw = SDL_RWFromConstMem(
 		reinterpret_cast<const void*>(mem->second.data()),
-		mem->second.size() * sizeof(decltype(mem->second)::value_type));
+		static_cast<int>(mem->second.size()));
 
 	auto decoder = Aulib::Decoder::decoderFor(rw);
 
@@ -187,13 +207,11 @@ void mxn::media_context::play_sound(const std::filesystem::path& path,
 		return;
 	}
 
-	audio_mutex.lock();
 	sfx.push_back(std::make_unique<Aulib::Stream>(
 		rw, std::move(decoder), std::make_unique<Aulib::ResamplerSpeex>(), true));
 	sfx.back()->play();
 	sfx.back()->setVolume(volume);
 	sfx.back()->setStereoPosition(pan);
-	audio_mutex.unlock();
 }
 
 void mxn::media_context::stop_music()
@@ -203,6 +221,9 @@ void mxn::media_context::stop_music()
 
 void mxn::media_context::play_music(const std::filesystem::path& path)
 {
+	std::scoped_lock lock(audio_mutex);
+	resolve_audio();
+
 	const auto mem = audiomem.find(path.string());
 	if (mem == audiomem.end())
 	{
@@ -212,7 +233,7 @@ void mxn::media_context::play_music(const std::filesystem::path& path)
 
 	SDL_RWops* rw = SDL_RWFromConstMem(
 		reinterpret_cast<const void*>(mem->second.data()),
-		mem->second.size() * sizeof(decltype(mem->second)::value_type));
+		static_cast<int>(mem->second.size()));
 
 	auto decoder = Aulib::Decoder::decoderFor(rw);
 
@@ -222,7 +243,6 @@ void mxn::media_context::play_music(const std::filesystem::path& path)
 		return;
 	}
 
-	audio_mutex.lock();
 	music.reset();
 
 	auto& stream = music.emplace(
@@ -230,6 +250,48 @@ void mxn::media_context::play_music(const std::filesystem::path& path)
 	
 	if (!stream.play(0))
 		MXN_ERRF("Failed to start music: {}", SDL_GetError());
+}
+
+void mxn::media_context::resolve_audio()
+{
+	if (audio_pending.empty()) return;
+
+	ZoneScopedN("MXN: Audio Resolve");
+
+	for (auto& [path, future] : audio_pending)
+	{
+		vfs_mapping buf;
+
+		try
+		{
+			buf = future.get();
+		}
+		catch (const std::future_error&)
+		{
+			continue; // Abandoned at shutdown
+		}
+
+		SDL_RWops* rw = SDL_RWFromConstMem(
+			reinterpret_cast<const void*>(buf.data()), static_cast<int>(buf.size()));
+		const bool decodable = Aulib::Decoder::decoderFor(rw) != nullptr;
+		SDL_RWclose(rw);
+
+		if (decodable) audiomem[path] = std::move(buf);
+	}
+
+	audio_pending.clear();
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+static bool is_audio_file(const std::filesystem::path& path)
+{
+	std::string ext = path.extension().string();
+
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](const char c) -> char {
+		return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	});
 
-	audio_mutex.unlock();
+	return std::find(AUDIO_EXTENSIONS.begin(), AUDIO_EXTENSIONS.end(), ext) !=
+		   AUDIO_EXTENSIONS.end();
 }
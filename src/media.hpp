@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "file.hpp"
 #include "preproc.hpp"
 
 #include <Aulib/Stream.h>
@@ -87,13 +88,20 @@ namespace mxn
 		bool alive;
 		std::thread audio_worker;
 		std::mutex audio_mutex;
-		std::unordered_map<std::string, std::vector<unsigned char>> audiomem;
+		std::unordered_map<std::string, vfs_mapping> audiomem;
+		/// Audio files being read in the background; moved into `audiomem` by
+		/// `resolve_audio()` if they are decodable.
+		std::vector<std::pair<std::string, std::shared_future<vfs_mapping>>>
+			audio_pending;
 		std::vector<std::unique_ptr<Aulib::Stream>> sfx;
 		std::optional<Aulib::Stream> music;
 
-		static PHYSFS_EnumerateCallbackResult load_audio_memory(
+		static PHYSFS_EnumerateCallbackResult collect_files(
 			void* data, const char* orig_dir, const char* fname);
 
+		/// @note `audio_mutex` must be held.
+		void resolve_audio();
+
 	public:
 		media_context();
 		~media_context();
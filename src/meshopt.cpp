@@ -0,0 +1,424 @@
+/**
+ * @file meshopt.cpp
+ * @brief Reordering of triangle meshes for efficient rendering.
+ */
+
+#include "meshopt.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+using namespace mxn;
+
+/// @brief For each vertex, the triangles using it, stored contiguously.
+struct adjacency final
+{
+	std::vector<uint32_t> offsets, counts, triangles;
+
+	adjacency(std::span<const uint32_t> indices, size_t vert_count);
+
+	[[nodiscard]] std::span<const uint32_t> of(const uint32_t v) const noexcept
+	{
+		return { triangles.data() + offsets[v], counts[v] };
+	}
+};
+
+/// @brief Fill in the bounding sphere and normal cone of a meshlet whose
+/// index range has already been set.
+static void compute_bounds(
+	meshopt::meshlet&, std::span<const uint32_t> indices, const float* positions,
+	size_t stride);
+
+/// @brief Simulate the FIFO cache, and note the triangles at which it has
+/// effectively been flushed: those whose vertices are all misses.
+[[nodiscard]] static std::vector<size_t> cluster_starts(
+	std::span<const uint32_t> indices, size_t vert_count, size_t cache_size);
+
+float meshopt::acmr(
+	const std::span<const uint32_t> indices, const size_t vert_count,
+	const size_t cache_size)
+{
+	if (indices.size() < 3) return 0.0f;
+
+	// Each vertex's insertion time into the FIFO; `cache_size` inserts later, it's gone
+	std::vector<size_t> inserted(vert_count, 0);
+	size_t time = cache_size + 1, misses = 0;
+
+	for (const auto i : indices)
+	{
+		if (time - inserted[i] > cache_size)
+		{
+			inserted[i] = time++;
+			misses++;
+		}
+	}
+
+	return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+void meshopt::optimise_vertex_cache(
+	const std::span<uint32_t> indices, const size_t vert_count, const size_t cache_size)
+{
+	assert(indices.size() % 3 == 0);
+
+	const size_t tri_c = indices.size() / 3;
+	const adjacency adj(indices, vert_count);
+
+	// Triangles yet to be emitted which use each vertex
+	std::vector<uint32_t> live = adj.counts;
+	std::vector<size_t> cache_time(vert_count, 0);
+	std::vector<bool> emitted(tri_c, false);
+	std::vector<uint32_t> dead_ends, candidates, ret;
+	ret.reserve(indices.size());
+
+	size_t time = cache_size + 1;
+	uint32_t cursor = 0;
+	int64_t fan = vert_count > 0 ? 0 : -1;
+
+	while (fan >= 0)
+	{
+		candidates.clear();
+
+		// Emit every remaining triangle around the fanning vertex
+		for (const auto t : adj.of(static_cast<uint32_t>(fan)))
+		{
+			if (emitted[t]) continue;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				const uint32_t v = indices[t * 3 + k];
+				ret.push_back(v);
+				dead_ends.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+
+				if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+			}
+
+			emitted[t] = true;
+		}
+
+		// Choose the next fanning vertex: the oldest candidate which will
+		// still be in the cache once all its triangles have been emitted
+		fan = -1;
+		size_t best_priority = 0;
+
+		for (const auto v : candidates)
+		{
+			if (live[v] == 0) continue;
+
+			size_t priority = 0;
+
+			if (time - cache_time[v] + 2 * live[v] <= cache_size)
+				priority = time - cache_time[v];
+
+			if (fan < 0 || priority > best_priority)
+			{
+				best_priority = priority;
+				fan = v;
+			}
+		}
+
+		if (fan >= 0) continue;
+
+		// Dead end; backtrack through recently-used vertices, then scan
+		while (!dead_ends.empty() && fan < 0)
+		{
+			const uint32_t v = dead_ends.back();
+			dead_ends.pop_back();
+
+			if (live[v] > 0) fan = v;
+		}
+
+		while (cursor < vert_count && fan < 0)
+		{
+			if (live[cursor] > 0) fan = cursor;
+
+			cursor++;
+		}
+	}
+
+	assert(ret.size() == indices.size());
+	std::copy(ret.begin(), ret.end(), indices.begin());
+}
+
+void meshopt::optimise_overdraw(
+	const std::span<uint32_t> indices, const float* const positions, const size_t stride,
+	const size_t vert_count, const float threshold)
+{
+	using vec3 = std::array<float, 3>;
+
+	const auto pos = [positions, stride](const uint32_t v) -> vec3 {
+		const float* const p = reinterpret_cast<const float*>(
+			reinterpret_cast<const unsigned char*>(positions) + v * stride);
+		return { p[0], p[1], p[2] };
+	};
+
+	const size_t tri_c = indices.size() / 3;
+	if (tri_c < 2) return;
+
+	const float acmr_before = acmr(indices, vert_count);
+	auto starts = cluster_starts(indices, vert_count, CACHE_SIZE);
+	starts.push_back(tri_c);
+
+	vec3 mesh_centre = {};
+
+	for (const auto i : indices)
+	{
+		const auto p = pos(i);
+		for (size_t c = 0; c < 3; c++) mesh_centre[c] += p[c] / indices.size();
+	}
+
+	// How far each cluster faces away from the centre of the mesh; those
+	// facing furthest outwards are likeliest to occlude the others
+	std::vector<float> keys(starts.size() - 1);
+
+	for (size_t i = 0; i + 1 < starts.size(); i++)
+	{
+		vec3 centroid = {}, normal = {};
+		float area = 0.0f;
+
+		for (size_t t = starts[i]; t < starts[i + 1]; t++)
+		{
+			const auto a = pos(indices[t * 3]), b = pos(indices[t * 3 + 1]),
+					   c = pos(indices[t * 3 + 2]);
+			const vec3 e1 = { b[0] - a[0], b[1] - a[1], b[2] - a[2] },
+					   e2 = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			// Its length is twice the triangle's area, so this is area-weighted
+			const vec3 n = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+							 e1[0] * e2[1] - e1[1] * e2[0] };
+			const float tri_area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				centroid[k] += (a[k] + b[k] + c[k]) / 3.0f * tri_area;
+				normal[k] += n[k];
+			}
+
+			area += tri_area;
+		}
+
+		const float nlen =
+			std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+		if (area <= 0.0f || nlen <= 0.0f) continue;
+
+		for (size_t k = 0; k < 3; k++)
+			keys[i] += (centroid[k] / area - mesh_centre[k]) * (normal[k] / nlen);
+	}
+
+	std::vector<size_t> order(keys.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&keys](const size_t a, const size_t b) {
+		return keys[a] > keys[b];
+	});
+
+	std::vector<uint32_t> ret;
+	ret.reserve(indices.size());
+
+	for (const auto c : order)
+		ret.insert(
+			ret.end(), indices.begin() + starts[c] * 3, indices.begin() + starts[c + 1] * 3);
+
+	if (acmr(ret, vert_count) > acmr_before * threshold) return;
+
+	std::copy(ret.begin(), ret.end(), indices.begin());
+}
+
+std::vector<meshopt::meshlet> meshopt::build_meshlets(
+	const std::span<const uint32_t> indices, const float* const positions,
+	const size_t stride, const size_t vert_count)
+{
+	std::vector<meshlet> ret;
+	// Which meshlet (plus one) last took each vertex, to count unique vertices
+	std::vector<size_t> owner(vert_count, 0);
+	size_t verts = 0;
+
+	for (size_t t = 0; t < indices.size() / 3; t++)
+	{
+		size_t added = 0;
+
+		for (size_t k = 0; k < 3; k++) added += owner[indices[t * 3 + k]] != ret.size();
+
+		if (ret.empty() || verts + added > MESHLET_MAX_VERTS ||
+			ret.back().index_count / 3 >= MESHLET_MAX_TRIS)
+		{
+			if (!ret.empty()) compute_bounds(ret.back(), indices, positions, stride);
+
+			ret.push_back({ .first_index = static_cast<uint32_t>(t * 3) });
+			verts = 0;
+		}
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			auto& o = owner[indices[t * 3 + k]];
+
+			if (o != ret.size())
+			{
+				o = ret.size();
+				verts++;
+			}
+		}
+
+		ret.back().index_count += 3;
+	}
+
+	if (!ret.empty()) compute_bounds(ret.back(), indices, positions, stride);
+
+	return ret;
+}
+
+bool meshopt::meshlet_visible(
+	const meshlet& m, const frustum& planes, const std::array<float, 3>& eye) noexcept
+{
+	for (const auto& p : planes)
+	{
+		const float dist = p[0] * m.centre[0] + p[1] * m.centre[1] + p[2] * m.centre[2] + p[3];
+		if (dist < -m.radius) return false;
+	}
+
+	if (m.cone_cutoff >= 1.0f) return true;
+
+	const float v[3] = { m.centre[0] - eye[0], m.centre[1] - eye[1], m.centre[2] - eye[2] };
+	const float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+	return v[0] * m.cone_axis[0] + v[1] * m.cone_axis[1] + v[2] * m.cone_axis[2] <
+		   m.cone_cutoff * len + m.radius;
+}
+
+std::vector<uint32_t> meshopt::optimise_vertex_fetch(
+	const std::span<uint32_t> indices, const size_t vert_count)
+{
+	std::vector<uint32_t> ret(vert_count, UINT32_MAX);
+	uint32_t next = 0;
+
+	for (auto& i : indices)
+	{
+		if (ret[i] == UINT32_MAX) ret[i] = next++;
+
+		i = ret[i];
+	}
+
+	return ret;
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+adjacency::adjacency(const std::span<const uint32_t> indices, const size_t vert_count)
+	: offsets(vert_count, 0), counts(vert_count, 0), triangles(indices.size())
+{
+	for (const auto i : indices) counts[i]++;
+
+	for (size_t v = 1; v < vert_count; v++) offsets[v] = offsets[v - 1] + counts[v - 1];
+
+	std::vector<uint32_t> fill = offsets;
+
+	for (size_t i = 0; i < indices.size(); i++)
+		triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+}
+
+static std::vector<size_t> cluster_starts(
+	const std::span<const uint32_t> indices, const size_t vert_count,
+	const size_t cache_size)
+{
+	std::vector<size_t> inserted(vert_count, 0), ret;
+	size_t time = cache_size + 1;
+
+	for (size_t t = 0; t < indices.size() / 3; t++)
+	{
+		size_t misses = 0;
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			const auto i = indices[t * 3 + k];
+
+			if (time - inserted[i] > cache_size)
+			{
+				inserted[i] = time++;
+				misses++;
+			}
+		}
+
+		if (t == 0 || misses == 3) ret.push_back(t);
+	}
+
+	return ret;
+}
+
+static void compute_bounds(
+	meshopt::meshlet& m, const std::span<const uint32_t> indices,
+	const float* const positions, const size_t stride)
+{
+	using vec3 = std::array<float, 3>;
+
+	const auto pos = [positions, stride](const uint32_t v) -> vec3 {
+		const float* const p = reinterpret_cast<const float*>(
+			reinterpret_cast<const unsigned char*>(positions) + v * stride);
+		return { p[0], p[1], p[2] };
+	};
+
+	const auto tris = indices.subspan(m.first_index, m.index_count);
+	vec3 lo = pos(tris[0]), hi = lo, axis = {};
+	std::vector<vec3> normals;
+	normals.reserve(tris.size() / 3);
+
+	for (size_t t = 0; t < tris.size(); t += 3)
+	{
+		const auto a = pos(tris[t]), b = pos(tris[t + 1]), c = pos(tris[t + 2]);
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			lo[k] = std::min({ lo[k], a[k], b[k], c[k] });
+			hi[k] = std::max({ hi[k], a[k], b[k], c[k] });
+		}
+
+		const vec3 e1 = { b[0] - a[0], b[1] - a[1], b[2] - a[2] },
+				   e2 = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		vec3 n = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+				   e1[0] * e2[1] - e1[1] * e2[0] };
+		const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+		// Degenerate triangles are never rasterised, so can't widen the cone
+		if (len <= 0.0f) continue;
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			n[k] /= len;
+			axis[k] += n[k];
+		}
+
+		normals.push_back(n);
+	}
+
+	for (size_t k = 0; k < 3; k++) m.centre[k] = (lo[k] + hi[k]) * 0.5f;
+
+	for (const auto i : tris)
+	{
+		const auto p = pos(i);
+		const float dx = p[0] - m.centre[0], dy = p[1] - m.centre[1],
+					dz = p[2] - m.centre[2];
+		m.radius = std::max(m.radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+	}
+
+	const float alen = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	m.cone_cutoff = 1.0f;
+
+	if (alen <= 0.0f) return;
+
+	float min_dot = 1.0f;
+
+	for (size_t k = 0; k < 3; k++) m.cone_axis[k] = axis[k] / alen;
+
+	for (const auto& n : normals)
+	{
+		min_dot = std::min(
+			min_dot,
+			n[0] * m.cone_axis[0] + n[1] * m.cone_axis[1] + n[2] * m.cone_axis[2]);
+	}
+
+	// A cone this wide (beyond ~84 degrees) is practically never backfacing
+	if (min_dot > 0.1f) m.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
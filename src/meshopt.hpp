@@ -0,0 +1,127 @@
+/**
+ * @file meshopt.hpp
+ * @brief Reordering of triangle meshes for efficient rendering.
+ *
+ * Three passes, best run in the order `optimise()` runs them:
+ * - Vertex cache optimisation reorders triangles so that the GPU's post-transform
+ * cache gets more hits, using Tipsify (Sander, Nehab, Barczak; 2007).
+ * - Overdraw optimisation reorders clusters of those triangles so that outward-
+ * facing ones are drawn first, as long as cache efficiency barely suffers.
+ * - Vertex fetch optimisation reorders vertices into first-use order, so that
+ * fetches are as sequential as possible, and drops unreferenced vertices.
+ *
+ * Efficiency is reported as ACMR (average cache miss ratio): post-transform
+ * cache misses per triangle. 3.0 is the worst case, and 0.5 the ideal for a
+ * large regular grid.
+ *
+ * Optimised meshes can then be split into meshlets: runs of consecutive
+ * triangles with bounds, so that they can be culled individually.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace mxn::meshopt
+{
+	/// The post-transform cache is assumed to be a FIFO of this many vertices.
+	/// Real hardware varies; 16 is a conservative middle ground.
+	constexpr size_t CACHE_SIZE = 16;
+
+	/// Meshlets are closed once they reach either limit. These are the limits
+	/// recommended for mesh shaders, which keeps the door open to using them.
+	constexpr size_t MESHLET_MAX_VERTS = 64, MESHLET_MAX_TRIS = 124;
+	/// Meshes with fewer triangles than this aren't worth culling piecemeal.
+	constexpr size_t MESHLET_MIN_MESH_TRIS = MESHLET_MAX_TRIS * 4;
+
+	/// @brief A run of a mesh's index buffer, with bounds for culling.
+	/// Laid out to match `Meshlet` in cluster_cull.comp.
+	struct meshlet final
+	{
+		float centre[3] = {}, radius = 0.0f;
+		/// Every triangle's normal lies within `acos(sqrt(1 - cone_cutoff^2))`
+		/// of this. A `cone_cutoff` of 1 means the cone can never be culled.
+		float cone_axis[3] = {}, cone_cutoff = 1.0f;
+		uint32_t first_index = 0, index_count = 0;
+		uint32_t padding[2] = {};
+	};
+
+	static_assert(sizeof(meshlet) == 48);
+
+	/// Each plane's normal points into the frustum; `w` is its distance.
+	using frustum = std::array<std::array<float, 4>, 6>;
+
+	struct stats final
+	{
+		float acmr_before = 0.0f, acmr_after = 0.0f;
+	};
+
+	/// @brief Simulate a FIFO post-transform cache over a triangle list.
+	[[nodiscard]] float acmr(
+		std::span<const uint32_t> indices, size_t vert_count,
+		size_t cache_size = CACHE_SIZE);
+
+	void optimise_vertex_cache(
+		std::span<uint32_t> indices, size_t vert_count, size_t cache_size = CACHE_SIZE);
+
+	/// @param positions The first float of each vertex's position. Each
+	/// position is three consecutive floats, `stride` bytes apart.
+	/// @param threshold How much worse the ACMR may become, as a factor.
+	/// If the result would be any worse, `indices` is left untouched.
+	void optimise_overdraw(
+		std::span<uint32_t> indices, const float* positions, size_t stride,
+		size_t vert_count, float threshold = 1.05f);
+
+	/// @brief Rewrite `indices` so that vertices are numbered in first-use order.
+	/// @returns A table mapping each old vertex index to its new one, or to
+	/// `UINT32_MAX` if it is unreferenced; see `remap_vertices()`.
+	[[nodiscard]] std::vector<uint32_t> optimise_vertex_fetch(
+		std::span<uint32_t> indices, size_t vert_count);
+
+	/// @brief Split a triangle list, without reordering it, into meshlets.
+	/// @param positions See `optimise_overdraw()`.
+	[[nodiscard]] std::vector<meshlet> build_meshlets(
+		std::span<const uint32_t> indices, const float* positions, size_t stride,
+		size_t vert_count);
+
+	/// @param eye The camera's position, in the same space as the meshlet.
+	/// @returns `false` if the meshlet lies outside the frustum, or if every
+	/// one of its triangles faces away from the camera.
+	[[nodiscard]] bool meshlet_visible(
+		const meshlet&, const frustum&, const std::array<float, 3>& eye) noexcept;
+
+	template<typename V>
+	void remap_vertices(std::vector<V>& verts, const std::vector<uint32_t>& remap)
+	{
+		size_t count = 0;
+
+		for (const auto r : remap) count += r != UINT32_MAX;
+
+		std::vector<V> ret(count);
+
+		for (size_t i = 0; i < verts.size(); i++)
+			if (remap[i] != UINT32_MAX) ret[remap[i]] = verts[i];
+
+		verts = std::move(ret);
+	}
+
+	/// @brief Run all three passes over a mesh.
+	/// @tparam V Must begin with its position, as three floats.
+	template<typename V>
+	stats optimise(std::vector<V>& verts, std::vector<uint32_t>& indices)
+	{
+		stats ret = { .acmr_before = acmr(indices, verts.size()) };
+
+		optimise_vertex_cache(indices, verts.size());
+		optimise_overdraw(
+			indices, reinterpret_cast<const float*>(verts.data()), sizeof(V),
+			verts.size());
+		remap_vertices(verts, optimise_vertex_fetch(indices, verts.size()));
+
+		ret.acmr_after = acmr(indices, verts.size());
+		return ret;
+	}
+} // namespace mxn::meshopt
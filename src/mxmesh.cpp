@@ -0,0 +1,171 @@
+/**
+ * @file mxmesh.cpp
+ * @brief Reading and writing of baked `.mxmesh` model files.
+ */
+
+#include "mxmesh.hpp"
+
+#include "meshopt.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace mxn;
+
+static constexpr size_t HEADER_SIZE = 24, MESH_ENTRY_SIZE = 48;
+
+/// @brief Whether `count` elements of `size` bytes each, starting at `offset`,
+/// lie within `total` bytes. Safe against overflow, whatever the inputs.
+[[nodiscard]] static bool fits(
+	uint64_t offset, uint64_t count, uint64_t size, size_t total);
+template<typename T>
+[[nodiscard]] static T read_native(std::span<const unsigned char> data, size_t offset);
+template<typename T>
+static void write_native(std::vector<unsigned char>& out, T val);
+
+std::optional<std::vector<mxmesh::mesh>> mxmesh::parse(
+	const std::span<const unsigned char> data, const uint32_t vertex_stride,
+	const uint32_t index_size, std::string& error)
+{
+	if (data.size() < HEADER_SIZE ||
+		!std::equal(IDENTIFIER.begin(), IDENTIFIER.end(), data.begin()))
+	{
+		error = "not a .mxmesh file";
+		return std::nullopt;
+	}
+
+	const uint32_t version = read_native<uint32_t>(data, 8),
+				   stride = read_native<uint32_t>(data, 12),
+				   isize = read_native<uint32_t>(data, 16),
+				   mesh_c = read_native<uint32_t>(data, 20);
+
+	if (version != VERSION)
+	{
+		error = "unsupported version " + std::to_string(version);
+		return std::nullopt;
+	}
+
+	if (stride != vertex_stride || isize != index_size)
+	{
+		error = "baked against a different vertex layout; re-bake it";
+		return std::nullopt;
+	}
+
+	if (!fits(HEADER_SIZE, mesh_c, MESH_ENTRY_SIZE, data.size()))
+	{
+		error = "truncated mesh table";
+		return std::nullopt;
+	}
+
+	std::vector<mesh> ret(mesh_c);
+
+	for (size_t i = 0; i < mesh_c; i++)
+	{
+		const size_t entry = HEADER_SIZE + MESH_ENTRY_SIZE * i;
+		auto& m = ret[i];
+		m.vert_offset = read_native<uint64_t>(data, entry);
+		m.vert_count = read_native<uint64_t>(data, entry + 8);
+		m.index_offset = read_native<uint64_t>(data, entry + 16);
+		m.index_count = read_native<uint64_t>(data, entry + 24);
+		m.meshlet_offset = read_native<uint64_t>(data, entry + 32);
+		m.meshlet_count = read_native<uint64_t>(data, entry + 40);
+
+		if (!fits(m.vert_offset, m.vert_count, stride, data.size()) ||
+			!fits(m.index_offset, m.index_count, isize, data.size()) ||
+			!fits(
+				m.meshlet_offset, m.meshlet_count, sizeof(meshopt::meshlet),
+				data.size()) ||
+			m.vert_offset % BLOB_ALIGNMENT != 0 || m.index_offset % BLOB_ALIGNMENT != 0 ||
+			m.meshlet_offset % BLOB_ALIGNMENT != 0)
+		{
+			error = "mesh " + std::to_string(i) + " lies out of bounds or misaligned";
+			return std::nullopt;
+		}
+	}
+
+	return ret;
+}
+
+std::vector<unsigned char> mxmesh::write(
+	const uint32_t vertex_stride, const uint32_t index_size,
+	const std::vector<blobs>& meshes)
+{
+	const auto align = [](const size_t n) -> size_t {
+		return (n + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+	};
+
+	std::vector<mesh> table(meshes.size());
+	size_t cursor = HEADER_SIZE + MESH_ENTRY_SIZE * meshes.size();
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		table[i].vert_offset = cursor = align(cursor);
+		table[i].vert_count = meshes[i].verts.size() / vertex_stride;
+		cursor += meshes[i].verts.size();
+
+		table[i].index_offset = cursor = align(cursor);
+		table[i].index_count = meshes[i].indices.size() / index_size;
+		cursor += meshes[i].indices.size();
+
+		table[i].meshlet_offset = cursor = align(cursor);
+		table[i].meshlet_count = meshes[i].meshlets.size() / sizeof(meshopt::meshlet);
+		cursor += meshes[i].meshlets.size();
+	}
+
+	std::vector<unsigned char> ret;
+	ret.reserve(cursor);
+	ret.insert(ret.end(), IDENTIFIER.begin(), IDENTIFIER.end());
+
+	write_native<uint32_t>(ret, VERSION);
+	write_native<uint32_t>(ret, vertex_stride);
+	write_native<uint32_t>(ret, index_size);
+	write_native<uint32_t>(ret, static_cast<uint32_t>(meshes.size()));
+
+	for (const auto& m : table)
+	{
+		write_native<uint64_t>(ret, m.vert_offset);
+		write_native<uint64_t>(ret, m.vert_count);
+		write_native<uint64_t>(ret, m.index_offset);
+		write_native<uint64_t>(ret, m.index_count);
+		write_native<uint64_t>(ret, m.meshlet_offset);
+		write_native<uint64_t>(ret, m.meshlet_count);
+	}
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		ret.resize(table[i].vert_offset, 0);
+		ret.insert(ret.end(), meshes[i].verts.begin(), meshes[i].verts.end());
+		ret.resize(table[i].index_offset, 0);
+		ret.insert(ret.end(), meshes[i].indices.begin(), meshes[i].indices.end());
+		ret.resize(table[i].meshlet_offset, 0);
+		ret.insert(ret.end(), meshes[i].meshlets.begin(), meshes[i].meshlets.end());
+	}
+
+	return ret;
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+static bool fits(
+	const uint64_t offset, const uint64_t count, const uint64_t size, const size_t total)
+{
+	// Compare against what remains, so that nothing is ever multiplied or summed
+	if (offset > total) return false;
+
+	return size == 0 || count <= (total - offset) / size;
+}
+
+template<typename T>
+static T read_native(const std::span<const unsigned char> data, const size_t offset)
+{
+	T ret = 0;
+	memcpy(&ret, data.data() + offset, sizeof(T));
+	return ret;
+}
+
+template<typename T>
+static void write_native(std::vector<unsigned char>& out, const T val)
+{
+	const auto bytes = reinterpret_cast<const unsigned char*>(&val);
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
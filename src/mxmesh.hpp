@@ -0,0 +1,59 @@
+/**
+ * @file mxmesh.hpp
+ * @brief Reading and writing of baked `.mxmesh` model files.
+ *
+ * A `.mxmesh` holds the already post-processed meshes of one model. Each mesh's
+ * vertex and index data are stored as blobs laid out exactly like
+ * `mxn::vk::vertex` and `mxn::vk::vertex::index_t`, so that loading a model
+ * amounts to copying those blobs into staging memory.
+ *
+ * Layout (all integers in host byte order; files are not portable across
+ * endianness):
+ * - `IDENTIFIER`, then `uint32_t` version, vertex stride, index size, mesh count.
+ * - One `mesh` entry (six `uint64_t`s) per mesh.
+ * - Vertex, index, and meshlet blobs, each aligned to `BLOB_ALIGNMENT` bytes.
+ * Meshlets are `mxn::meshopt::meshlet`s, and are absent for small meshes.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace mxn::mxmesh
+{
+	constexpr std::array<unsigned char, 8> IDENTIFIER = { 'M', 'X', 'M', 'E',
+														  'S', 'H', 0x0D, 0x0A };
+	constexpr uint32_t VERSION = 2;
+	constexpr size_t BLOB_ALIGNMENT = 16;
+
+	struct mesh final
+	{
+		/// Offsets are relative to the start of the file.
+		uint64_t vert_offset = 0, vert_count = 0, index_offset = 0, index_count = 0,
+				 meshlet_offset = 0, meshlet_count = 0;
+	};
+
+	/// @brief Raw vertex, index, and meshlet data of one mesh, for `write()`.
+	struct blobs final
+	{
+		std::span<const unsigned char> verts, indices, meshlets;
+	};
+
+	/// @brief Validate the header and mesh table of a `.mxmesh` file in memory.
+	/// @param vertex_stride The size of a vertex the caller expects. Files baked
+	/// against a different vertex layout are rejected.
+	/// @param index_size The size of an index the caller expects.
+	/// @param error Receives a description of the problem if parsing fails.
+	[[nodiscard]] std::optional<std::vector<mesh>> parse(
+		std::span<const unsigned char> data, uint32_t vertex_stride,
+		uint32_t index_size, std::string& error);
+
+	/// @brief Serialise a complete `.mxmesh` file.
+	[[nodiscard]] std::vector<unsigned char> write(
+		uint32_t vertex_stride, uint32_t index_size, const std::vector<blobs>& meshes);
+} // namespace mxn::mxmesh
@@ -3,16 +3,245 @@
 
 #include "script.hpp"
 
+#include "ecs.hpp"
 #include "file.hpp"
 #include "log.hpp"
+#include "world.hpp"
 
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <sol/sol.hpp>
+#include <unordered_map>
+#include <xxhash.h>
+
+namespace stdfs = std::filesystem;
 
 static void lua_log_info(const char* msg) { MXN_LOG(msg); }
 static void lua_log_warn(const char* msg) { MXN_WARN(msg); }
 static void lua_log_err(const char* msg) { MXN_ERR(msg); }
 static void lua_log_debug(const char* msg) { MXN_DEBUG(msg); }
 
+// The FFI declarations below must describe these types byte for byte
+static_assert(sizeof(glm::vec3) == 12 && sizeof(glm::ivec3) == 12);
+static_assert(offsetof(mxn::point_light, radius) == 12);
+static_assert(offsetof(mxn::point_light, intensity) == 16);
+static_assert(sizeof(mxn::point_light) == 32);
+static_assert(offsetof(mxn::world_chunk, values) == sizeof(glm::ivec3));
+static_assert(
+	sizeof(mxn::world_chunk) == sizeof(glm::ivec3) + sizeof(mxn::world_chunk::arr_t));
+static_assert(offsetof(mxn::heightmap, heights) == sizeof(glm::ivec2));
+static_assert(
+	sizeof(mxn::heightmap) == sizeof(glm::ivec2) + sizeof(mxn::heightmap::arr_t));
+
+/// @brief Declares engine types to the FFI, and returns the table of bound
+/// views and the `mxn.view()` function.
+static std::string ffi_prelude()
+{
+	return fmt::format(
+		R"(
+ffi.cdef[[
+typedef struct {{ float x, y, z; }} mxn_vec3;
+typedef struct {{ int32_t x, y, z; }} mxn_ivec3;
+typedef struct {{ int32_t x, y; }} mxn_ivec2;
+typedef struct {{
+	mxn_vec3 position;
+	float radius;
+	mxn_vec3 intensity;
+	uint8_t padding[4];
+}} mxn_point_light;
+typedef struct {{ mxn_ivec3 position; float values[{}]; }} mxn_world_chunk;
+typedef struct {{ mxn_ivec2 position; uint16_t heights[{}][{}]; }} mxn_heightmap;
+]]
+
+local views = {{}}
+
+return views, function(name)
+	local v = views[name]
+
+	if v == nil then
+		return nil, 0
+	end
+
+	-- Binding replaces the entry, so a cached cast can never be stale
+	if v.cdata == nil then
+		v.cdata = ffi.cast(v.ctype, v.ptr)
+	end
+
+	return v.cdata, v.count
+end
+)",
+		std::tuple_size_v<mxn::world_chunk::arr_t>, mxn::heightmap::WIDTH,
+		mxn::heightmap::WIDTH);
+}
+
+/// @brief Files run by `safe_script_file()` are recorded under this key, so
+/// that `reload_file()` can tell which to re-run; `path` may or may not have
+/// a leading separator.
+static std::string loaded_key(const stdfs::path& path)
+{
+	std::string ret = path.lexically_normal().generic_string();
+	ret.erase(0, ret.find_first_not_of('/'));
+	return ret;
+}
+
+static void bind_view_raw(
+	sol::state& lua, const std::string& name, void* const ptr, const size_t count,
+	const char* const ctype)
+{
+	sol::table views = lua.registry()["mxn_views"];
+
+	if (!views.valid())
+	{
+		MXN_ERRF("Failed to bind Lua view: {} (FFI types not declared).", name);
+		return;
+	}
+
+	views[name] = lua.create_table_with("ptr", ptr, "count", count, "ctype", ctype);
+}
+
+/// @brief Read a script, preferring the precompiled `.ljbc` sibling of a `.lua`
+/// file (see CMakeLists.txt), so that LuaJIT needn't parse it. Load the result
+/// with `sol::load_mode::any`.
+static std::string read_script(sol::state& lua, const stdfs::path& path)
+{
+	if (path.extension() != ".lua") return mxn::vfs_readstr(path);
+
+	auto bc_path = path;
+	bc_path.replace_extension(".ljbc");
+
+	// A mod overriding the source mustn't be shadowed by bytecode for the
+	// original, so both have to come from the same mount. This also tells
+	// whether either exists, without a separate lookup
+	const char* const src_dir = PHYSFS_getRealDir(path.c_str());
+	const char* const bc_dir = PHYSFS_getRealDir(bc_path.c_str());
+
+	if (src_dir == nullptr || bc_dir == nullptr || strcmp(src_dir, bc_dir) != 0)
+		return mxn::vfs_readstr(path);
+
+	// Dumps start with ESC, "LJ", a version byte, and flags; the version and
+	// the endianness and GC64 flags must match the running VM's own dumps
+	static constexpr unsigned char HEADER_FLAGS = 0x01 | 0x08;
+	static const std::string own_header = [&lua]() -> std::string {
+		const std::string dump = lua.safe_script("return string.dump(function() end)");
+		return dump.substr(0, 5);
+	}();
+
+	std::string ret = mxn::vfs_readstr(bc_path);
+
+	if (ret.size() >= 5 && own_header.size() == 5 &&
+		ret.compare(0, 4, own_header, 0, 4) == 0 &&
+		((ret[4] ^ own_header[4]) & HEADER_FLAGS) == 0)
+		return ret;
+
+	MXN_WARNF("Ignoring incompatible Lua bytecode: {}", bc_path.string());
+	return mxn::vfs_readstr(path);
+}
+
+/// Compiled Teal, shared by every state; see `compile_teal()`.
+static std::unordered_map<uint64_t, std::string> teal_cache;
+static std::mutex teal_cache_mtx;
+
+/// @brief Compile Teal source to Lua, at most once per source and compiler
+/// version. Output is cached in memory, and on disk under `user_path`, so it
+/// survives restarts.
+/// @param path Only used for error reporting.
+static std::optional<std::string> compile_teal(
+	sol::state& lua, const std::string& source, const stdfs::path& path)
+{
+	const sol::table teal = lua.registry()["teal"];
+	assert(teal.valid());
+
+	// Output depends only on the source, and on the compiler producing it
+	const sol::function version_fn = teal["version"];
+	const std::string version = version_fn();
+	const uint64_t key = XXH64(
+		source.data(), source.size(), XXH64(version.data(), version.size(), 0));
+
+	{
+		const std::scoped_lock lock(teal_cache_mtx);
+
+		if (const auto iter = teal_cache.find(key); iter != teal_cache.end())
+			return iter->second;
+	}
+
+	const auto cache_path =
+		stdfs::path(mxn::user_path) / "teal" / fmt::format("{:016x}.lua", key);
+	std::string ret;
+	bool cached = false;
+
+	if (std::ifstream in(cache_path, std::ios::binary); in)
+	{
+		ret.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+		// An empty or corrupt file (e.g. left by a crash, or by hand) is no
+		// cache hit; it is recompiled and overwritten
+		cached = !ret.empty() && lua.load(ret, path.string()).valid();
+
+		if (!cached)
+			MXN_WARNF("Discarding unusable compiled Teal file: {}", cache_path.string());
+	}
+
+	if (!cached)
+	{
+		const sol::function gen = teal["gen"];
+		auto result = gen(source);
+
+		if (!result.valid())
+		{
+			const sol::error& err = result;
+			MXN_ERRF(
+				"Failed to compile Teal file: {}.\n\tError: {}", path.string(),
+				err.what());
+			return std::nullopt;
+		}
+
+		// `tl.gen()` returns `nil` upon syntax errors
+		const sol::optional<std::string> output = result;
+
+		if (!output.has_value())
+		{
+			MXN_ERRF("Failed to compile Teal file: {} (syntax errors).", path.string());
+			return std::nullopt;
+		}
+
+		ret = output.value();
+
+		// Write to a temporary first, so that other processes never read a
+		// partially-written file. Its name is unique to this writer, since other
+		// threads and processes may be compiling the same source
+		std::error_code ec;
+		stdfs::create_directories(cache_path.parent_path(), ec);
+		std::random_device rd;
+		auto tmp_path = cache_path;
+		tmp_path += fmt::format(".{:08x}{:08x}.tmp", rd(), rd());
+
+		if (!ec)
+		{
+			std::ofstream out(tmp_path, std::ios::binary);
+
+			if (!out.write(ret.data(), static_cast<std::streamsize>(ret.size())))
+				ec = std::make_error_code(std::errc::io_error);
+		}
+
+		if (!ec) stdfs::rename(tmp_path, cache_path, ec);
+
+		if (ec)
+		{
+			MXN_WARNF(
+				"Failed to cache compiled Teal file: {} ({})", path.string(),
+				ec.message());
+			stdfs::remove(tmp_path, ec);
+		}
+	}
+
+	const std::scoped_lock lock(teal_cache_mtx);
+	teal_cache.emplace(key, ret);
+	return ret;
+}
+
 void mxn::lua::setup_state(sol::state& lua)
 {
 	// clang-format off
@@ -31,6 +260,22 @@ void mxn::lua::setup_state(sol::state& lua)
 	_G_mxn.set_function("err", lua_log_err);
 	_G_mxn.set_function("debug", lua_log_debug);
 
+	// Declare engine types to the FFI, for `bind_view()`
+
+	{
+		const auto res = lua.safe_script(ffi_prelude());
+		if (!res.valid())
+		{
+			const sol::error& err = res;
+			MXN_ERRF("Failed to declare FFI engine types. Details: {}", err.what());
+		}
+		else
+		{
+			lua.registry()["mxn_views"] = res.get<sol::table>(0);
+			_G_mxn["view"] = res.get<sol::function>(1);
+		}
+	}
+
 	lua.set_function("import", [&lua](const char* path) -> sol::object {
 		return mxn::lua::safe_script_file(lua, path);
 	});
@@ -74,7 +319,7 @@ sol::object mxn::lua::require_file(
 		return sol::protected_function_result();
 	}
 
-	const std::string buffer = vfs_readstr(path);
+	const std::string buffer = read_script(lua, path);
 	if (buffer.empty())
 	{
 		MXN_ERRF("Failed to read Lua script from file: {}", path);
@@ -83,27 +328,19 @@ sol::object mxn::lua::require_file(
 
 	if (path.extension() == ".tl")
 	{
-		const sol::function teal = lua.registry()["teal"]["gen"];
-		assert(teal.valid());
-		auto result = teal(buffer);
+		const auto lua_src = compile_teal(lua, buffer, path);
 
-		if (!result.valid())
-		{
-			const sol::error& err = result;
-			MXN_ERRF(
-				"Failed to compile Teal file: {}.\n\tError: {}", path.string(),
-				err.what());
-		}
+		if (!lua_src.has_value()) return sol::object();
 
 		return lua.require_script(
-			key, static_cast<std::string>(result), create_global,
-			sol::detail::default_chunk_name(), sol::load_mode::text);
+			key, lua_src.value(), create_global, sol::detail::default_chunk_name(),
+			sol::load_mode::text);
 	}
 	else
 	{
 		return lua.require_script(
 			key, buffer, create_global, sol::detail::default_chunk_name(),
-			sol::load_mode::text);
+			sol::load_mode::any);
 	}
 }
 
@@ -116,34 +353,76 @@ sol::protected_function_result mxn::lua::safe_script_file(
 		return sol::protected_function_result();
 	}
 
-	const std::string buffer = vfs_readstr(path);
+	const std::string buffer = read_script(lua, path);
 	if (buffer.empty())
 	{
 		MXN_ERRF("Failed to read Lua script from file: {}", path);
 		return sol::protected_function_result();
 	}
 
+	lua.registry()["mxn_loaded"].get_or_create<sol::table>()[loaded_key(path)] = true;
+
 	if (path.extension() == ".tl")
 	{
-		const sol::function teal = lua.registry()["teal"]["gen"];
-		assert(teal.valid());
-		auto result = teal(buffer);
+		const auto lua_src = compile_teal(lua, buffer, path);
 
-		if (!result.valid())
-		{
-			const sol::error& err = result;
-			MXN_ERRF(
-				"Failed to compile Teal file: {}.\n\tError: {}", path.string(),
-				err.what());
-		}
+		if (!lua_src.has_value()) return sol::protected_function_result();
 
 		return lua.safe_script(
-			static_cast<std::string>(result), sol::detail::default_chunk_name(),
-			sol::load_mode::text);
+			lua_src.value(), sol::detail::default_chunk_name(), sol::load_mode::text);
 	}
 	else
 	{
 		return lua.safe_script(
-			buffer, sol::detail::default_chunk_name(), sol::load_mode::text);
+			buffer, sol::detail::default_chunk_name(), sol::load_mode::any);
+	}
+}
+
+bool mxn::lua::reload_file(sol::state& lua, const std::filesystem::path& path)
+{
+	const sol::table loaded = lua.registry()["mxn_loaded"];
+
+	if (!loaded.valid() || !loaded[loaded_key(path)].valid()) return false;
+
+	MXN_LOGF("Reloading Lua script: {}", path.string());
+	const auto res = safe_script_file(lua, path);
+
+	if (!res.valid())
+	{
+		const sol::error& err = res;
+		MXN_ERRF("Failed to reload Lua script: {}. Details: {}", path.string(),
+			err.what());
 	}
+
+	return true;
+}
+
+void mxn::lua::bind_view(
+	sol::state& lua, const std::string& name, const std::span<glm::vec3> data)
+{
+	bind_view_raw(lua, name, data.data(), data.size(), "mxn_vec3*");
+}
+
+void mxn::lua::bind_view(
+	sol::state& lua, const std::string& name, const std::span<point_light> data)
+{
+	bind_view_raw(lua, name, data.data(), data.size(), "mxn_point_light*");
+}
+
+void mxn::lua::bind_view(
+	sol::state& lua, const std::string& name, const std::span<world_chunk> data)
+{
+	bind_view_raw(lua, name, data.data(), data.size(), "mxn_world_chunk*");
+}
+
+void mxn::lua::bind_view(
+	sol::state& lua, const std::string& name, const std::span<heightmap> data)
+{
+	bind_view_raw(lua, name, data.data(), data.size(), "mxn_heightmap*");
+}
+
+void mxn::lua::unbind_view(sol::state& lua, const std::string& name)
+{
+	sol::table views = lua.registry()["mxn_views"];
+	if (views.valid()) views[name] = sol::lua_nil;
 }
@@ -2,6 +2,9 @@
 /// @brief Lua scripting interfaces and utilities.
 
 #include <filesystem>
+#include <glm/fwd.hpp>
+#include <span>
+#include <string>
 
 #pragma once
 
@@ -21,6 +24,13 @@ namespace sol
 	using object = basic_object<reference>;
 }
 
+namespace mxn
+{
+	struct point_light;
+	struct world_chunk;
+	struct heightmap;
+}
+
 namespace mxn::lua
 {
 	/// @brief Prepares a Sol2 state for use.
@@ -34,4 +44,24 @@ namespace mxn::lua
 
 	sol::object require_file(sol::state&, const std::string& key,
 		const std::filesystem::path&, bool create_global = true);
+
+	/// @brief Re-run a file if `safe_script_file()` has run it in this state
+	/// before, e.g. after it changes on disk. Teal is recompiled as needed.
+	/// @returns `false` if the state has never run the file.
+	bool reload_file(sol::state&, const std::filesystem::path&);
+
+	/// @brief Let scripts read and write an engine array in place, via the FFI.
+	///
+	/// `mxn.view(name)` returns a zero-indexed FFI pointer to the first element
+	/// (of C type `mxn_vec3`, `mxn_point_light`, `mxn_world_chunk`, or
+	/// `mxn_heightmap`) and the element count, or `nil` and 0 if nothing is
+	/// bound under `name`. Nothing is copied, and element accesses compile to
+	/// plain loads and stores under the JIT.
+	/// @note The caller must rebind or unbind the view before the array is
+	/// moved or freed, and must not touch it while a script might be.
+	void bind_view(sol::state&, const std::string& name, std::span<glm::vec3>);
+	void bind_view(sol::state&, const std::string& name, std::span<point_light>);
+	void bind_view(sol::state&, const std::string& name, std::span<world_chunk>);
+	void bind_view(sol::state&, const std::string& name, std::span<heightmap>);
+	void unbind_view(sol::state&, const std::string& name);
 } // namespace mxn
@@ -0,0 +1,186 @@
+/// @file script_arena.cpp
+/// @brief Per-state Lua memory, kept apart from the engine's heap.
+
+#include "script_arena.hpp"
+
+#include "log.hpp"
+
+#include <Tracy.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sol/sol.hpp>
+
+using namespace mxn::lua;
+
+/// @brief Whether this LuaJIT build accepts custom allocators.
+/// Without GC64, `lua_newstate()` always returns null on 64-bit targets.
+static bool custom_alloc_supported()
+{
+	static const bool ret = []() -> bool {
+		lua_State* const probe = lua_newstate(
+			[](void*, void* ptr, size_t, size_t nsize) -> void* {
+				if (nsize != 0) return std::realloc(ptr, nsize);
+
+				std::free(ptr);
+				return nullptr;
+			},
+			nullptr);
+
+		if (probe == nullptr) return false;
+
+		lua_close(probe);
+		return true;
+	}();
+
+	return ret;
+}
+
+arena::arena(const std::string& name, const size_t budget)
+	: name(name), plot_name(fmt::format("MXN: Lua Heap, {}", name)),
+	  budget_bytes(budget)
+{
+}
+
+arena::~arena()
+{
+	for (void* page : pages) std::free(page);
+}
+
+void* arena::alloc(
+	void* const ud, void* const ptr, size_t osize, const size_t nsize) noexcept
+{
+	auto& self = *static_cast<arena*>(ud);
+
+	// For new blocks, Lua may pass a type tag here instead
+	if (ptr == nullptr) osize = 0;
+
+	if (nsize == 0)
+	{
+		self.release(ptr, osize);
+		self.used_bytes -= osize;
+		return nullptr;
+	}
+
+	// Only growth may fail; Lua assumes that shrinking always succeeds
+	if (nsize > osize && self.used_bytes - osize + nsize > self.budget_bytes)
+		return nullptr;
+
+	void* ret = nullptr;
+
+	if (ptr != nullptr && osize > SMALL_MAX && nsize > SMALL_MAX)
+	{
+		ret = std::realloc(ptr, nsize);
+	}
+	else if (ptr != nullptr && osize <= SMALL_MAX && nsize <= SMALL_MAX &&
+			 (osize - 1) / GRANULE == (nsize - 1) / GRANULE)
+	{
+		ret = ptr; // Same size class
+	}
+	else
+	{
+		ret = self.acquire(nsize);
+
+		if (ret != nullptr && ptr != nullptr)
+		{
+			memcpy(ret, ptr, std::min(osize, nsize));
+			self.release(ptr, osize);
+		}
+	}
+
+	if (ret == nullptr)
+	{
+		// Only possible if the system is out of memory
+		if (nsize <= osize)
+		{
+			MXN_ERRF("Lua arena ({}) failed to shrink a block.", self.name);
+			std::abort();
+		}
+
+		return nullptr;
+	}
+
+	self.used_bytes = self.used_bytes - osize + nsize;
+	self.peak_bytes = std::max(self.peak_bytes, self.used_bytes);
+	return ret;
+}
+
+void arena::plot(const sol::state& lua) const
+{
+	TracyPlot(
+		plot_name.c_str(),
+		static_cast<int64_t>(is_active ? used_bytes : lua.memory_used()));
+}
+
+void arena::report(const sol::state& lua) const
+{
+	if (!is_active)
+	{
+		MXN_LOGF("Lua heap ({}): {}B (default allocator)", name, lua.memory_used());
+		return;
+	}
+
+	MXN_LOGF(
+		"Lua heap ({}): {}B used, {}B peak, {}B budget, {} pages", name, used_bytes,
+		peak_bytes, budget_bytes, pages.size());
+}
+
+sol::state mxn::lua::make_state(arena& mem)
+{
+	if (!custom_alloc_supported())
+	{
+		static bool warned = false;
+
+		if (!std::exchange(warned, true))
+			MXN_WARN("LuaJIT lacks GC64; Lua states will use the default allocator.");
+
+		return sol::state();
+	}
+
+	mem.is_active = true;
+	return sol::state(sol::default_at_panic, &arena::alloc, &mem);
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+void* arena::acquire(const size_t size)
+{
+	if (size > SMALL_MAX) return std::malloc(size);
+
+	const size_t cls = (size - 1) / GRANULE;
+
+	if (free_lists[cls] != nullptr)
+		return std::exchange(free_lists[cls], free_lists[cls]->next);
+
+	const size_t block = (cls + 1) * GRANULE;
+
+	// The old page's remainder is abandoned, but is always under `SMALL_MAX`
+	if (static_cast<size_t>(bump_end - bump) < block)
+	{
+		void* const page = std::malloc(PAGE_SIZE);
+
+		if (page == nullptr) return nullptr;
+
+		pages.push_back(page);
+		bump = static_cast<char*>(page);
+		bump_end = bump + PAGE_SIZE;
+	}
+
+	return std::exchange(bump, bump + block);
+}
+
+void arena::release(void* const ptr, const size_t size) noexcept
+{
+	if (ptr == nullptr) return;
+
+	if (size > SMALL_MAX)
+	{
+		std::free(ptr);
+		return;
+	}
+
+	auto* const blk = static_cast<free_block*>(ptr);
+	const size_t cls = (size - 1) / GRANULE;
+	blk->next = free_lists[cls];
+	free_lists[cls] = blk;
+}
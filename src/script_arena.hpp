@@ -0,0 +1,81 @@
+/// @file script_arena.hpp
+/// @brief Per-state Lua memory, kept apart from the engine's heap.
+
+#pragma once
+
+#include "preproc.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace sol
+{
+	class state;
+}
+
+namespace mxn::lua
+{
+	/// @brief A `lua_Alloc` for one Lua state, with a budget and accounting.
+	///
+	/// Blocks of up to `SMALL_MAX` bytes (nearly everything Lua allocates) come
+	/// from size classes carved out of large pages owned by this arena, and
+	/// freed blocks are recycled within their class, so GC churn never reaches
+	/// the global heap. Pages are only released with the arena. Larger blocks
+	/// go to `malloc()`, but still count towards the budget.
+	///
+	/// Pass to `make_state()`. LuaJIT builds without GC64 reject custom
+	/// allocators; the state then falls back to the default one, and reports
+	/// `sol::state::memory_used()` instead.
+	/// @note Not thread-safe; like its state, use from one thread at a time.
+	class arena final
+	{
+	public:
+		/// @param name Identifies this arena in Tracy plots and reports.
+		/// @param budget Allocations that would exceed this many bytes in total
+		/// fail, raising a Lua memory error.
+		arena(const std::string& name, size_t budget);
+		~arena();
+		DELETE_COPIERS_AND_MOVERS(arena)
+
+		/// @brief Satisfies `lua_Alloc`; `ud` must be an `arena`.
+		static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize) noexcept;
+
+		/// @brief Record the state's heap size in its Tracy plot.
+		void plot(const sol::state&) const;
+		/// @brief Log the state's heap size, peak, and budget.
+		void report(const sol::state&) const;
+
+		/// @returns `false` if the state fell back to the default allocator.
+		[[nodiscard]] bool active() const noexcept { return is_active; }
+		[[nodiscard]] size_t used() const noexcept { return used_bytes; }
+		[[nodiscard]] size_t peak() const noexcept { return peak_bytes; }
+		[[nodiscard]] size_t budget() const noexcept { return budget_bytes; }
+
+	private:
+		static constexpr size_t GRANULE = 16, SMALL_MAX = 512,
+								CLASS_C = SMALL_MAX / GRANULE, PAGE_SIZE = 1 << 16;
+
+		struct free_block final
+		{
+			free_block* next;
+		};
+
+		std::string name, plot_name;
+		size_t budget_bytes, used_bytes = 0, peak_bytes = 0;
+		bool is_active = false;
+		std::array<free_block*, CLASS_C> free_lists = {};
+		std::vector<void*> pages;
+		/// Unclaimed remainder of the newest page.
+		char *bump = nullptr, *bump_end = nullptr;
+
+		[[nodiscard]] void* acquire(size_t);
+		void release(void*, size_t) noexcept;
+
+		friend sol::state make_state(arena&);
+	};
+
+	/// @brief Create a state whose memory comes from `mem`, if LuaJIT permits.
+	/// `mem` must outlive the state.
+	[[nodiscard]] sol::state make_state(arena& mem);
+} // namespace mxn::lua
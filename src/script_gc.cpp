@@ -0,0 +1,80 @@
+/// @file script_gc.cpp
+/// @brief Paces a Lua state's garbage collection into bounded time slices.
+
+#include "script_gc.hpp"
+
+#include "log.hpp"
+
+#include <Tracy.hpp>
+#include <algorithm>
+#include <sol/sol.hpp>
+
+using namespace mxn::lua;
+
+gc_pacer::gc_pacer(const std::string& name)
+	: name(name), plot_name(fmt::format("MXN: Lua GC Slice (us), {}", name))
+{
+}
+
+void gc_pacer::attach(sol::state& lua)
+{
+	lua_gc(lua.lua_state(), LUA_GCSETPAUSE, BACKSTOP_PAUSE);
+	trigger = lua.memory_used() * (100 + TRIGGER_PERCENT) / 100;
+}
+
+void gc_pacer::step(sol::state& lua, const clock::duration budget)
+{
+	if (!in_cycle && lua.memory_used() < trigger) return;
+
+	ZoneScopedN("MXN: Lua GC Slice");
+
+	in_cycle = true;
+	const auto start = clock::now();
+	auto now = start;
+
+	// One basic step at a time, so that the budget is checked often
+	do
+	{
+		step_c++;
+
+		if (lua_gc(lua.lua_state(), LUA_GCSTEP, 0) != 0)
+		{
+			in_cycle = false;
+			cycle_c++;
+			trigger = lua.memory_used() * (100 + TRIGGER_PERCENT) / 100;
+			now = clock::now();
+			break;
+		}
+
+		now = clock::now();
+	} while (now - start < budget);
+
+	slice_c++;
+	last_slice = now - start;
+	longest_slice = std::max(longest_slice, last_slice);
+	total_time += last_slice;
+}
+
+void gc_pacer::plot() const
+{
+	TracyPlot(
+		plot_name.c_str(),
+		static_cast<int64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(last_slice).count()));
+}
+
+void gc_pacer::report() const
+{
+	using std::chrono::microseconds;
+	using std::chrono::duration_cast;
+
+	const auto mean = slice_c > 0 ? total_time / slice_c : clock::duration::zero();
+
+	MXN_LOGF(
+		"Lua GC ({}): {} cycles, {} slices, {} steps; slice mean {}us, max {}us, "
+		"last {}us{}",
+		name, cycle_c, slice_c, step_c, duration_cast<microseconds>(mean).count(),
+		duration_cast<microseconds>(longest_slice).count(),
+		duration_cast<microseconds>(last_slice).count(),
+		in_cycle ? " (mid-cycle)" : "");
+}
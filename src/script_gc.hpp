@@ -0,0 +1,58 @@
+/// @file script_gc.hpp
+/// @brief Paces a Lua state's garbage collection into bounded time slices.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace sol
+{
+	class state;
+}
+
+namespace mxn::lua
+{
+	/// @brief Runs a state's collector in slices of bounded duration, so that
+	/// scripts' garbage is collected in spare time rather than wherever the
+	/// heap happens to cross LuaJIT's threshold.
+	///
+	/// A paced cycle starts once the heap has grown by `TRIGGER_PERCENT` since
+	/// the last one ended, and is then advanced by `step()` until it completes.
+	/// LuaJIT's own pacing stays on, with a far higher pause, as a backstop for
+	/// when slices cannot keep up. A slice may still overrun by one atomic
+	/// step, which is proportional to the state's root set, not its heap.
+	/// @note Not thread-safe; like its state, use from one thread at a time.
+	class gc_pacer final
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		/// Heap growth, as a percentage, which begins a paced cycle.
+		static constexpr size_t TRIGGER_PERCENT = 50;
+		/// `LUA_GCSETPAUSE` for the backstop collector.
+		static constexpr int BACKSTOP_PAUSE = 400;
+
+		/// @param name Identifies this state in Tracy plots and reports.
+		explicit gc_pacer(const std::string& name);
+
+		/// @brief Hand the state's collection over to this pacer.
+		void attach(sol::state&);
+		/// @brief Collect until `budget` elapses or a cycle completes.
+		/// Does nothing if no cycle is due.
+		void step(sol::state&, clock::duration budget);
+
+		/// @brief Record the last slice's duration in this state's Tracy plot.
+		void plot() const;
+		/// @brief Log pause statistics.
+		void report() const;
+
+	private:
+		std::string name, plot_name;
+		size_t trigger = 0;
+		bool in_cycle = false;
+		uint64_t slice_c = 0, step_c = 0, cycle_c = 0;
+		clock::duration last_slice = {}, longest_slice = {}, total_time = {};
+	};
+} // namespace mxn::lua
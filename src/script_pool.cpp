@@ -0,0 +1,205 @@
+/// @file script_pool.cpp
+/// @brief Isolated Lua states, ticked in parallel on worker threads.
+
+#include "script_pool.hpp"
+
+#include "log.hpp"
+#include "script.hpp"
+#include "script_arena.hpp"
+#include "script_gc.hpp"
+
+#include <Tracy.hpp>
+#include <algorithm>
+#include <latch>
+#include <sol/sol.hpp>
+#include <xxhash.h>
+
+using namespace mxn::lua;
+
+struct state_pool::lane final
+{
+	/// Declared first, so that it outlives the state.
+	arena mem;
+	sol::state lua;
+	gc_pacer gc;
+	uint32_t index;
+	/// Only touched by the host between ticks.
+	std::vector<message> inbox;
+	/// Only touched by this lane's job during a tick.
+	std::vector<message> outbox;
+
+	lane(const uint32_t index, const size_t budget)
+		: mem(fmt::format("Lane {}", index), budget), lua(make_state(mem)),
+		  gc(fmt::format("Lane {}", index)), index(index)
+	{
+	}
+};
+
+state_pool::state_pool(
+	const uint32_t lane_count, const size_t lane_budget, const size_t thread_c)
+	: workers(
+		  "Lua",
+		  thread_c != 0
+			  ? thread_c
+			  : std::clamp<size_t>(
+					std::max(std::thread::hardware_concurrency(), 2u) - 1, 1, lane_count))
+{
+	assert(lane_count > 0);
+	lanes.reserve(lane_count);
+
+	for (uint32_t i = 0; i < lane_count; i++)
+		lanes.emplace_back(std::make_unique<lane>(i, lane_budget));
+
+	// Each state is only ever touched by one thread at a time, so lanes can
+	// be prepared in parallel; the Teal compiler's cache is thread-safe
+	for_each_lane([lane_count](lane& l) -> void {
+		setup_state(l.lua);
+		l.gc.attach(l.lua);
+
+		auto _G_mxn = l.lua["mxn"].get_or_create<sol::table>();
+		_G_mxn["lane"] = l.index;
+		_G_mxn["lane_count"] = lane_count;
+		_G_mxn["HOST"] = HOST;
+		_G_mxn.set_function(
+			"send", [&l, lane_count](const uint32_t to, std::string data) -> bool {
+				if (to != HOST && to >= lane_count) return false;
+
+				l.outbox.push_back({ .from = l.index, .to = to, .data = std::move(data) });
+				return true;
+			});
+	});
+}
+
+state_pool::~state_pool() = default;
+
+void state_pool::run_file(const std::filesystem::path& path)
+{
+	ZoneScopedN("MXN: Lua Lanes, Run File");
+
+	for_each_lane([&path](lane& l) -> void {
+		const auto res = safe_script_file(l.lua, path);
+
+		if (!res.valid())
+		{
+			const sol::error& err = res;
+			MXN_ERRF("Lua lane {} failed to run {}. Details: {}", l.index, path.string(),
+				err.what());
+		}
+	});
+}
+
+void state_pool::reload_file(const std::filesystem::path& path)
+{
+	for_each_lane([&path](lane& l) -> void { mxn::lua::reload_file(l.lua, path); });
+}
+
+void state_pool::post(const uint32_t to, std::string data)
+{
+	host_outbox.push_back({ .from = HOST, .to = to, .data = std::move(data) });
+}
+
+void state_pool::tick()
+{
+	ZoneScopedN("MXN: Lua Lanes, Tick");
+
+	const auto deliver = [this](message& msg) -> void {
+		if (msg.to == HOST)
+			host_inbox.push_back(std::move(msg));
+		else if (msg.to < lanes.size())
+			lanes[msg.to]->inbox.push_back(std::move(msg));
+		else
+			MXN_WARNF("Dropping message to non-existent Lua lane {}.", msg.to);
+	};
+
+	// Always deliver in the same order, regardless of which lane finished first
+	for (auto& msg : host_outbox) deliver(msg);
+
+	host_outbox.clear();
+
+	for (auto& l : lanes)
+	{
+		for (auto& msg : l->outbox) deliver(msg);
+
+		l->outbox.clear();
+	}
+
+	for_each_lane([tick = tick_count, budget = gc_budget](lane& l) -> void {
+		ZoneScopedN("MXN: Lua Lane Tick");
+
+		const sol::protected_function on_tick = l.lua["on_tick"];
+
+		if (!on_tick.valid())
+		{
+			l.inbox.clear();
+			l.gc.step(l.lua, budget);
+			return;
+		}
+
+		sol::table msgs = l.lua.create_table(static_cast<int>(l.inbox.size()), 0);
+
+		for (size_t i = 0; i < l.inbox.size(); i++)
+		{
+			msgs[i + 1] = l.lua.create_table_with(
+				"from", l.inbox[i].from, "data", std::move(l.inbox[i].data));
+		}
+
+		l.inbox.clear();
+
+		const auto res = on_tick(tick, msgs);
+
+		if (!res.valid())
+		{
+			const sol::error& err = res;
+			MXN_ERRF("Lua lane {} failed on tick {}. Details: {}", l.index, tick,
+				err.what());
+		}
+
+		l.gc.step(l.lua, budget);
+	});
+
+	for (const auto& l : lanes)
+	{
+		l->mem.plot(l->lua);
+		l->gc.plot();
+	}
+
+	tick_count++;
+}
+
+std::vector<state_pool::message> state_pool::take_messages() noexcept
+{
+	return std::exchange(host_inbox, {});
+}
+
+uint32_t state_pool::lane_for(const uint64_t key) const noexcept
+{
+	return static_cast<uint32_t>(XXH64(&key, sizeof(key), 0) % lanes.size());
+}
+
+void state_pool::report_memory() const
+{
+	for (const auto& l : lanes) l->mem.report(l->lua);
+}
+
+void state_pool::report_gc() const
+{
+	for (const auto& l : lanes) l->gc.report();
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+template<typename F>
+void state_pool::for_each_lane(F func)
+{
+	std::latch done(static_cast<std::ptrdiff_t>(lanes.size()));
+
+	for (auto& l : lanes)
+	{
+		workers.push([&func, &done, &l = *l]() -> void {
+			func(l);
+			done.count_down();
+		});
+	}
+
+	done.wait();
+}
@@ -0,0 +1,104 @@
+/// @file script_pool.hpp
+/// @brief Isolated Lua states, ticked in parallel on worker threads.
+
+#pragma once
+
+#include "preproc.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mxn::lua
+{
+	/// @brief A fixed number of "lanes", each an independent Lua state prepared
+	/// by `setup_state()`, among which script work can be partitioned.
+	///
+	/// Lanes share no Lua data, and only communicate by messages, which are
+	/// delivered at the start of the next tick. A lane's inbox is ordered by
+	/// sender (the host first, then lanes by index), then by sending order, so
+	/// that every tick's outcome depends only on the lane count and the
+	/// messages posted, and never on how the OS schedules workers. Keep the
+	/// lane count fixed across runs for replays to hold.
+	///
+	/// Scripts see `mxn.lane`, `mxn.lane_count`, `mxn.HOST`, and
+	/// `mxn.send(to, string)`, and may define a global `on_tick(tick, messages)`,
+	/// where `messages` is an array of `{ from = lane, data = string }`.
+	/// @note Only use from the logic thread.
+	class state_pool final
+	{
+	public:
+		/// The sender and recipient index of messages to and from C++.
+		static constexpr uint32_t HOST = std::numeric_limits<uint32_t>::max();
+
+		struct message final
+		{
+			uint32_t from = HOST, to = HOST;
+			std::string data;
+		};
+
+		/// @param lane_budget Bytes of Lua heap allowed to each lane.
+		/// @param thread_c If 0, as many workers as there are lanes, within
+		/// one less than the hardware concurrency. Does not affect results.
+		state_pool(uint32_t lane_count, size_t lane_budget, size_t thread_c = 0);
+		~state_pool();
+		DELETE_COPIERS_AND_MOVERS(state_pool)
+
+		/// @brief Run a script file in every lane, e.g. to define `on_tick`.
+		/// Blocks until all lanes are done.
+		void run_file(const std::filesystem::path&);
+
+		/// @brief `reload_file()` in every lane. Blocks until all lanes are done.
+		void reload_file(const std::filesystem::path&);
+
+		/// @brief Queue a message for delivery at the start of the next tick.
+		void post(uint32_t to, std::string data);
+
+		/// @brief Deliver pending messages, then call every lane's `on_tick`.
+		/// Blocks until all lanes are done.
+		void tick();
+
+		/// @brief Messages sent to `HOST` during previous ticks, in delivery order.
+		[[nodiscard]] std::vector<message> take_messages() noexcept;
+
+		/// @brief The lane to which work keyed by `key` (e.g. an entity ID)
+		/// should go. Depends only on `key` and the lane count.
+		[[nodiscard]] uint32_t lane_for(uint64_t key) const noexcept;
+
+		[[nodiscard]] uint32_t lane_count() const noexcept
+		{
+			return static_cast<uint32_t>(lanes.size());
+		}
+
+		[[nodiscard]] uint64_t ticks_run() const noexcept { return tick_count; }
+
+		/// @brief Log every lane's Lua heap usage.
+		void report_memory() const;
+		/// @brief Log every lane's garbage collection pauses.
+		void report_gc() const;
+
+		/// Time each lane may spend collecting garbage at the end of a tick;
+		/// see `gc_pacer`.
+		std::chrono::microseconds gc_budget = std::chrono::microseconds(500);
+
+	private:
+		struct lane;
+
+		std::vector<std::unique_ptr<lane>> lanes;
+		/// Posted by the host, pending delivery.
+		std::vector<message> host_outbox;
+		/// Sent to the host by lanes.
+		std::vector<message> host_inbox;
+		uint64_t tick_count = 0;
+		/// Declared last, so that workers are joined before lanes are destroyed.
+		thread_pool workers;
+
+		/// @brief Run `func` once per lane, in parallel, and wait for all.
+		template<typename F>
+		void for_each_lane(F func);
+	};
+} // namespace mxn::lua
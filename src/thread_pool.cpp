@@ -0,0 +1,51 @@
+/**
+ * @file thread_pool.cpp
+ * @brief A fixed set of worker threads consuming a shared queue of jobs.
+ */
+
+#include "thread_pool.hpp"
+
+#include "log.hpp"
+
+#include <Tracy.hpp>
+
+using namespace mxn;
+
+thread_pool::thread_pool(const std::string& name, size_t thread_c)
+{
+	if (thread_c == 0)
+		thread_c = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	workers.reserve(thread_c);
+
+	for (size_t i = 0; i < thread_c; i++)
+	{
+		workers.emplace_back([this, name, i]() -> void {
+			tracy::SetThreadName(fmt::format("MXN: {} {}", name, i).c_str());
+
+			job_t job = {};
+
+			while (alive)
+			{
+				// Time out periodically so that shutdown is never missed
+				if (!jobs.wait_dequeue_timed(job, std::chrono::milliseconds(100))) continue;
+				if (job) job();
+			}
+		});
+	}
+}
+
+thread_pool::~thread_pool()
+{
+	alive = false;
+
+	// Empty jobs wake any sleeping workers immediately
+	for (size_t i = 0; i < workers.size(); i++) jobs.enqueue({});
+
+	for (auto& worker : workers) worker.join();
+}
+
+void thread_pool::push(job_t&& job)
+{
+	jobs.enqueue(std::move(job));
+}
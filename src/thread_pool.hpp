@@ -0,0 +1,42 @@
+/**
+ * @file thread_pool.hpp
+ * @brief A fixed set of worker threads consuming a shared queue of jobs.
+ */
+
+#pragma once
+
+#include "preproc.hpp"
+
+#include <atomic>
+#include <concurrentqueue/blockingconcurrentqueue.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mxn
+{
+	class thread_pool final
+	{
+	public:
+		using job_t = std::function<void()>;
+
+	private:
+		std::atomic_bool alive = true;
+		moodycamel::BlockingConcurrentQueue<job_t> jobs;
+		std::vector<std::thread> workers;
+
+	public:
+		/// @param name Workers are named "MXN: <name> <index>".
+		/// @param thread_c If 0, one less than the hardware concurrency (minimum 1).
+		thread_pool(const std::string& name, size_t thread_c = 0);
+		/// @brief Joins all workers; jobs not yet started are discarded.
+		~thread_pool();
+		DELETE_COPIERS_AND_MOVERS(thread_pool)
+
+		/// @note Jobs may run in any order, on any worker.
+		void push(job_t&&);
+
+		[[nodiscard]] size_t size() const noexcept { return workers.size(); }
+	};
+} // namespace mxn
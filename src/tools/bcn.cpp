@@ -0,0 +1,252 @@
+/**
+ * @file tools/bcn.cpp
+ * @brief Block compression (BC1, BC3, BC4, BC5) of RGBA8 images, for offline use.
+ *
+ * Colour endpoints are fit along the principal axis of each block's colours;
+ * single-channel endpoints are the block's extremes. This is not as thorough as
+ * an iterative cluster fit, but it is fast and far better than a bounding box.
+ */
+
+#include "bcn.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace mxn;
+
+using block_t = std::array<std::array<unsigned char, 4>, 16>;
+
+static void encode_bc1(const block_t&, std::vector<unsigned char>& out);
+static void encode_bc4(const block_t&, size_t channel, std::vector<unsigned char>& out);
+
+std::vector<unsigned char> bcn::encode(
+	const ktx::format fmt, const unsigned char* const rgba, const uint32_t w,
+	const uint32_t h)
+{
+	assert(ktx::is_block_compressed(static_cast<uint32_t>(fmt)));
+	assert(fmt != ktx::format::BC7_UNORM);
+
+	const uint32_t blocks_x = (w + 3) / 4, blocks_y = (h + 3) / 4;
+	std::vector<unsigned char> ret;
+	ret.reserve(
+		static_cast<size_t>(blocks_x) * blocks_y *
+		ktx::block_size(static_cast<uint32_t>(fmt)));
+
+	for (uint32_t by = 0; by < blocks_y; by++)
+	{
+		for (uint32_t bx = 0; bx < blocks_x; bx++)
+		{
+			block_t block = {};
+
+			for (uint32_t y = 0; y < 4; y++)
+			{
+				for (uint32_t x = 0; x < 4; x++)
+				{
+					const uint32_t px = std::min(bx * 4 + x, w - 1),
+								   py = std::min(by * 4 + y, h - 1);
+					const unsigned char* const texel =
+						rgba + (static_cast<size_t>(py) * w + px) * 4;
+					std::copy(texel, texel + 4, block[y * 4 + x].begin());
+				}
+			}
+
+			switch (fmt)
+			{
+			case ktx::format::BC1_RGB_UNORM:
+			case ktx::format::BC1_RGBA_UNORM: encode_bc1(block, ret); break;
+			case ktx::format::BC3_UNORM:
+				encode_bc4(block, 3, ret);
+				encode_bc1(block, ret);
+				break;
+			case ktx::format::BC4_UNORM: encode_bc4(block, 0, ret); break;
+			case ktx::format::BC5_UNORM:
+				encode_bc4(block, 0, ret);
+				encode_bc4(block, 1, ret);
+				break;
+			default: break;
+			}
+		}
+	}
+
+	return ret;
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+[[nodiscard]] static uint16_t pack_565(const std::array<float, 3>& c)
+{
+	const auto quantise = [&c](const size_t i, const float max) -> uint16_t {
+		return static_cast<uint16_t>(
+			std::lround(std::clamp(c[i], 0.0f, 255.0f) * max / 255.0f));
+	};
+
+	const uint16_t r = quantise(0, 31.0f), g = quantise(1, 63.0f), b = quantise(2, 31.0f);
+
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+[[nodiscard]] static std::array<int, 3> unpack_565(const uint16_t c)
+{
+	const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+}
+
+static void encode_bc1(const block_t& block, std::vector<unsigned char>& out)
+{
+	// Principal axis of the block's colours, via power iteration on the covariance
+
+	std::array<float, 3> mean = {};
+
+	for (const auto& t : block)
+		for (size_t c = 0; c < 3; c++) mean[c] += t[c] / 16.0f;
+
+	std::array<float, 6> cov = {}; // xx, xy, xz, yy, yz, zz
+
+	for (const auto& t : block)
+	{
+		const float r = t[0] - mean[0], g = t[1] - mean[1], b = t[2] - mean[2];
+		cov[0] += r * r;
+		cov[1] += r * g;
+		cov[2] += r * b;
+		cov[3] += g * g;
+		cov[4] += g * b;
+		cov[5] += b * b;
+	}
+
+	// Start from the covariance row of the widest channel, which unlike a constant
+	// guess can never be orthogonal to the principal axis
+	std::array<float, 3> axis = { cov[0], cov[1], cov[2] };
+
+	if (cov[3] > cov[0] && cov[3] >= cov[5])
+		axis = { cov[1], cov[3], cov[4] };
+	else if (cov[5] > cov[0] && cov[5] > cov[3])
+		axis = { cov[2], cov[4], cov[5] };
+
+	for (int i = 0; i < 8; i++)
+	{
+		const std::array<float, 3> next = {
+			cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+			cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+			cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+		};
+
+		const float len =
+			std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (len < 1e-6f) break;
+
+		axis = { next[0] / len, next[1] / len, next[2] / len };
+	}
+
+	float proj_min = std::numeric_limits<float>::max(),
+		  proj_max = std::numeric_limits<float>::lowest();
+
+	for (const auto& t : block)
+	{
+		const float p = (t[0] - mean[0]) * axis[0] + (t[1] - mean[1]) * axis[1] +
+						(t[2] - mean[2]) * axis[2];
+		proj_min = std::min(proj_min, p);
+		proj_max = std::max(proj_max, p);
+	}
+
+	uint16_t c0 = pack_565({ mean[0] + axis[0] * proj_max, mean[1] + axis[1] * proj_max,
+							 mean[2] + axis[2] * proj_max }),
+			 c1 = pack_565({ mean[0] + axis[0] * proj_min, mean[1] + axis[1] * proj_min,
+							 mean[2] + axis[2] * proj_min });
+
+	// `c0 > c1` selects the 4-colour (opaque) mode
+	if (c0 < c1) std::swap(c0, c1);
+
+	uint32_t indices = 0;
+
+	if (c0 != c1)
+	{
+		const auto e0 = unpack_565(c0), e1 = unpack_565(c1);
+		std::array<std::array<int, 3>, 4> palette = { e0, e1, {}, {} };
+
+		for (size_t c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * e0[c] + e1[c]) / 3;
+			palette[3][c] = (e0[c] + 2 * e1[c]) / 3;
+		}
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			uint32_t best = 0;
+			int best_dist = std::numeric_limits<int>::max();
+
+			for (uint32_t p = 0; p < 4; p++)
+			{
+				const int dr = block[i][0] - palette[p][0],
+						  dg = block[i][1] - palette[p][1],
+						  db = block[i][2] - palette[p][2];
+				const int dist = dr * dr + dg * dg + db * db;
+
+				if (dist < best_dist)
+				{
+					best_dist = dist;
+					best = p;
+				}
+			}
+
+			indices |= best << (i * 2);
+		}
+	}
+
+	out.push_back(static_cast<unsigned char>(c0 & 0xFF));
+	out.push_back(static_cast<unsigned char>(c0 >> 8));
+	out.push_back(static_cast<unsigned char>(c1 & 0xFF));
+	out.push_back(static_cast<unsigned char>(c1 >> 8));
+
+	for (size_t i = 0; i < 4; i++)
+		out.push_back(static_cast<unsigned char>((indices >> (i * 8)) & 0xFF));
+}
+
+static void encode_bc4(
+	const block_t& block, const size_t channel, std::vector<unsigned char>& out)
+{
+	int lo = 255, hi = 0;
+
+	for (const auto& t : block)
+	{
+		lo = std::min<int>(lo, t[channel]);
+		hi = std::max<int>(hi, t[channel]);
+	}
+
+	// `hi > lo` selects the 8-value mode; when equal, every index selects `hi`
+	std::array<int, 8> palette = { hi, lo };
+
+	for (int i = 1; i < 7; i++) palette[i + 1] = ((7 - i) * hi + i * lo) / 7;
+
+	uint64_t indices = 0;
+
+	if (hi != lo)
+	{
+		for (size_t i = 0; i < 16; i++)
+		{
+			uint64_t best = 0;
+			int best_dist = std::numeric_limits<int>::max();
+
+			for (uint64_t p = 0; p < 8; p++)
+			{
+				const int dist = std::abs(block[i][channel] - palette[p]);
+
+				if (dist < best_dist)
+				{
+					best_dist = dist;
+					best = p;
+				}
+			}
+
+			indices |= best << (i * 3);
+		}
+	}
+
+	out.push_back(static_cast<unsigned char>(hi));
+	out.push_back(static_cast<unsigned char>(lo));
+
+	for (size_t i = 0; i < 6; i++)
+		out.push_back(static_cast<unsigned char>((indices >> (i * 8)) & 0xFF));
+}
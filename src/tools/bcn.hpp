@@ -0,0 +1,22 @@
+/**
+ * @file tools/bcn.hpp
+ * @brief Block compression (BC1, BC3, BC4, BC5) of RGBA8 images, for offline use.
+ */
+
+#pragma once
+
+#include "../ktx.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace mxn::bcn
+{
+	/// @brief Compress a tightly-packed RGBA8 image into 4x4 blocks.
+	/// @param fmt One of the BC1, BC3, BC4 or BC5 formats; BC4 and BC5 read the
+	/// red and red/green channels respectively.
+	/// @note Images with dimensions which are not multiples of 4 are padded by
+	/// repeating their last row and column.
+	[[nodiscard]] std::vector<unsigned char> encode(
+		ktx::format fmt, const unsigned char* rgba, uint32_t w, uint32_t h);
+} // namespace mxn::bcn
@@ -0,0 +1,130 @@
+/**
+ * @file tools/meshbake.cpp
+ * @brief Offline conversion of model files into `.mxmesh` files, for loading by
+ * `mxn::vk::model_importer` without running Assimp at startup.
+ *
+ * Usage: meshbake <input> <output>
+ *
+ * The input goes through the same Assimp post-processing steps and mesh
+ * optimisation passes the importer would apply, so baked and unbaked models
+ * are identical once loaded.
+ */
+
+#include "../meshopt.hpp"
+#include "../mxmesh.hpp"
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace mxn;
+
+/// @brief Mirrors `mxn::vk::vertex`, which can't be included without Vulkan.
+struct baked_vertex final
+{
+	float pos[3], colour[3], uv[2], normal[3], binormal[3];
+};
+
+using index_t = uint32_t;
+
+int main(const int arg_c, const char* const argv[])
+{
+	if (arg_c != 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <input> <output>" << std::endl;
+		return 1;
+	}
+
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(
+		argv[1], aiProcess_CalcTangentSpace | aiProcess_Triangulate |
+					 aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
+
+	if (scene == nullptr)
+	{
+		std::cerr << "Failed to import " << argv[1] << ": " << importer.GetErrorString()
+				  << std::endl;
+		return 1;
+	}
+
+	std::vector<std::vector<baked_vertex>> verts(scene->mNumMeshes);
+	std::vector<std::vector<index_t>> indices(scene->mNumMeshes);
+	std::vector<std::vector<meshopt::meshlet>> meshlets(scene->mNumMeshes);
+	std::vector<mxmesh::blobs> blobs;
+	size_t vert_total = 0, index_total = 0;
+
+	for (size_t i = 0; i < scene->mNumMeshes; i++)
+	{
+		const auto m = scene->mMeshes[i];
+
+		// `SortByPType` may leave point and line meshes, which aren't drawn
+		if (m->mPrimitiveTypes != aiPrimitiveType_TRIANGLE) continue;
+
+		verts[i].reserve(m->mNumVertices);
+		indices[i].reserve(static_cast<size_t>(m->mNumFaces) * 3);
+
+		for (unsigned int j = 0; j < m->mNumVertices; j++)
+		{
+			const auto& v = m->mVertices[j];
+			const auto colour = m->HasVertexColors(0) ? m->mColors[0][j] : aiColor4D(1.0f);
+			const auto uv = m->HasTextureCoords(0) ? m->mTextureCoords[0][j] : aiVector3D();
+			const auto norm = m->HasNormals() ? m->mNormals[j] : aiVector3D();
+			const auto bt = m->HasTangentsAndBitangents() ? m->mBitangents[j] : aiVector3D();
+
+			verts[i].push_back({ .pos = { v.x, v.y, v.z },
+								 .colour = { colour.r, colour.g, colour.b },
+								 .uv = { uv.x, uv.y },
+								 .normal = { norm.x, norm.y, norm.z },
+								 .binormal = { bt.x, bt.y, bt.z } });
+		}
+
+		for (unsigned int j = 0; j < m->mNumFaces; j++)
+			for (unsigned int k = 0; k < m->mFaces[j].mNumIndices; k++)
+				indices[i].push_back(m->mFaces[j].mIndices[k]);
+
+		// The importer skips meshes without triangles; no need to bake them
+		if (indices[i].empty()) continue;
+
+		const auto opt = meshopt::optimise(verts[i], indices[i]);
+
+		std::cout << "Mesh " << i << ": ACMR " << opt.acmr_before << " -> "
+				  << opt.acmr_after << std::endl;
+
+		if (indices[i].size() / 3 >= meshopt::MESHLET_MIN_MESH_TRIS)
+		{
+			meshlets[i] = meshopt::build_meshlets(
+				indices[i], verts[i][0].pos, sizeof(baked_vertex), verts[i].size());
+
+			std::cout << "Mesh " << i << ": " << meshlets[i].size() << " meshlets"
+					  << std::endl;
+		}
+
+		blobs.push_back(
+			{ .verts = { reinterpret_cast<const unsigned char*>(verts[i].data()),
+						 verts[i].size() * sizeof(baked_vertex) },
+			  .indices = { reinterpret_cast<const unsigned char*>(indices[i].data()),
+						   indices[i].size() * sizeof(index_t) },
+			  .meshlets = { reinterpret_cast<const unsigned char*>(meshlets[i].data()),
+							meshlets[i].size() * sizeof(meshopt::meshlet) } });
+
+		vert_total += verts[i].size();
+		index_total += indices[i].size();
+	}
+
+	const auto file = mxmesh::write(sizeof(baked_vertex), sizeof(index_t), blobs);
+	std::ofstream out(argv[2], std::ios::binary);
+
+	if (!out.write(reinterpret_cast<const char*>(file.data()), file.size()))
+	{
+		std::cerr << "Failed to write " << argv[2] << std::endl;
+		return 1;
+	}
+
+	std::cout << argv[1] << " -> " << argv[2] << " (" << blobs.size() << " meshes, "
+			  << vert_total << " vertices, " << index_total << " indices, "
+			  << file.size() << "B)" << std::endl;
+	return 0;
+}
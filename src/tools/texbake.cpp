@@ -0,0 +1,204 @@
+/**
+ * @file tools/texbake.cpp
+ * @brief Offline conversion of loose images into block-compressed KTX2 textures
+ * with precomputed mip chains, for loading by `mxn::vk::vma_image::from_file`.
+ *
+ * Usage: texbake [--format auto|bc1|bc3|bc4|bc5|rgba8] [--normal] <input> <output>
+ *
+ * With `--format auto` (the default), opaque images become BC1, images with
+ * any transparency become BC3, and `--normal` selects BC5.
+ */
+
+#include "../ktx.hpp"
+#include "bcn.hpp"
+
+#include <SOIL2/SOIL2.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace mxn;
+
+struct options final
+{
+	std::string format = "auto", input, output;
+	bool normal = false;
+};
+
+[[nodiscard]] static bool parse_args(int arg_c, const char* const argv[], options&);
+/// @brief Box-filter `src` down to half its size, in place of the next mip level.
+[[nodiscard]] static std::vector<unsigned char> downsample(
+	const std::vector<unsigned char>& src, uint32_t w, uint32_t h, bool normal);
+
+int main(const int arg_c, const char* const argv[])
+{
+	options opts = {};
+
+	if (!parse_args(arg_c, argv, opts))
+	{
+		std::cerr << "Usage: " << argv[0]
+				  << " [--format auto|bc1|bc3|bc4|bc5|rgba8] [--normal] <input> <output>"
+				  << std::endl;
+		return 1;
+	}
+
+	int w = -1, h = -1, chans = -1;
+	unsigned char* img =
+		SOIL_load_image(opts.input.c_str(), &w, &h, &chans, SOIL_LOAD_RGBA);
+
+	if (img == nullptr)
+	{
+		std::cerr << "Failed to decode " << opts.input << ": " << SOIL_last_result()
+				  << std::endl;
+		return 1;
+	}
+
+	std::vector<unsigned char> base(img, img + static_cast<size_t>(w) * h * 4);
+	SOIL_free_image_data(img);
+
+	ktx::format fmt = ktx::format::BC1_RGB_UNORM;
+
+	if (opts.format == "auto")
+	{
+		bool opaque = true;
+
+		for (size_t i = 3; i < base.size() && opaque; i += 4) opaque = base[i] == 255;
+
+		fmt = opts.normal ? ktx::format::BC5_UNORM
+						  : (opaque ? ktx::format::BC1_RGB_UNORM : ktx::format::BC3_UNORM);
+	}
+	else if (opts.format == "bc1")
+		fmt = ktx::format::BC1_RGB_UNORM;
+	else if (opts.format == "bc3")
+		fmt = ktx::format::BC3_UNORM;
+	else if (opts.format == "bc4")
+		fmt = ktx::format::BC4_UNORM;
+	else if (opts.format == "bc5")
+		fmt = ktx::format::BC5_UNORM;
+	else if (opts.format == "rgba8")
+		fmt = ktx::format::R8G8B8A8_UNORM;
+	else
+	{
+		std::cerr << "Unknown format: " << opts.format << std::endl;
+		return 1;
+	}
+
+	const uint32_t mip_c =
+		static_cast<uint32_t>(std::floor(std::log2(std::max(w, h)))) + 1;
+
+	std::vector<std::vector<unsigned char>> levels;
+	std::vector<unsigned char> mip = std::move(base);
+	uint32_t mip_w = static_cast<uint32_t>(w), mip_h = static_cast<uint32_t>(h);
+	size_t total = 0;
+
+	for (uint32_t i = 0; i < mip_c; i++)
+	{
+		if (fmt == ktx::format::R8G8B8A8_UNORM)
+			levels.push_back(mip);
+		else
+			levels.push_back(bcn::encode(fmt, mip.data(), mip_w, mip_h));
+
+		total += levels.back().size();
+
+		if (i + 1 < mip_c)
+		{
+			mip = downsample(mip, mip_w, mip_h, opts.normal);
+			mip_w = std::max(mip_w / 2, 1u);
+			mip_h = std::max(mip_h / 2, 1u);
+		}
+	}
+
+	const auto file = ktx::write(fmt, static_cast<uint32_t>(w), static_cast<uint32_t>(h), levels);
+	std::ofstream out(opts.output, std::ios::binary);
+
+	if (!out.write(reinterpret_cast<const char*>(file.data()), file.size()))
+	{
+		std::cerr << "Failed to write " << opts.output << std::endl;
+		return 1;
+	}
+
+	std::cout << opts.input << " -> " << opts.output << " (" << w << "x" << h << ", "
+			  << mip_c << " mips, " << total << "B vs. "
+			  << static_cast<size_t>(w) * h * 4 << "B RGBA8 base level)" << std::endl;
+	return 0;
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+static bool parse_args(const int arg_c, const char* const argv[], options& opts)
+{
+	std::vector<std::string> positional;
+
+	for (int i = 1; i < arg_c; i++)
+	{
+		if (strcmp(argv[i], "--normal") == 0)
+			opts.normal = true;
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < arg_c)
+			opts.format = argv[++i];
+		else
+			positional.emplace_back(argv[i]);
+	}
+
+	if (positional.size() != 2) return false;
+
+	opts.input = positional[0];
+	opts.output = positional[1];
+	return true;
+}
+
+static std::vector<unsigned char> downsample(
+	const std::vector<unsigned char>& src, const uint32_t w, const uint32_t h,
+	const bool normal)
+{
+	const uint32_t dw = std::max(w / 2, 1u), dh = std::max(h / 2, 1u);
+	std::vector<unsigned char> ret(static_cast<size_t>(dw) * dh * 4);
+
+	for (uint32_t y = 0; y < dh; y++)
+	{
+		for (uint32_t x = 0; x < dw; x++)
+		{
+			float sum[4] = {};
+
+			for (uint32_t sy = 0; sy < 2; sy++)
+			{
+				for (uint32_t sx = 0; sx < 2; sx++)
+				{
+					const uint32_t px = std::min(x * 2 + sx, w - 1),
+								   py = std::min(y * 2 + sy, h - 1);
+
+					for (size_t c = 0; c < 4; c++)
+						sum[c] += src[(static_cast<size_t>(py) * w + px) * 4 + c] / 4.0f;
+				}
+			}
+
+			// Averaged normals shorten; restore unit length
+			if (normal)
+			{
+				float n[3], len = 0.0f;
+
+				for (size_t c = 0; c < 3; c++)
+				{
+					n[c] = sum[c] / 127.5f - 1.0f;
+					len += n[c] * n[c];
+				}
+
+				len = std::sqrt(len);
+
+				for (size_t c = 0; c < 3 && len > 0.0f; c++)
+					sum[c] = (n[c] / len + 1.0f) * 127.5f;
+			}
+
+			for (size_t c = 0; c < 4; c++)
+			{
+				ret[(static_cast<size_t>(y) * dw + x) * 4 + c] =
+					static_cast<unsigned char>(std::lround(std::clamp(sum[c], 0.0f, 255.0f)));
+			}
+		}
+	}
+
+	return ret;
+}
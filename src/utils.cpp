@@ -6,10 +6,14 @@
 #include "file.hpp"
 #include "log.hpp"
 #include "string.hpp"
+#include "thread_pool.hpp"
 #include "time.hpp"
 
 #include <SDL2/SDL.h>
+#include <Tracy.hpp>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
 
 namespace stdfs = std::filesystem;
 
@@ -23,6 +27,160 @@ static std::string get_base_path() noexcept
 	return ret;
 }
 
+/// @brief Open a file for reading, with one lookup for its existence, type,
+/// and size. Failures are logged.
+static PHYSFS_File* vfs_open_sized(const stdfs::path& path, size_t& size)
+{
+	PHYSFS_Stat stat = {};
+
+	if (PHYSFS_stat(path.c_str(), &stat) == 0)
+	{
+		MXN_ERRF("Attempted to read file from non-existent path: {}", path.string());
+		return nullptr;
+	}
+
+	if (stat.filetype == PHYSFS_FILETYPE_DIRECTORY)
+	{
+		MXN_ERRF("Illegal attempt to read directory: {}", path.string());
+		return nullptr;
+	}
+
+	PHYSFS_File* const ret = PHYSFS_openRead(path.c_str());
+
+	if (ret == nullptr)
+	{
+		MXN_ERRF(
+			"Failed to open file for read: {}\n\t{}", path.string(),
+			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+		return nullptr;
+	}
+
+	// Not every archiver knows sizes without opening the file
+	const PHYSFS_sint64 len = stat.filesize >= 0 ? stat.filesize : PHYSFS_fileLength(ret);
+
+	if (len <= -1)
+	{
+		MXN_ERRF(
+			"Failed to determine file length: {}\n\t{}", path.string(),
+			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+		PHYSFS_close(ret);
+		return nullptr;
+	}
+
+	size = static_cast<size_t>(len);
+	return ret;
+}
+
+/// @brief Read up to `size` bytes of a file into `dest`, and close it.
+/// @returns The number of bytes read, or -1 upon failure.
+static PHYSFS_sint64 vfs_read_close(
+	PHYSFS_File* const pfs, void* const dest, const size_t size, const stdfs::path& path)
+{
+	PHYSFS_sint64 ret = PHYSFS_readBytes(pfs, dest, size);
+
+	if (ret <= -1)
+	{
+		MXN_ERRF(
+			"Error while reading file: {}\n\t{}", path.string(),
+			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+	}
+	else if (static_cast<size_t>(ret) < size && PHYSFS_eof(pfs) == 0)
+	{
+		MXN_ERRF(
+			"Incomplete read of file: {}\n\t{}", path.string(),
+			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+		ret = -1;
+	}
+
+	if (PHYSFS_close(pfs) == 0)
+	{
+		MXN_ERRF(
+			"Failed to close virtual file handle: {}\n\t{}", path.string(),
+			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+	}
+
+	return ret;
+}
+
+/// @brief Read a whole file into `out`, a contiguous container of bytes,
+/// reusing its capacity. `out` is left empty upon failure.
+template<typename T>
+static bool vfs_read_into(const stdfs::path& path, T& out)
+{
+	size_t size = 0;
+	PHYSFS_File* const pfs = vfs_open_sized(path, size);
+
+	if (pfs == nullptr)
+	{
+		out.clear();
+		return false;
+	}
+
+	out.resize(size);
+	const PHYSFS_sint64 read = vfs_read_close(pfs, out.data(), size, path);
+
+	if (read <= -1)
+	{
+		out.clear();
+		return false;
+	}
+
+	out.resize(static_cast<size_t>(read));
+	return true;
+}
+
+/// Reads mostly wait on the disk, so more can usefully be in flight than there
+/// are cores; enough to keep a drive's queue full.
+static constexpr size_t IO_THREAD_C = 4;
+/// Exists between `vfs_init()` and `vfs_deinit()`.
+static std::unique_ptr<mxn::thread_pool> io_pool;
+/// Guards both `io_inflight` and `io_prefetched`.
+static std::mutex io_inflight_mtx;
+/// Requested reads not yet complete, so that repeat requests can share them.
+/// Keyed by `io_key()`.
+static std::unordered_map<std::string, std::shared_future<mxn::vfs_mapping>> io_inflight;
+/// Reads started by `vfs_prefetch()`, complete or not, which nothing has used
+/// yet. Each is released on its first use. Keyed by `io_key()`.
+static std::unordered_map<std::string, std::shared_future<mxn::vfs_mapping>>
+	io_prefetched;
+
+/// @returns The path, normalised and without a leading separator.
+static std::string io_key(const stdfs::path& path)
+{
+	std::string ret = path.lexically_normal().generic_string();
+	ret.erase(0, ret.find_first_not_of('/'));
+	return ret;
+}
+
+/// @brief Remove a prefetched read from `io_prefetched`, if there is one.
+/// @returns An invalid future if the path was not prefetched, or was used.
+/// @note Expects `io_inflight_mtx` to be locked.
+static std::shared_future<mxn::vfs_mapping> take_prefetched_locked(const std::string& key)
+{
+	const auto iter = io_prefetched.find(key);
+
+	if (iter == io_prefetched.end()) return {};
+
+	auto ret = std::move(iter->second);
+	io_prefetched.erase(iter);
+	return ret;
+}
+
+/// @brief Touch every page of a mapping, so that the disk is read now, on an
+/// I/O thread, rather than wherever the bytes are first used.
+static void fault_in(const mxn::vfs_mapping& mapping)
+{
+	static constexpr size_t PAGE_SIZE = 4096;
+
+	if (!mapping.mapped()) return;
+
+	volatile unsigned char sink = 0;
+
+	for (size_t i = 0; i < mapping.size(); i += PAGE_SIZE) sink = mapping.data()[i];
+
+	(void)sink;
+}
+
 std::string mxn::get_userdata_path(const std::string& appname) noexcept
 {
 	char* p = SDL_GetPrefPath("RatCircus", appname.c_str());
@@ -44,24 +202,35 @@ void mxn::vfs_init(const std::string& argv0)
 			"PhysicsFS failed to properly initialise: {}",
 			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode())));
 	}
+
+	io_pool = std::make_unique<thread_pool>("VFS I/O", IO_THREAD_C);
 }
 
 void mxn::vfs_deinit()
 {
 	assert(PHYSFS_isInit() != 0);
 
+	// Reads in progress finish first; any not yet started are abandoned
+	io_pool.reset();
+
+	{
+		const std::scoped_lock lock(io_inflight_mtx);
+		io_prefetched.clear();
+	}
+
 	if (PHYSFS_deinit() == 0)
 		MXN_WARNF(
 			"PhysicsFS failed to properly deinitialise: {}",
 			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
 }
 
-void mxn::vfs_mount(const stdfs::path& path, const stdfs::path& mount_point)
+void mxn::vfs_mount(
+	const stdfs::path& path, const stdfs::path& mount_point, const bool append)
 {
 	if (!stdfs::exists(path))
 	{ MXN_ERRF("Attempted to mount non-existent path: {}", path.string()); }
 
-	if (PHYSFS_mount(path.c_str(), mount_point.c_str(), 1) == 0)
+	if (PHYSFS_mount(path.c_str(), mount_point.c_str(), append ? 1 : 0) == 0)
 	{
 		MXN_ERRF(
 			"Failed to mount {} as \"{}\":\n\t{}", path.string(), mount_point.string(),
@@ -102,127 +271,108 @@ uint32_t mxn::vfs_count(const stdfs::path& path) noexcept
 	return ret;
 }
 
+bool mxn::vfs_read(const stdfs::path& path, std::vector<unsigned char>& out)
+{
+	return vfs_read_into(path, out);
+}
+
+bool mxn::vfs_read(const stdfs::path& path, std::string& out)
+{
+	return vfs_read_into(path, out);
+}
+
 std::vector<unsigned char> mxn::vfs_read(const stdfs::path& path)
 {
-	if (!vfs_exists(path))
-	{
-		MXN_ERRF("Attempted to read file from non-existent path: {}", path.string());
-		return {};
-	}
+	std::vector<unsigned char> ret = {};
+	vfs_read_into(path, ret);
+	return ret;
+}
 
-	if (vfs_isdir(path))
-	{
-		MXN_ERRF("Illegal attempt to read directory: {}", path.string());
-		return {};
-	}
+std::string mxn::vfs_readstr(const stdfs::path& path)
+{
+	std::string ret = {};
+	vfs_read_into(path, ret);
+	return ret;
+}
 
-	PHYSFS_File* pfs = PHYSFS_openRead(path.c_str());
-	if (pfs == nullptr)
-	{
-		MXN_ERRF(
-			"Failed to open file for read: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
-	}
+std::shared_future<mxn::vfs_mapping> mxn::vfs_read_async(const stdfs::path& path)
+{
+	assert(io_pool != nullptr);
 
-	const PHYSFS_sint64 len = PHYSFS_fileLength(pfs);
+	std::string key = io_key(path);
+	const std::scoped_lock lock(io_inflight_mtx);
 
-	if (len <= -1)
-	{
-		MXN_ERRF(
-			"Failed to determine file length: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
-	}
+	if (auto prefetched = take_prefetched_locked(key); prefetched.valid())
+		return prefetched;
 
-	std::vector<unsigned char> ret = {};
-	ret.resize(static_cast<size_t>(len));
-	const PHYSFS_sint64 read = PHYSFS_readBytes(pfs, ret.data(), len);
+	if (const auto iter = io_inflight.find(key); iter != io_inflight.end())
+		return iter->second;
 
-	if (read <= -1)
-	{
-		MXN_ERRF(
-			"Error while reading file: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
-	}
+	// `std::function` must be copyable, so the promise is shared
+	auto promise = std::make_shared<std::promise<vfs_mapping>>();
+	auto ret = promise->get_future().share();
+	io_inflight.emplace(key, ret);
 
-	if (static_cast<size_t>(read) < ret.size() && PHYSFS_eof(pfs) == 0)
-	{
-		MXN_ERRF(
-			"Incomplete read of file: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
-	}
+	io_pool->push([promise, path, key]() -> void {
+		ZoneScopedN("MXN: VFS Async Read");
 
-	if (PHYSFS_close(pfs) == 0)
-	{
-		MXN_ERRF(
-			"Failed to close virtual file handle: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-	}
+		// Not `vfs_map()`, which could wait on this very read if it was prefetched
+		auto mapping = vfs_map_direct(path);
+		fault_in(mapping);
+
+		{
+			const std::scoped_lock lock(io_inflight_mtx);
+			io_inflight.erase(key);
+		}
+
+		promise->set_value(std::move(mapping));
+	});
 
 	return ret;
 }
 
-std::string mxn::vfs_readstr(const stdfs::path& path)
+mxn::vfs_mapping mxn::vfs_map(const stdfs::path& path)
 {
-	if (!vfs_exists(path))
-	{
-		MXN_ERRF("Attempted to read file from non-existent path: {}", path.string());
-		return {};
-	}
+	std::shared_future<vfs_mapping> prefetched;
 
-	if (vfs_isdir(path))
 	{
-		MXN_ERRF("Illegal attempt to read directory: {}", path.string());
-		return {};
-	}
+		const std::scoped_lock lock(io_inflight_mtx);
 
-	PHYSFS_File* pfs = PHYSFS_openRead(path.c_str());
-	if (pfs == nullptr)
-	{
-		MXN_ERRF(
-			"Failed to open file for read: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
+		if (!io_prefetched.empty()) prefetched = take_prefetched_locked(io_key(path));
 	}
 
-	const PHYSFS_sint64 len = PHYSFS_fileLength(pfs);
+	return prefetched.valid() ? prefetched.get() : vfs_map_direct(path);
+}
 
-	if (len <= -1)
+size_t mxn::vfs_prefetch(const stdfs::path& manifest)
+{
+	const std::string text = vfs_readstr(manifest);
+	size_t ret = 0;
+
+	for (size_t pos = 0; pos < text.size();)
 	{
-		MXN_ERRF(
-			"Failed to determine file length: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
-	}
+		size_t end = text.find('\n', pos);
 
-	std::string ret = {};
-	ret.resize(static_cast<size_t>(len));
-	const PHYSFS_sint64 read = PHYSFS_readBytes(pfs, ret.data(), len);
+		if (end == std::string::npos) end = text.size();
 
-	if (read <= -1)
-	{
-		MXN_ERRF(
-			"Error while reading file: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
-	}
+		std::string_view line(text.data() + pos, end - pos);
+		pos = end + 1;
 
-	if (static_cast<size_t>(read) < ret.size() && PHYSFS_eof(pfs) == 0)
-	{
-		MXN_ERRF(
-			"Incomplete read of file: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
-		return {};
-	}
+		const size_t first = line.find_first_not_of(" \t\r");
 
-	if (PHYSFS_close(pfs) == 0)
-	{
-		MXN_ERRF(
-			"Failed to close virtual file handle: {}\n\t{}", path.string(),
-			PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+		if (first == std::string_view::npos || line[first] == '#') continue;
+
+		line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+		const stdfs::path path(line);
+		auto future = vfs_read_async(path);
+
+		{
+			const std::scoped_lock lock(io_inflight_mtx);
+			io_prefetched.insert_or_assign(io_key(path), std::move(future));
+		}
+
+		ret++;
 	}
 
 	return ret;
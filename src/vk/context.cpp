@@ -8,11 +8,17 @@
 #include "../file.hpp"
 #include "../log.hpp"
 #include "../string.hpp"
+#include "../world.hpp"
 #include "model.hpp"
 #include "src/defines.hpp"
+#include "upload.hpp"
 
 #include <SDL2/SDL_vulkan.h>
 #include <Tracy.hpp>
+#include <algorithm>
+#include <exception>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
 #include <imgui_impl_sdl.h>
 #include <imgui_impl_vulkan.h>
 #include <magic_enum.hpp>
@@ -24,6 +30,22 @@ namespace mxn::vk
 	{
 		glm::uvec2 viewport_size = {}, tile_nums = {};
 		int debugview_index = 0;
+		/// Only read by the bindless fragment shader; set by `bind_material()`.
+		uint32_t material_index = 0;
+	};
+
+	/// @brief Pushed to vertex shaders for vertex formats other than `full`.
+	struct mesh_pushconst final
+	{
+		glm::vec4 quant_origin = {}, quant_scale = {};
+	};
+
+	/// @brief Pushed to cluster_cull.comp, once per mesh.
+	struct cull_pushconst final
+	{
+		std::array<glm::vec4, 6> planes = {};
+		glm::vec4 eye = {};
+		uint32_t meshlet_count = 0;
 	};
 } // namespace mxn::vk
 
@@ -34,6 +56,43 @@ static constexpr uint32_t MXN_VK_VERSION = VK_MAKE_VERSION(
 
 static constexpr uint32_t MIN_IMG_COUNT = 2;
 
+/// Follows `pushconst`, which only fragment and compute shaders see.
+static constexpr uint32_t MESH_PUSHCONST_OFFSET = 32;
+
+static_assert(sizeof(pushconst) <= MESH_PUSHCONST_OFFSET);
+
+/// Must match `local_size_x` in cluster_cull.comp.
+static constexpr uint32_t CULL_GROUP_SIZE = 64;
+/// How many meshes with meshlets can be alive at once.
+static constexpr uint32_t MAX_CULLED_MESHES = 4096;
+static constexpr ::vk::DeviceSize DRAW_CMD_SIZE = sizeof(::vk::DrawIndexedIndirectCommand);
+
+static_assert(sizeof(cull_pushconst) <= 128);
+
+/// @brief Calls `func` when destroyed by an exception unwinding its scope, so
+/// that whatever was created before the throw can be destroyed.
+template<typename F>
+struct on_unwind final
+{
+	F func;
+	const int uncaught = std::uncaught_exceptions();
+
+	explicit on_unwind(F&& f) : func(std::move(f)) {}
+	DELETE_COPIERS_AND_MOVERS(on_unwind)
+
+	~on_unwind()
+	{
+		if (std::uncaught_exceptions() > uncaught) func();
+	}
+};
+
+/// The graphics pipelines' variants for `terrain_renderer` follow those for
+/// each vertex format. The tessellated one only exists if `context::tessellation`.
+static constexpr size_t TERRAIN_VARIANT = magic_enum::enum_count<vertex_format>(),
+						TERRAIN_TESS_VARIANT = TERRAIN_VARIANT + 1;
+/// Where the terrain's set lies in both graphics pipeline layouts.
+static constexpr uint32_t TERRAIN_SET = 5;
+
 static constexpr std::array DEVICE_EXTENSIONS = { VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 												  VK_KHR_MULTIVIEW_EXTENSION_NAME };
 
@@ -110,12 +169,36 @@ static void imgui_debug_callback(const VkResult err)
 	}
 }
 
+/// @brief How many materials fit in the bindless texture array (two textures
+/// each), within every limit on update-after-bind samplers and sampled images.
+[[nodiscard]] static uint32_t bindless_capacity(const ::vk::PhysicalDevice& gpu)
+{
+	const auto chain = gpu.getProperties2<
+		::vk::PhysicalDeviceProperties2, ::vk::PhysicalDeviceDescriptorIndexingProperties>();
+	const auto& props = chain.get<::vk::PhysicalDeviceDescriptorIndexingProperties>();
+
+	const uint32_t texture_c = std::min(
+		{ props.maxPerStageDescriptorUpdateAfterBindSamplers,
+		  props.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		  props.maxDescriptorSetUpdateAfterBindSamplers,
+		  props.maxDescriptorSetUpdateAfterBindSampledImages });
+
+	return std::min(MAX_BINDLESS_MATERIALS, texture_c / 2);
+}
+
+[[nodiscard]] static std::string material_key(
+	const std::filesystem::path& albedo, const std::filesystem::path& normal)
+{
+	// Newlines can't appear in VFS paths
+	return albedo.string() + '\n' + normal.string();
+}
+
 // Context, public interface ///////////////////////////////////////////////////
 
 context::context(SDL_Window* const window)
 	: inst(ctor_instance(window)), surface(ctor_surface(window)), gpu(ctor_select_gpu()),
 	  qfam_gfx(ctor_get_qfam_gfx()), qfam_pres(ctor_get_qfam_pres()),
-	  qfam_trans(ctor_get_qfam_trans()), device(ctor_device()),
+	  qfam_trans(ctor_get_qfam_trans()), bindless(ctor_bindless()), device(ctor_device()),
 	  dispatch_loader(ctor_dispatch_loader()),
 	  debug_messenger(ctor_init_debug_messenger()), vma(ctor_vma()),
 	  q_gfx(device.getQueue(qfam_gfx, 0)), q_pres(device.getQueue(qfam_pres, 0)),
@@ -141,13 +224,14 @@ context::context(SDL_Window* const window)
 	ubo_obj = ubo<glm::mat4>(*this, "Objects");
 	ubo_lights = ubo<std::vector<point_light>, POINTLIGHT_BUFSIZE>(
 		*this, qfam_gfx, 0u, "Point Lights");
+	ubo_lights.data.resize(MAX_POINTLIGHT_COUNT);
 
 	texture_sampler = device.createSampler(
 		::vk::SamplerCreateInfo(
 			::vk::SamplerCreateFlags(), ::vk::Filter::eLinear, ::vk::Filter::eLinear,
 			::vk::SamplerMipmapMode::eLinear, ::vk::SamplerAddressMode::eRepeat,
 			::vk::SamplerAddressMode::eRepeat, ::vk::SamplerAddressMode::eRepeat, 0.0f,
-			true, 16.0f, false, ::vk::CompareOp::eAlways, 0.0f, 0.0f,
+			true, 16.0f, false, ::vk::CompareOp::eAlways, 0.0f, VK_LOD_CLAMP_NONE,
 			::vk::BorderColor::eIntOpaqueBlack, false),
 		nullptr);
 
@@ -160,6 +244,30 @@ context::context(SDL_Window* const window)
 	descset_inter = descsets[3];
 	update_descset_obj();
 
+	if (bindless) create_bindless_resources();
+
+	create_cull_resources();
+	multidraw = gpu.getFeatures().multiDrawIndirect;
+	tessellation = gpu.getFeatures().tessellationShader;
+	terrain.init(*this);
+
+	{
+		const auto grid = heightmap_grid_indices();
+		const ::vk::DeviceSize size = grid.size() * sizeof(uint16_t);
+
+		heightmap_ibuf = vma_buffer(
+			*this,
+			::vk::BufferCreateInfo(
+				::vk::BufferCreateFlags(), size,
+				::vk::BufferUsageFlagBits::eTransferDst |
+					::vk::BufferUsageFlagBits::eIndexBuffer),
+			VMA_ALLOC_CREATEINFO_GENERAL);
+
+		upload_batch batch(*this);
+		batch.copy_to_buffer(grid.data(), size, heightmap_ibuf);
+		set_debug_name(heightmap_ibuf.buffer, "MXN: Buffer (I), Heightmap Grid");
+	}
+
 	create_swapchain(window);
 
 	// Sync primitives /////////////////////////////////////////////////////////
@@ -223,6 +331,8 @@ context::context(SDL_Window* const window)
 	device.freeCommandBuffers(cmdpool_gfx, fontup_cmdbuf);
 	ImGui_ImplVulkan_DestroyFontUploadObjects();
 
+	textures.init(*this);
+
 	// Assign debug names //////////////////////////////////////////////////////
 
 	set_debug_name(surface, "MXN: Surface");
@@ -246,12 +356,28 @@ context::~context()
 {
 	device.waitIdle();
 	ImGui_ImplVulkan_Shutdown();
+	reap_uploads();
+	assert(uploads.empty());
+
+	for (auto& kvp : materials)
+	{
+		kvp.second.mat->destroy(*this);
+		if (!bindless) device.freeDescriptorSets(descpool, kvp.second.mat->descset);
+	}
+
+	materials.clear();
+	textures.destroy(*this);
+
+	if (bindless) destroy_bindless_resources();
 
 	device.destroySampler(texture_sampler);
 	destroy_swapchain();
+	destroy_cull_resources();
+	terrain.destroy(*this);
 
 	ubo_obj.destroy(*this);
 	ubo_lights.destroy(*this);
+	heightmap_ibuf.destroy(*this);
 
 	device.destroyDescriptorSetLayout(dsl_mat, nullptr);
 	device.destroyDescriptorSetLayout(dsl_inter, nullptr);
@@ -296,6 +422,16 @@ bool context::start_render() noexcept
 	[[maybe_unused]] const auto res_fencereset = device.resetFences(1, &fence_render);
 	assert(res_fencereset != ::vk::Result::eErrorOutOfDeviceMemory);
 
+	reap_uploads();
+
+	// Nothing is in flight, so material descriptors can safely be re-written.
+	// Textures and material parameters share one submission, ahead of the frame
+	{
+		upload_batch batch(*this);
+		textures.flush(*this, batch);
+		flush_material_writes(batch);
+	}
+
 	const auto res_acq = device.acquireNextImageKHR(
 		swapchain, std::numeric_limits<uint64_t>::max(), sema_imgavail, {});
 
@@ -313,6 +449,63 @@ void context::set_camera(const ubo<camera>& uniform)
 		NO_BUFVIEWS);
 
 	device.updateDescriptorSets(descwrite, {});
+
+	frame_cull = cull_mode.load();
+
+	// Gribb-Hartmann extraction, in object space so that meshlets' bounds can
+	// be tested as-is; Vulkan's depth range is [0, 1], so the near plane is
+	// the third row alone
+	const glm::mat4 m = uniform.data.camera.projview * ubo_obj.data;
+	const auto row = [&m](const int i) -> glm::vec4 {
+		return { m[0][i], m[1][i], m[2][i], m[3][i] };
+	};
+
+	const std::array<glm::vec4, 6> planes = {
+		row(3) + row(0), row(3) - row(0), row(3) + row(1),
+		row(3) - row(1), row(2), row(3) - row(2)
+	};
+
+	for (size_t i = 0; i < planes.size(); i++)
+	{
+		const glm::vec4 p = planes[i] / glm::length(glm::vec3(planes[i]));
+		frustum[i] = { p.x, p.y, p.z, p.w };
+	}
+
+	const glm::vec4 e =
+		glm::inverse(ubo_obj.data) * glm::vec4(uniform.data.camera.position, 1.0f);
+	eye = { e.x, e.y, e.z };
+}
+
+void context::cull_clusters(const model& model) noexcept
+{
+	if (frame_cull != cluster_cull::gpu) return;
+
+	for (const auto& mesh : model.meshes)
+	{
+		if (mesh.meshlets.empty()) continue;
+
+		begin_prepass_record();
+
+		if (!clusters_culled)
+		{
+			cmdbuf_prepass.bindPipeline(::vk::PipelineBindPoint::eCompute, ppl_cull.handle);
+			clusters_culled = true;
+		}
+
+		cull_pushconst pc = { .eye = glm::vec4(eye[0], eye[1], eye[2], 1.0f),
+							  .meshlet_count = static_cast<uint32_t>(mesh.meshlets.size()) };
+
+		for (size_t i = 0; i < frustum.size(); i++)
+			pc.planes[i] = { frustum[i][0], frustum[i][1], frustum[i][2], frustum[i][3] };
+
+		cmdbuf_prepass.bindDescriptorSets(
+			::vk::PipelineBindPoint::eCompute, ppl_cull.layout, 0, mesh.cull_descset,
+			{});
+		cmdbuf_prepass.pushConstants<cull_pushconst>(
+			ppl_cull.layout, ::vk::ShaderStageFlagBits::eCompute, 0, pc);
+		cmdbuf_prepass.dispatch(
+			(pc.meshlet_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	}
 }
 
 void context::start_render_record() noexcept
@@ -343,15 +536,33 @@ void context::start_render_record() noexcept
 			::vk::PipelineBindPoint::eGraphics, ppl_render.layout, 0,
 			std::array { descset_obj, descset_cam, descset_lightcull, descset_inter },
 			std::array<uint32_t, 0>());
+
+		// Bound once for every material; `bind_material()` only sets an index
+		if (bindless)
+		{
+			cmdbufs_gfx[img_idx].bindDescriptorSets(
+				::vk::PipelineBindPoint::eGraphics, ppl_render.layout, 4,
+				descset_bindless, {});
+		}
 	}
 
 	// Begin recording depth pre-pass command buffer ///////////////////////////
 
 	{
-		cmdbuf_prepass.reset(::vk::CommandBufferResetFlags());
+		begin_prepass_record();
 
-		cmdbuf_prepass.begin(::vk::CommandBufferBeginInfo(
-			::vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr));
+		// The geometry pass is submitted to the same queue after the pre-pass,
+		// so this barrier covers its indirect draws as well
+		if (clusters_culled)
+		{
+			cmdbuf_prepass.pipelineBarrier(
+				::vk::PipelineStageFlagBits::eComputeShader,
+				::vk::PipelineStageFlagBits::eDrawIndirect, ::vk::DependencyFlags(),
+				::vk::MemoryBarrier(
+					::vk::AccessFlagBits::eShaderWrite,
+					::vk::AccessFlagBits::eIndirectCommandRead),
+				{}, {});
+		}
 
 		static const ::vk::ClearValue
 		DEPTH_CLEAR_VAL(::vk::ClearDepthStencilValue(1.0f, 0.0f));
@@ -369,30 +580,140 @@ void context::start_render_record() noexcept
 			::vk::PipelineBindPoint::eGraphics, ppl_depth.layout, 0,
 			{ descset_obj, descset_cam }, {});
 	}
+
+	bound_format = vertex_format::full;
 }
 
 void context::record_draw(const model& model) noexcept
 {
 	for (const auto& mesh : model.meshes)
 	{
-		// Record rendering commands ///////////////////////////////////////////
+		// Variants share their layouts, so bound descriptor sets are undisturbed
+		if (mesh.format != bound_format)
+		{
+			const auto variant = static_cast<size_t>(mesh.format);
+			cmdbufs_gfx[img_idx].bindPipeline(
+				::vk::PipelineBindPoint::eGraphics, ppl_render.variant(variant));
+			cmdbuf_prepass.bindPipeline(
+				::vk::PipelineBindPoint::eGraphics, ppl_depth.variant(variant));
+			bound_format = mesh.format;
+		}
+
+		if (mesh.format != vertex_format::full)
+		{
+			const std::array pc = { mesh_pushconst {
+				.quant_origin = glm::vec4(mesh.quant_origin, 0.0f),
+				.quant_scale = glm::vec4(mesh.quant_scale, 0.0f) } };
+
+			cmdbufs_gfx[img_idx].pushConstants<mesh_pushconst>(
+				ppl_render.layout, ::vk::ShaderStageFlagBits::eVertex,
+				MESH_PUSHCONST_OFFSET, pc);
+			cmdbuf_prepass.pushConstants<mesh_pushconst>(
+				ppl_depth.layout, ::vk::ShaderStageFlagBits::eVertex,
+				MESH_PUSHCONST_OFFSET, pc);
+		}
+
+		const std::array cmdbufs = { cmdbufs_gfx[img_idx], cmdbuf_prepass };
+
+		for (const auto& cmdbuf : cmdbufs)
+		{
+			cmdbuf.bindVertexBuffers(0, mesh.verts.buffer, { 0 });
+			cmdbuf.bindIndexBuffer(mesh.indices.buffer, 0, mesh.index_type);
+		}
+
+		if (mesh.meshlets.empty() || frame_cull == cluster_cull::off)
+		{
+			for (const auto& cmdbuf : cmdbufs)
+				cmdbuf.drawIndexed(mesh.index_count, 1, 0, 0, 0);
+		}
+		else if (frame_cull == cluster_cull::cpu)
+		{
+			for (const auto& m : mesh.meshlets)
+			{
+				if (!meshopt::meshlet_visible(m, frustum, eye)) continue;
+
+				for (const auto& cmdbuf : cmdbufs)
+					cmdbuf.drawIndexed(m.index_count, 1, m.first_index, 0, 0);
+			}
+		}
+		else
+		{
+			// Culled meshlets' draws have no indices, and cost next to nothing
+			const auto count = static_cast<uint32_t>(mesh.meshlets.size());
+
+			for (const auto& cmdbuf : cmdbufs)
+			{
+				if (multidraw)
+				{
+					cmdbuf.drawIndexedIndirect(
+						mesh.draw_buf.buffer, 0, count, DRAW_CMD_SIZE);
+					continue;
+				}
+
+				for (uint32_t i = 0; i < count; i++)
+				{
+					cmdbuf.drawIndexedIndirect(
+						mesh.draw_buf.buffer, i * DRAW_CMD_SIZE, 1, DRAW_CMD_SIZE);
+				}
+			}
+		}
+	}
+}
+
+void context::record_terrain() noexcept
+{
+	if (terrain.chunk_count() == 0) return;
+
+	static constexpr uint32_t CELL_C = (heightmap::WIDTH - 1) * (heightmap::WIDTH - 1),
+							  INDEX_C = CELL_C * 6, PATCH_VERT_C = CELL_C * 4;
 
-		cmdbufs_gfx[img_idx].bindVertexBuffers(0, mesh.verts.buffer, { 0 });
-		cmdbufs_gfx[img_idx].bindIndexBuffer(mesh.indices.buffer, 0, ::vk::IndexType::eUint32);
-		cmdbufs_gfx[img_idx].drawIndexed(mesh.index_count, 1, 0, 0, 0);
+	const bool tess = tessellation && tessellate_terrain;
+	const auto variant = tess ? TERRAIN_TESS_VARIANT : TERRAIN_VARIANT;
+	const std::array cmdbufs = { cmdbufs_gfx[img_idx], cmdbuf_prepass };
+	const std::array ppls = { &ppl_render, &ppl_depth };
 
-		// Record depth-prepass commands ///////////////////////////////////////
+	for (size_t i = 0; i < cmdbufs.size(); i++)
+	{
+		cmdbufs[i].bindPipeline(
+			::vk::PipelineBindPoint::eGraphics, ppls[i]->variant(variant));
+		cmdbufs[i].bindDescriptorSets(
+			::vk::PipelineBindPoint::eGraphics, ppls[i]->layout, TERRAIN_SET,
+			terrain.descset(), {});
+		cmdbufs[i].bindVertexBuffers(0, terrain.instance_buffer().buffer, { 0 });
+
+		// Every chunk shares one grid; the instance gives its position and layer.
+		// Patches need no index buffer, since their vertices are never shared
+		if (tess)
+		{
+			cmdbufs[i].draw(PATCH_VERT_C, terrain.chunk_count(), 0, 0);
+			continue;
+		}
 
-		cmdbuf_prepass.bindVertexBuffers(0, mesh.verts.buffer, { 0 });
-		cmdbuf_prepass.bindIndexBuffer(mesh.indices.buffer, 0, ::vk::IndexType::eUint32);
-		cmdbuf_prepass.drawIndexed(mesh.index_count, 1, 0, 0, 0);
+		cmdbufs[i].bindIndexBuffer(heightmap_ibuf.buffer, 0, ::vk::IndexType::eUint16);
+		cmdbufs[i].drawIndexed(INDEX_C, terrain.chunk_count(), 0, 0, 0);
 	}
+
+	// Leave the variants `record_draw()` expects bound
+	const auto fmt_variant = static_cast<size_t>(bound_format);
+	cmdbufs_gfx[img_idx].bindPipeline(
+		::vk::PipelineBindPoint::eGraphics, ppl_render.variant(fmt_variant));
+	cmdbuf_prepass.bindPipeline(
+		::vk::PipelineBindPoint::eGraphics, ppl_depth.variant(fmt_variant));
 }
 
 void context::bind_material(const material& mat) noexcept
 {
-	cmdbufs_gfx[img_idx].bindDescriptorSets(
-		::vk::PipelineBindPoint::eGraphics, ppl_render.layout, 4, mat.descset, {});
+	if (bindless)
+	{
+		cmdbufs_gfx[img_idx].pushConstants(
+			ppl_render.layout, ::vk::ShaderStageFlagBits::eFragment,
+			offsetof(pushconst, material_index), sizeof(uint32_t), &mat.bindless_index);
+	}
+	else
+	{
+		cmdbufs_gfx[img_idx].bindDescriptorSets(
+			::vk::PipelineBindPoint::eGraphics, ppl_render.layout, 4, mat.descset, {});
+	}
 }
 
 void context::end_render_record() noexcept
@@ -401,6 +722,7 @@ void context::end_render_record() noexcept
 	cmdbufs_gfx[img_idx].end();
 	cmdbuf_prepass.endRenderPass();
 	cmdbuf_prepass.end();
+	prepass_begun = clusters_culled = false;
 }
 
 const ::vk::Semaphore& context::submit_prepass(
@@ -546,10 +868,81 @@ void context::rebuild_swapchain(SDL_Window* const window)
 	create_swapchain(window);
 }
 
+void context::request_shader_reload(const std::filesystem::path& spv)
+{
+	const std::scoped_lock lock(shader_reload_mtx);
+	shader_reloads.push_back(spv.filename().string());
+}
+
+void context::reload_shaders()
+{
+	std::vector<std::string> changed;
+
+	{
+		const std::scoped_lock lock(shader_reload_mtx);
+		changed.swap(shader_reloads);
+	}
+
+	if (changed.empty()) return;
+
+	ZoneScopedN("MXN: Shader Reload");
+
+	// Both compute pipelines use one shader each; every other shader belongs
+	// to the graphics pair, which share layouts and so are rebuilt together
+	bool gfx = false, comp = false, cull = false;
+
+	for (const auto& name : changed)
+	{
+		if (name == "lightcull.comp.spv")
+			comp = true;
+		else if (name == "cluster_cull.comp.spv")
+			cull = true;
+		else
+			gfx = true;
+	}
+
+	device.waitIdle();
+
+	try
+	{
+		if (gfx)
+		{
+			auto [depth, render] = create_graphics_pipelines();
+			ppl_depth.destroy(*this);
+			ppl_render.destroy(*this);
+			ppl_depth = std::move(depth);
+			ppl_render = std::move(render);
+		}
+
+		if (comp)
+		{
+			auto lightcull = create_compute_pipeline();
+			ppl_comp.destroy(*this);
+			ppl_comp = std::move(lightcull);
+		}
+
+		if (cull)
+		{
+			auto cluster_cull = create_cull_pipeline();
+			ppl_cull.destroy(*this);
+			ppl_cull = std::move(cluster_cull);
+		}
+	}
+	catch (const std::exception& err)
+	{
+		MXN_ERRF("(VK) Failed to reload shaders; keeping old pipelines. Details: {}",
+			err.what());
+		return;
+	}
+
+	MXN_LOGF("(VK) Reloaded {} shader(s).", changed.size());
+}
+
 ::vk::ShaderModule context::create_shader(
 	const std::filesystem::path& path, const std::string& debug_name) const
 {
-	std::vector<unsigned char> code = vfs_read(path);
+	// Mappings are aligned enough to be read as SPIR-V words in place
+	const auto code = vfs_map(path);
 
 	::vk::ShaderModule ret = device.createShaderModule(::vk::ShaderModuleCreateInfo(
 		::vk::ShaderModuleCreateFlags(), code.size(),
@@ -560,61 +953,203 @@ void context::rebuild_swapchain(SDL_Window* const window)
 	return ret;
 }
 
+const material& context::acquire_material(
+	const std::filesystem::path& albedo, const std::filesystem::path& normal,
+	const std::string& debug_name)
+{
+	std::lock_guard lock(materials_mtx);
+
+	auto& cached = materials[material_key(albedo, normal)];
+
+	if (cached.refs++ == 0)
+		cached.mat = std::make_unique<material>(create_material(albedo, normal, debug_name));
+
+	return *cached.mat;
+}
+
+void context::release_material(const material& mat)
+{
+	std::lock_guard lock(materials_mtx);
+
+	const auto iter = materials.find(material_key(
+		mat.albedo ? mat.albedo->path : "", mat.normal ? mat.normal->path : ""));
+	assert(iter != materials.end() && iter->second.mat.get() == &mat);
+
+	if (--iter->second.refs > 0) return;
+
+	auto& m = *iter->second.mat;
+	*m.alive = false;
+
+	if (m.albedo) textures.release(*this, m.albedo);
+	if (m.normal) textures.release(*this, m.normal);
+
+	m.destroy(*this);
+
+	if (bindless)
+		free_material_slots.push_back(m.bindless_index);
+	else
+		device.freeDescriptorSets(descpool, m.descset);
+
+	materials.erase(iter);
+}
+
 material context::create_material(
 	const std::filesystem::path& albedo, const std::filesystem::path& normal,
-	const std::string& debug_name
-) const
+	const std::string& debug_name)
 {
-	const ::vk::DescriptorSetAllocateInfo alloc_info(descpool, dsl_mat);
+	mxn::vk::material ret = {};
 
-	mxn::vk::material ret {
-		.info { *this, fmt::format("MXN: UBO, Material Info, {}", debug_name) },
-		.descset = device.allocateDescriptorSets(alloc_info)[0],
-		.albedo = vma_image::from_file(*this, albedo),
-		.normal = vma_image::from_file(*this, normal)
-	};
+	if (bindless)
+	{
+		if (free_material_slots.empty())
+			throw std::runtime_error("(VK) Out of bindless material slots.");
 
+		ret.bindless_index = free_material_slots.back();
+		free_material_slots.pop_back();
+	}
+	else
+	{
+		const ::vk::DescriptorSetAllocateInfo alloc_info(descpool, dsl_mat);
+		ret.info = ubo<material_info>(
+			*this, fmt::format("MXN: UBO, Material Info, {}", debug_name));
+		ret.descset = device.allocateDescriptorSets(alloc_info)[0];
+	}
+
+	// Placeholders look the same as the absence of a map, so the flags can be
+	// set now; only a two-channel normal map needs them updating later
 	ret.info.data = {
-		.has_albedo = ret.albedo ? 1 : 0,
-		.has_normal = ret.normal ? 1 : 0
+		.has_albedo = albedo.empty() ? 0 : 1,
+		.has_normal = normal.empty() ? 0 : 1
+	};
+
+	// Slot 0 is the albedo map, slot 1 the normal map
+	const auto write_image = [this, descset = ret.descset, index = ret.bindless_index](
+		const uint32_t slot, const ::vk::ImageView& view) -> void {
+		const ::vk::DescriptorImageInfo dii(
+			texture_sampler, view, ::vk::ImageLayout::eShaderReadOnlyOptimal);
+
+		device.updateDescriptorSets(
+			bindless ? ::vk::WriteDescriptorSet(
+						   descset_bindless, 1, index * 2 + slot,
+						   ::vk::DescriptorType::eCombinedImageSampler, dii,
+						   NO_DESCBUF_INFO, NO_BUFVIEWS)
+					 : ::vk::WriteDescriptorSet(
+						   descset, 1 + slot, 0,
+						   ::vk::DescriptorType::eCombinedImageSampler, dii,
+						   NO_DESCBUF_INFO, NO_BUFVIEWS),
+			{});
 	};
 
-	std::vector<::vk::WriteDescriptorSet> descwrites = {};
+	auto write_info = [this, info = ret.info, index = ret.bindless_index](
+		const material_info& data) mutable -> void {
+		if (!bindless)
+		{
+			info.data = data;
+			info.update(*this);
+			return;
+		}
 
-	const ::vk::DescriptorBufferInfo dbi(ret.info.get_buffer(), 0, ret.info.data_size);
+		const material_gpu gpu_mat = { .albedo_index = index * 2,
+									   .normal_index = index * 2 + 1,
+									   .has_albedo = data.has_albedo,
+									   .has_normal = data.has_normal };
 
-	descwrites.emplace_back(
-		ret.descset, 0, 0, ::vk::DescriptorType::eUniformBuffer,
-		NO_DESCIMG_INFO, dbi, NO_BUFVIEWS);
+		// Uploaded with the next frame's textures, by `flush_material_writes()`
+		std::lock_guard lock(material_writes_mtx);
+		material_writes.emplace_back(index, gpu_mat);
+	};
 
-	const ::vk::DescriptorImageInfo dii_albedo(texture_sampler, ret.albedo.view,
-		::vk::ImageLayout::eShaderReadOnlyOptimal);
+	if (!albedo.empty())
+	{
+		ret.albedo = textures.acquire(
+			*this, albedo, placeholder::albedo,
+			[write_image, alive = ret.alive](const texture& tex) -> void {
+				if (*alive) write_image(0, tex.view());
+			});
+	}
 
-	if (ret.info.data.has_albedo)
+	if (!normal.empty())
 	{
-		descwrites.emplace_back(
-			ret.descset, 1, 0, ::vk::DescriptorType::eCombinedImageSampler,
-			dii_albedo, NO_DESCBUF_INFO, NO_BUFVIEWS);
+		ret.normal = textures.acquire(
+			*this, normal, placeholder::normal,
+			[write_image, write_info, data = ret.info.data,
+			 alive = ret.alive](const texture& tex) mutable -> void {
+				if (!*alive) return;
+
+				write_image(1, tex.view());
+
+				if (tex.image.format != ::vk::Format::eBc5UnormBlock) return;
+
+				data.has_normal = 2;
+				write_info(data);
+			});
 	}
 
-	const ::vk::DescriptorImageInfo dii_norm(texture_sampler, ret.normal.view,
-		::vk::ImageLayout::eShaderReadOnlyOptimal);
+	// Already cached under another material, and decoded as two-channel
+	if (ret.normal && ret.normal->ready &&
+		ret.normal->image.format == ::vk::Format::eBc5UnormBlock)
+		ret.info.data.has_normal = 2;
 
-	if (ret.info.data.has_normal)
+	write_info(ret.info.data);
+
+	if (!bindless)
 	{
-		descwrites.emplace_back(
-			ret.descset, 2, 0, ::vk::DescriptorType::eCombinedImageSampler,
-			dii_norm, NO_DESCBUF_INFO, NO_BUFVIEWS);
+		const ::vk::DescriptorBufferInfo dbi(ret.info.get_buffer(), 0, ret.info.data_size);
+
+		device.updateDescriptorSets(
+			::vk::WriteDescriptorSet(
+				ret.descset, 0, 0, ::vk::DescriptorType::eUniformBuffer, NO_DESCIMG_INFO,
+				dbi, NO_BUFVIEWS),
+			{});
+
+		if (!debug_name.empty())
+			set_debug_name(ret.descset, fmt::format("MXN: Desc. Set, {}", debug_name));
 	}
 
-	device.updateDescriptorSets(descwrites, std::array<::vk::CopyDescriptorSet, 0>());
+	if (ret.albedo) write_image(0, ret.albedo->view());
+	if (ret.normal) write_image(1, ret.normal->view());
 
-	if (!debug_name.empty())
-		set_debug_name(ret.descset, fmt::format("MXN: Desc. Set, {}", debug_name));
+	return ret;
+}
+
+::vk::DescriptorSet context::alloc_cull_descset(
+	const vma_buffer& meshlets, const vma_buffer& draws) const
+{
+	::vk::DescriptorSet ret;
+
+	{
+		std::lock_guard lock(cull_mtx);
+		ret = device.allocateDescriptorSets(
+			::vk::DescriptorSetAllocateInfo(descpool_cull, dsl_cull))[0];
+	}
+
+	const std::array dbis = { ::vk::DescriptorBufferInfo(meshlets.buffer, 0, VK_WHOLE_SIZE),
+							  ::vk::DescriptorBufferInfo(draws.buffer, 0, VK_WHOLE_SIZE) };
+
+	device.updateDescriptorSets(
+		::vk::WriteDescriptorSet(
+			ret, 0, 0, ::vk::DescriptorType::eStorageBuffer, NO_DESCIMG_INFO, dbis,
+			NO_BUFVIEWS),
+		{});
 
 	return ret;
 }
 
+void context::free_cull_descset(const ::vk::DescriptorSet& descset) const
+{
+	std::lock_guard lock(cull_mtx);
+	device.freeDescriptorSets(descpool_cull, descset);
+}
+
+void context::retire_upload(
+	const ::vk::Fence& fence, const ::vk::CommandBuffer& cmdbuf,
+	std::vector<vma_buffer>&& stagings) const
+{
+	std::lock_guard lock(uploads_mtx);
+	uploads.push_back(
+		{ .fence = fence, .cmdbuf = cmdbuf, .stagings = std::move(stagings) });
+}
+
 ::vk::CommandBuffer context::begin_onetime_buffer() const
 {
 	const ::vk::CommandBufferAllocateInfo alloc_info(
@@ -637,7 +1172,8 @@ void context::consume_onetime_buffer(::vk::CommandBuffer&& cmdbuf) const
 
 void context::record_image_layout_change(
 	const ::vk::CommandBuffer& cmdbuf, const ::vk::Image& image,
-	const ::vk::ImageLayout from, const ::vk::ImageLayout to) const
+	const ::vk::ImageLayout from, const ::vk::ImageLayout to, const uint32_t base_mip,
+	const uint32_t mip_c) const
 {
 	::vk::AccessFlags src, dst;
 
@@ -654,6 +1190,27 @@ void context::record_image_layout_change(
 		src = ::vk::AccessFlagBits::eHostWrite;
 		dst = ::vk::AccessFlagBits::eTransferWrite;
 	}
+	else if (
+		from == ::vk::ImageLayout::eUndefined &&
+		to == ::vk::ImageLayout::eTransferDstOptimal)
+	{
+		src = ::vk::AccessFlags();
+		dst = ::vk::AccessFlagBits::eTransferWrite;
+	}
+	else if (
+		from == ::vk::ImageLayout::eTransferDstOptimal &&
+		to == ::vk::ImageLayout::eTransferSrcOptimal)
+	{
+		src = ::vk::AccessFlagBits::eTransferWrite;
+		dst = ::vk::AccessFlagBits::eTransferRead;
+	}
+	else if (
+		from == ::vk::ImageLayout::eTransferSrcOptimal &&
+		to == ::vk::ImageLayout::eShaderReadOnlyOptimal)
+	{
+		src = ::vk::AccessFlagBits::eTransferRead;
+		dst = ::vk::AccessFlagBits::eShaderRead;
+	}
 	else if (
 		from == ::vk::ImageLayout::eUndefined &&
 		to == ::vk::ImageLayout::eDepthStencilAttachmentOptimal)
@@ -708,7 +1265,7 @@ void context::record_image_layout_change(
 
 	const ::vk::ImageMemoryBarrier barrier(
 		src, dst, from, to, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image,
-		::vk::ImageSubresourceRange(aspect_mask, 0, 1, 0, 1));
+		::vk::ImageSubresourceRange(aspect_mask, base_mip, mip_c, 0, 1));
 
 	cmdbuf.pipelineBarrier(
 		// Happens before barrier
@@ -783,6 +1340,17 @@ void context::vkdiag(const std::vector<std::string>& args) const
 		return;
 	}
 
+	if (args[1] == "cache")
+	{
+		const auto [paths, images] = textures.counts();
+		MXN_LOGF("Textures: {} paths backed by {} images", paths, images);
+		MXN_LOGF("Textures still loading: {}", textures.pending());
+
+		std::lock_guard lock(materials_mtx);
+		MXN_LOGF("Materials: {} ({})", materials.size(), bindless ? "bindless" : "per-set");
+		return;
+	}
+
 	if (args[1] == "queue")
 	{
 		const auto qfams = gpu.getQueueFamilyProperties();
@@ -1075,14 +1643,19 @@ std::array<::vk::DescriptorSetLayout, 5> context::create_descset_layouts() const
 {
 	std::array<::vk::DescriptorSetLayout, 5> ret = {};
 
+	// Tessellated terrain transforms and projects its subdivided vertices
+	static constexpr auto TESS_STAGES = ::vk::ShaderStageFlagBits::eTessellationControl |
+										::vk::ShaderStageFlagBits::eTessellationEvaluation;
+
 	const ::vk::DescriptorSetLayoutBinding bind_obj(
 		0, ::vk::DescriptorType::eUniformBuffer, 1,
-		::vk::ShaderStageFlagBits::eVertex | ::vk::ShaderStageFlagBits::eFragment);
+		::vk::ShaderStageFlagBits::eVertex | ::vk::ShaderStageFlagBits::eFragment |
+			TESS_STAGES);
 
 	const ::vk::DescriptorSetLayoutBinding bind_cam(
 		0, ::vk::DescriptorType::eUniformBuffer, 1,
 		::vk::ShaderStageFlagBits::eVertex | ::vk::ShaderStageFlagBits::eFragment |
-			::vk::ShaderStageFlagBits::eCompute);
+			::vk::ShaderStageFlagBits::eCompute | TESS_STAGES);
 
 	const std::array binds_lightcull = {
 		// Light culling results
@@ -1135,12 +1708,79 @@ std::array<::vk::DescriptorSetLayout, 5> context::create_descset_layouts() const
 
 std::pair<pipeline, pipeline> context::create_graphics_pipelines() const
 {
-	::vk::Pipeline ppl_d = {}, ppl_r = {};
+	// One pipeline per vertex format, then two for `terrain`; the first is the
+	// parent of the others
+	std::array<::vk::Pipeline, TERRAIN_TESS_VARIANT + 1> ppls_d = {}, ppls_r = {};
 	::vk::PipelineLayout lo_d = {}, lo_r = {};
+	std::vector<::vk::ShaderModule> sms;
+
+	const auto shader = [this, &sms](const char* const path) -> ::vk::ShaderModule {
+		return sms.emplace_back(create_shader(path));
+	};
 
-	const ::vk::ShaderModule sm_depth = create_shader("shaders/depth.vert.spv"),
-							 sm_render_v = create_shader("shaders/fwdplus.vert.spv"),
-							 sm_render_f = create_shader("shaders/fwdplus.frag.spv");
+	// Null handles are ignored, so this needn't know how far creation got
+	const on_unwind cleanup([&]() -> void {
+		for (const auto& ppl : ppls_d) device.destroyPipeline(ppl);
+		for (const auto& ppl : ppls_r) device.destroyPipeline(ppl);
+
+		device.destroyPipelineLayout(lo_d);
+		device.destroyPipelineLayout(lo_r);
+
+		for (const auto& sm : sms) device.destroyShaderModule(sm);
+	});
+
+	const ::vk::ShaderModule
+		sm_depth = shader("shaders/depth.vert.spv"),
+		sm_depth_packed = shader("shaders/depth_packed.vert.spv"),
+		sm_render_v = shader("shaders/fwdplus.vert.spv"),
+		sm_render_v_packed = shader("shaders/fwdplus_packed.vert.spv"),
+		sm_render_v_terrain = shader("shaders/fwdplus_terrain.vert.spv"),
+		sm_depth_heightmap = shader("shaders/depth_heightmap.vert.spv"),
+		sm_render_v_heightmap = shader("shaders/fwdplus_heightmap.vert.spv"),
+		sm_render_f = shader(
+			bindless ? "shaders/fwdplus_bindless.frag.spv" : "shaders/fwdplus.frag.spv");
+
+	// Modules declaring the tessellation capability are invalid without the
+	// feature. Both passes share these, so that their depths agree exactly
+	const ::vk::ShaderModule
+		sm_tess_v = tessellation ? shader("shaders/heightmap_tess.vert.spv")
+								 : ::vk::ShaderModule(),
+		sm_tess_c = tessellation ? shader("shaders/heightmap.tesc.spv")
+								 : ::vk::ShaderModule(),
+		sm_tess_e = tessellation ? shader("shaders/heightmap.tese.spv")
+								 : ::vk::ShaderModule();
+
+	// Indexed by variant. The depth pass only reads positions, which the
+	// packed and terrain formats store identically
+	const std::array sms_depth = { sm_depth, sm_depth_packed, sm_depth_packed,
+								   sm_depth_heightmap, sm_tess_v };
+	const std::array sms_render_v = { sm_render_v, sm_render_v_packed,
+									  sm_render_v_terrain, sm_render_v_heightmap,
+									  sm_tess_v };
+
+	static_assert(sms_depth.size() == ppls_d.size());
+
+	const auto variant_name = [](const size_t i) -> std::string_view {
+		switch (i)
+		{
+		case TERRAIN_VARIANT: return "heightmap";
+		case TERRAIN_TESS_VARIANT: return "heightmap, tessellated";
+		default: return magic_enum::enum_name(static_cast<vertex_format>(i));
+		}
+	};
+
+	// The terrain variants read one `terrain_renderer::instance` per chunk,
+	// and derive the rest from `gl_VertexIndex` and the chunk's heights
+	const ::vk::VertexInputBindingDescription terrain_vertbind(
+		0, sizeof(terrain_renderer::instance), ::vk::VertexInputRate::eInstance);
+
+	const std::vector terrain_vertattrs = {
+		::vk::VertexInputAttributeDescription(
+			0, 0, ::vk::Format::eR32G32Sint,
+			offsetof(terrain_renderer::instance, position)),
+		::vk::VertexInputAttributeDescription(
+			1, 0, ::vk::Format::eR32Uint, offsetof(terrain_renderer::instance, layer))
+	};
 
 	// Shared state ////////////////////////////////////////////////////////////
 
@@ -1174,79 +1814,110 @@ std::pair<pipeline, pipeline> context::create_graphics_pipelines() const
 		::vk::PipelineMultisampleStateCreateFlags(), ::vk::SampleCountFlagBits::e1, false,
 		1.0f, nullptr, false, false);
 
-	// Depth pre-pass //////////////////////////////////////////////////////////
+	// Dequantisation parameters for packed vertex formats
+	const ::vk::PushConstantRange pcr_mesh(
+		::vk::ShaderStageFlagBits::eVertex, MESH_PUSHCONST_OFFSET,
+		sizeof(mesh_pushconst));
 
-	{
-		const ::vk::VertexInputBindingDescription vertbind(
-			0, sizeof(vertex::pos), ::vk::VertexInputRate::eVertex);
+	// Both layouts number their sets alike, so that the terrain's shaders can
+	// be shared between passes; the pre-pass just leaves most of them unbound
+	const std::array dsls = { dsl_obj,
+							  dsl_cam,
+							  dsl_lightcull,
+							  dsl_inter,
+							  bindless ? dsl_bindless : dsl_mat,
+							  terrain.descset_layout() };
 
-		const std::array vertattrs = { ::vk::VertexInputAttributeDescription(
-			0, 0, ::vk::Format::eR32G32B32Sfloat, offsetof(vertex, pos)) };
+	// Tessellated terrain: one quad patch per heightmap cell
 
-		const ::vk::PipelineVertexInputStateCreateInfo vertinput(
-			::vk::PipelineVertexInputStateCreateFlags(), vertbind, vertattrs);
+	const ::vk::PipelineInputAssemblyStateCreateInfo inasm_patches(
+		::vk::PipelineInputAssemblyStateCreateFlags(),
+		::vk::PrimitiveTopology::ePatchList, false);
+
+	const ::vk::PipelineTessellationStateCreateInfo tess(
+		::vk::PipelineTessellationStateCreateFlags(), 4);
+
+	// Edge lengths are measured in pixels, against the swapchain's height
+	const float viewport_height = static_cast<float>(extent.height);
+	const ::vk::SpecializationMapEntry tesc_spec_entry(0, 0, sizeof(float));
+	const ::vk::SpecializationInfo tesc_spec(
+		1, &tesc_spec_entry, sizeof(float), &viewport_height);
+
+	const std::array tess_stages = {
+		::vk::PipelineShaderStageCreateInfo(
+			::vk::PipelineShaderStageCreateFlags(),
+			::vk::ShaderStageFlagBits::eTessellationControl, sm_tess_c, "main",
+			&tesc_spec),
+		::vk::PipelineShaderStageCreateInfo(
+			::vk::PipelineShaderStageCreateFlags(),
+			::vk::ShaderStageFlagBits::eTessellationEvaluation, sm_tess_e, "main")
+	};
 
+	// Depth pre-pass //////////////////////////////////////////////////////////
+
+	{
 		::vk::PipelineDepthStencilStateCreateInfo depthstencil_prepass(depthstencil);
 		depthstencil_prepass.depthCompareOp = ::vk::CompareOp::eLess;
 		depthstencil_prepass.depthWriteEnable = true;
 
-		::vk::PipelineShaderStageCreateInfo stage(
-			::vk::PipelineShaderStageCreateFlags(), ::vk::ShaderStageFlagBits::eVertex,
-			sm_depth, "main");
-
-		const std::array dsls = { dsl_obj, dsl_cam };
-
 		const ::vk::PipelineLayoutCreateInfo layout_ci(
-			::vk::PipelineLayoutCreateFlags(), dsls, {});
+			::vk::PipelineLayoutCreateFlags(), dsls, pcr_mesh);
 
 		lo_d = device.createPipelineLayout(layout_ci);
 
-		const ::vk::GraphicsPipelineCreateInfo ppl_ci(
-			::vk::PipelineCreateFlagBits::eAllowDerivatives, stage, &vertinput, &inasm,
-			nullptr, &viewpstate, &raster, &multisampling, &depthstencil_prepass, nullptr,
-			nullptr, lo_d, depth_prepass, 0, ::vk::Pipeline(), -1);
-
-		const auto res = device.createGraphicsPipeline(::vk::PipelineCache(), ppl_ci);
-
-		if (res.result != ::vk::Result::eSuccess)
+		for (size_t i = 0; i < ppls_d.size(); i++)
 		{
-			throw std::runtime_error(fmt::format(
-				"(VK) Depth pre-pass pipeline creation failed: {}",
-				magic_enum::enum_name(res.result)));
+			if (i == TERRAIN_TESS_VARIANT && !tessellation) continue;
+
+			const bool heightmap = i >= TERRAIN_VARIANT,
+					   tessellated = i == TERRAIN_TESS_VARIANT;
+			const auto fmt = static_cast<vertex_format>(i);
+
+			const auto vertbind = heightmap
+									  ? terrain_vertbind
+									  : ::vk::VertexInputBindingDescription(
+											0, vertex_stride(fmt),
+											::vk::VertexInputRate::eVertex);
+
+			// Position always comes first, and is all this pass needs
+			const auto vertattrs = heightmap
+									   ? terrain_vertattrs
+									   : std::vector { vertex_attributes(fmt)[0] };
+
+			const ::vk::PipelineVertexInputStateCreateInfo vertinput(
+				::vk::PipelineVertexInputStateCreateFlags(), vertbind, vertattrs);
+
+			std::vector stages = { ::vk::PipelineShaderStageCreateInfo(
+				::vk::PipelineShaderStageCreateFlags(), ::vk::ShaderStageFlagBits::eVertex,
+				sms_depth[i], "main") };
+
+			if (tessellated)
+				stages.insert(stages.end(), tess_stages.begin(), tess_stages.end());
+
+			const ::vk::GraphicsPipelineCreateInfo ppl_ci(
+				i == 0 ? ::vk::PipelineCreateFlagBits::eAllowDerivatives
+					   : ::vk::PipelineCreateFlagBits::eDerivative,
+				stages, &vertinput, tessellated ? &inasm_patches : &inasm,
+				tessellated ? &tess : nullptr, &viewpstate, &raster, &multisampling,
+				&depthstencil_prepass, nullptr, nullptr, lo_d, depth_prepass, 0, ppls_d[0],
+				-1);
+
+			const auto res = device.createGraphicsPipeline(::vk::PipelineCache(), ppl_ci);
+
+			if (res.result != ::vk::Result::eSuccess)
+			{
+				throw std::runtime_error(fmt::format(
+					"(VK) Depth pre-pass pipeline creation failed ({} vertices): {}",
+					variant_name(i), magic_enum::enum_name(res.result)));
+			}
+
+			ppls_d[i] = res.value;
 		}
-
-		ppl_d = res.value;
 	}
 
 	// Render //////////////////////////////////////////////////////////////////
 
 	{
-		const ::vk::VertexInputBindingDescription vertbind(
-			0, sizeof(vertex), ::vk::VertexInputRate::eVertex);
-
-		const std::array vertattrs = {
-			::vk::VertexInputAttributeDescription(
-				0, 0, ::vk::Format::eR32G32B32Sfloat, offsetof(vertex, pos)),
-			::vk::VertexInputAttributeDescription(
-				1, 0, ::vk::Format::eR32G32B32Sfloat, offsetof(vertex, colour)),
-			::vk::VertexInputAttributeDescription(
-				2, 0, ::vk::Format::eR32G32Sfloat, offsetof(vertex, uv)),
-			::vk::VertexInputAttributeDescription(
-				3, 0, ::vk::Format::eR32G32B32Sfloat, offsetof(vertex, normal))
-		};
-
-		const ::vk::PipelineVertexInputStateCreateInfo vertinput(
-			::vk::PipelineVertexInputStateCreateFlags(), vertbind, vertattrs);
-
-		const std::array stages = {
-			::vk::PipelineShaderStageCreateInfo(
-				::vk::PipelineShaderStageCreateFlags(),
-				::vk::ShaderStageFlagBits::eVertex, sm_render_v, "main"),
-			::vk::PipelineShaderStageCreateInfo(
-				::vk::PipelineShaderStageCreateFlags(),
-				::vk::ShaderStageFlagBits::eFragment, sm_render_f, "main")
-		};
-
 		const ::vk::PipelineColorBlendAttachmentState cba(
 			true, ::vk::BlendFactor::eSrcAlpha, ::vk::BlendFactor::eOneMinusSrcAlpha,
 			::vk::BlendOp::eAdd, ::vk::BlendFactor::eOne, ::vk::BlendFactor::eZero,
@@ -1264,41 +1935,97 @@ std::pair<pipeline, pipeline> context::create_graphics_pipelines() const
 		const ::vk::PipelineDynamicStateCreateInfo dynstate(
 			::vk::PipelineDynamicStateCreateFlags(), dynstates);
 
-		const ::vk::PushConstantRange pcr(
-			::vk::ShaderStageFlagBits::eFragment, 0, sizeof(pushconst));
-
-		const std::array dsls = { dsl_obj, dsl_cam, dsl_lightcull, dsl_inter, dsl_mat };
+		const std::array pcrs = { ::vk::PushConstantRange(
+									  ::vk::ShaderStageFlagBits::eFragment, 0,
+									  sizeof(pushconst)),
+								  pcr_mesh };
 
 		const ::vk::PipelineLayoutCreateInfo layout_ci(
-			::vk::PipelineLayoutCreateFlags(), dsls, pcr);
+			::vk::PipelineLayoutCreateFlags(), dsls, pcrs);
 
 		lo_r = device.createPipelineLayout(layout_ci);
 
-		const ::vk::GraphicsPipelineCreateInfo ppl_ci(
-			::vk::PipelineCreateFlagBits::eAllowDerivatives, stages, &vertinput, &inasm,
-			nullptr, &viewpstate, &raster, &multisampling, &depthstencil, &cbs, &dynstate,
-			lo_r, render_pass, 0, ::vk::Pipeline(), -1);
+		for (size_t i = 0; i < ppls_r.size(); i++)
+		{
+			if (i == TERRAIN_TESS_VARIANT && !tessellation) continue;
 
-		const auto res = device.createGraphicsPipeline(::vk::PipelineCache(), ppl_ci);
+			const bool heightmap = i >= TERRAIN_VARIANT,
+					   tessellated = i == TERRAIN_TESS_VARIANT;
+			const auto fmt = static_cast<vertex_format>(i);
 
-		if (res.result != ::vk::Result::eSuccess)
-		{
-			throw std::runtime_error(fmt::format(
-				"(VK) Render pipeline creation failed: {}",
-				magic_enum::enum_name(res.result)));
-		}
+			const auto vertbind = heightmap
+									  ? terrain_vertbind
+									  : ::vk::VertexInputBindingDescription(
+											0, vertex_stride(fmt),
+											::vk::VertexInputRate::eVertex);
+
+			const auto vertattrs = heightmap ? terrain_vertattrs : vertex_attributes(fmt);
+
+			const ::vk::PipelineVertexInputStateCreateInfo vertinput(
+				::vk::PipelineVertexInputStateCreateFlags(), vertbind, vertattrs);
+
+			std::vector stages = { ::vk::PipelineShaderStageCreateInfo(
+				::vk::PipelineShaderStageCreateFlags(), ::vk::ShaderStageFlagBits::eVertex,
+				sms_render_v[i], "main") };
+
+			if (tessellated)
+				stages.insert(stages.end(), tess_stages.begin(), tess_stages.end());
+
+			stages.emplace_back(
+				::vk::PipelineShaderStageCreateFlags(),
+				::vk::ShaderStageFlagBits::eFragment, sm_render_f, "main");
+
+			const ::vk::GraphicsPipelineCreateInfo ppl_ci(
+				i == 0 ? ::vk::PipelineCreateFlagBits::eAllowDerivatives
+					   : ::vk::PipelineCreateFlagBits::eDerivative,
+				stages, &vertinput, tessellated ? &inasm_patches : &inasm,
+				tessellated ? &tess : nullptr, &viewpstate, &raster, &multisampling,
+				&depthstencil, &cbs, &dynstate, lo_r, render_pass, 0, ppls_r[0], -1);
+
+			const auto res = device.createGraphicsPipeline(::vk::PipelineCache(), ppl_ci);
 
-		ppl_r = res.value;
+			if (res.result != ::vk::Result::eSuccess)
+			{
+				throw std::runtime_error(fmt::format(
+					"(VK) Render pipeline creation failed ({} vertices): {}",
+					variant_name(i), magic_enum::enum_name(res.result)));
+			}
+
+			ppls_r[i] = res.value;
+		}
 	}
 
-	const std::pair<pipeline, pipeline> ret = {
-		pipeline(ppl_d, lo_d, { sm_depth }),
-		pipeline(ppl_r, lo_r, { sm_render_v, sm_render_f })
+	std::pair<pipeline, pipeline> ret = {
+		pipeline(ppls_d[0], lo_d, { sm_depth, sm_depth_packed, sm_depth_heightmap }),
+		pipeline(
+			ppls_r[0], lo_r,
+			{ sm_render_v, sm_render_v_packed, sm_render_v_terrain, sm_render_v_heightmap,
+			  sm_render_f })
 	};
 
-	set_debug_name(ret.first.handle, "MXN: Pipeline, Depth Pre-pass");
+	ret.first.variants.assign(ppls_d.begin() + 1, ppls_d.end());
+	ret.second.variants.assign(ppls_r.begin() + 1, ppls_r.end());
+
+	// Shared by both passes, but only owned by one
+	if (tessellation)
+	{
+		ret.second.shaders.insert(
+			ret.second.shaders.end(), { sm_tess_v, sm_tess_c, sm_tess_e });
+	}
+
+	for (size_t i = 0; i < ppls_d.size(); i++)
+	{
+		if (!ppls_d[i]) continue;
+
+		set_debug_name(
+			ret.first.variant(i),
+			fmt::format("MXN: Pipeline, Depth Pre-pass ({})", variant_name(i)));
+		set_debug_name(
+			ret.second.variant(i),
+			fmt::format("MXN: Pipeline, Render ({})", variant_name(i)));
+	}
+
 	set_debug_name(ret.first.layout, "MXN: Pipeline Layout, Depth Pre-pass");
-	set_debug_name(ret.second.handle, "MXN: Pipeline, Render");
 	set_debug_name(ret.second.layout, "MXN: Pipeline Layout, Render");
 
 	return ret;
@@ -1317,7 +2044,14 @@ pipeline context::create_compute_pipeline() const
 
 	const std::array dsls { dsl_lightcull, dsl_cam, dsl_inter };
 
-	const ::vk::PipelineLayout layout = device.createPipelineLayout(
+	::vk::PipelineLayout layout = {};
+
+	const on_unwind cleanup([&]() -> void {
+		device.destroyPipelineLayout(layout);
+		device.destroyShaderModule(shader);
+	});
+
+	layout = device.createPipelineLayout(
 		::vk::PipelineLayoutCreateInfo(::vk::PipelineLayoutCreateFlags(), dsls, pcr));
 
 	const auto res = device.createComputePipeline(
@@ -1340,6 +2074,48 @@ pipeline context::create_compute_pipeline() const
 	}
 }
 
+pipeline context::create_cull_pipeline() const
+{
+	const auto shader = create_shader("/shaders/cluster_cull.comp.spv");
+
+	const ::vk::PipelineShaderStageCreateInfo stage(
+		::vk::PipelineShaderStageCreateFlags(), ::vk::ShaderStageFlagBits::eCompute,
+		shader, "main");
+
+	const ::vk::PushConstantRange pcr(
+		::vk::ShaderStageFlagBits::eCompute, 0,
+		static_cast<uint32_t>(sizeof(cull_pushconst)));
+
+	::vk::PipelineLayout layout = {};
+
+	const on_unwind cleanup([&]() -> void {
+		device.destroyPipelineLayout(layout);
+		device.destroyShaderModule(shader);
+	});
+
+	layout = device.createPipelineLayout(
+		::vk::PipelineLayoutCreateInfo(::vk::PipelineLayoutCreateFlags(), dsl_cull, pcr));
+
+	const auto res = device.createComputePipeline(
+		::vk::PipelineCache(),
+		::vk::ComputePipelineCreateInfo(
+			::vk::PipelineCreateFlags(), stage, layout, VK_NULL_HANDLE, -1));
+
+	if (res.result == ::vk::Result::eSuccess)
+	{
+		const pipeline ret(res.value, layout, { shader });
+		set_debug_name(ret.handle, "MXN: Pipeline, Cluster Culling Compute");
+		set_debug_name(ret.layout, "MXN: Pipeline Layout, Cluster Culling Compute");
+		return ret;
+	}
+	else
+	{
+		throw std::runtime_error(fmt::format(
+			"(VK) Cluster culling compute pipeline creation failed: {}",
+			magic_enum::enum_name(res.result)));
+	}
+}
+
 vma_image context::create_depth_image() const
 {
 	const vma_image ret(
@@ -1392,6 +2168,7 @@ void context::create_swapchain(SDL_Window* const window)
 	update_descset_inter();
 	std::tie(ppl_depth, ppl_render) = create_graphics_pipelines();
 	ppl_comp = create_compute_pipeline();
+	ppl_cull = create_cull_pipeline();
 
 	tile_count = update_lightcull_tilecounts();
 	lightvis = create_and_write_lightvis_buffer();
@@ -1409,6 +2186,7 @@ void context::destroy_swapchain()
 	ppl_render.destroy(*this);
 	ppl_depth.destroy(*this);
 	ppl_comp.destroy(*this);
+	ppl_cull.destroy(*this);
 
 	for (auto& framebuf : framebufs) device.destroyFramebuffer(framebuf, nullptr);
 	framebufs.clear();
@@ -1433,6 +2211,175 @@ void context::destroy_swapchain()
 	device.destroySwapchainKHR(swapchain);
 }
 
+void context::create_bindless_resources()
+{
+	const uint32_t material_c = bindless_capacity(gpu), texture_c = material_c * 2;
+
+	if (material_c < MAX_BINDLESS_MATERIALS)
+		MXN_WARNF("(VK) GPU limits bindless materials to {}.", material_c);
+
+	const std::array binds = {
+		// Materials
+		::vk::DescriptorSetLayoutBinding(
+			0, ::vk::DescriptorType::eStorageBuffer, 1,
+			::vk::ShaderStageFlagBits::eFragment),
+		// Textures; two per material
+		::vk::DescriptorSetLayoutBinding(
+			1, ::vk::DescriptorType::eCombinedImageSampler, texture_c,
+			::vk::ShaderStageFlagBits::eFragment)
+	};
+
+	// Slots of released materials go unwritten, and slots can be written while
+	// other slots are in use by a frame in flight
+	const std::array<::vk::DescriptorBindingFlags, 2> bind_flags = {
+		::vk::DescriptorBindingFlags(),
+		::vk::DescriptorBindingFlagBits::ePartiallyBound |
+			::vk::DescriptorBindingFlagBits::eUpdateAfterBind
+	};
+
+	const ::vk::DescriptorSetLayoutBindingFlagsCreateInfo bind_flags_ci(bind_flags);
+
+	::vk::DescriptorSetLayoutCreateInfo dsl_ci(
+		::vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool, binds);
+	dsl_ci.pNext = &bind_flags_ci;
+
+	dsl_bindless = device.createDescriptorSetLayout(dsl_ci);
+
+	const std::array pool_sizes = {
+		::vk::DescriptorPoolSize(::vk::DescriptorType::eStorageBuffer, 1),
+		::vk::DescriptorPoolSize(::vk::DescriptorType::eCombinedImageSampler, texture_c)
+	};
+
+	descpool_bindless = device.createDescriptorPool(::vk::DescriptorPoolCreateInfo(
+		::vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind, 1, pool_sizes));
+
+	descset_bindless = device.allocateDescriptorSets(
+		::vk::DescriptorSetAllocateInfo(descpool_bindless, dsl_bindless))[0];
+
+	material_ssbo = vma_buffer(
+		*this,
+		::vk::BufferCreateInfo(
+			::vk::BufferCreateFlags(), sizeof(material_gpu) * material_c,
+			::vk::BufferUsageFlagBits::eStorageBuffer |
+				::vk::BufferUsageFlagBits::eTransferDst),
+		VMA_ALLOC_CREATEINFO_GENERAL);
+
+	const ::vk::DescriptorBufferInfo dbi(material_ssbo.buffer, 0, VK_WHOLE_SIZE);
+
+	device.updateDescriptorSets(
+		::vk::WriteDescriptorSet(
+			descset_bindless, 0, 0, ::vk::DescriptorType::eStorageBuffer,
+			NO_DESCIMG_INFO, dbi, NO_BUFVIEWS),
+		{});
+
+	// Hand out low slots first
+	free_material_slots.resize(material_c);
+
+	for (uint32_t i = 0; i < material_c; i++)
+		free_material_slots[i] = material_c - 1 - i;
+
+	set_debug_name(dsl_bindless, "MXN: Desc. Set Layout, Bindless");
+	set_debug_name(descpool_bindless, "MXN: Descriptor Pool, Bindless");
+	set_debug_name(descset_bindless, "MXN: Desc. Set, Bindless");
+	set_debug_name(material_ssbo.buffer, "MXN: SSBO, Materials");
+}
+
+void context::destroy_bindless_resources()
+{
+	material_ssbo.destroy(*this);
+	device.destroyDescriptorPool(descpool_bindless);
+	device.destroyDescriptorSetLayout(dsl_bindless);
+	free_material_slots.clear();
+}
+
+void context::create_cull_resources()
+{
+	const std::array binds = {
+		// Meshlets
+		::vk::DescriptorSetLayoutBinding(
+			0, ::vk::DescriptorType::eStorageBuffer, 1,
+			::vk::ShaderStageFlagBits::eCompute),
+		// Indirect draws
+		::vk::DescriptorSetLayoutBinding(
+			1, ::vk::DescriptorType::eStorageBuffer, 1,
+			::vk::ShaderStageFlagBits::eCompute)
+	};
+
+	dsl_cull = device.createDescriptorSetLayout(
+		::vk::DescriptorSetLayoutCreateInfo(::vk::DescriptorSetLayoutCreateFlags(), binds));
+
+	const ::vk::DescriptorPoolSize pool_size(
+		::vk::DescriptorType::eStorageBuffer, MAX_CULLED_MESHES * 2);
+
+	descpool_cull = device.createDescriptorPool(::vk::DescriptorPoolCreateInfo(
+		::vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, MAX_CULLED_MESHES,
+		pool_size));
+
+	set_debug_name(dsl_cull, "MXN: Desc. Set Layout, Cluster Culling");
+	set_debug_name(descpool_cull, "MXN: Descriptor Pool, Cluster Culling");
+}
+
+void context::destroy_cull_resources()
+{
+	device.destroyDescriptorPool(descpool_cull);
+	device.destroyDescriptorSetLayout(dsl_cull);
+}
+
+void context::begin_prepass_record() noexcept
+{
+	if (prepass_begun) return;
+
+	cmdbuf_prepass.reset(::vk::CommandBufferResetFlags());
+
+	cmdbuf_prepass.begin(::vk::CommandBufferBeginInfo(
+		::vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr));
+
+	prepass_begun = true;
+}
+
+void context::flush_material_writes(upload_batch& batch)
+{
+	std::lock_guard lock(material_writes_mtx);
+
+	if (material_writes.empty()) return;
+
+	// One staging buffer, scattered into the SSBO by one copy command
+	auto& stg = batch.staging(material_writes.size() * sizeof(material_gpu));
+	std::vector<::vk::BufferCopy> copies;
+	copies.reserve(material_writes.size());
+
+	void* d = nullptr;
+	[[maybe_unused]] const auto res = vmaMapMemory(vma, stg.allocation, &d);
+	assert(res == VK_SUCCESS);
+
+	for (size_t i = 0; i < material_writes.size(); i++)
+	{
+		const auto& [index, gpu_mat] = material_writes[i];
+		memcpy(static_cast<material_gpu*>(d) + i, &gpu_mat, sizeof(material_gpu));
+		copies.emplace_back(
+			i * sizeof(material_gpu), index * sizeof(material_gpu), sizeof(material_gpu));
+	}
+
+	vmaUnmapMemory(vma, stg.allocation);
+	batch.commands().copyBuffer(stg.buffer, material_ssbo.buffer, copies);
+	material_writes.clear();
+}
+
+void context::reap_uploads() const
+{
+	std::lock_guard lock(uploads_mtx);
+
+	std::erase_if(uploads, [this](retired_upload& up) -> bool {
+		if (device.getFenceStatus(up.fence) != ::vk::Result::eSuccess) return false;
+
+		for (auto& stg : up.stagings) stg.destroy(*this);
+
+		device.destroyFence(up.fence);
+		device.freeCommandBuffers(cmdpool_gfx, up.cmdbuf);
+		return true;
+	});
+}
+
 ::vk::Format context::depth_format() const
 {
 	static constexpr std::array CANDIDATES = { ::vk::Format::eD32Sfloat,
@@ -1780,6 +2727,24 @@ uint32_t context::ctor_get_qfam_trans() const
 	return INVALID_QUEUE_FAMILY;
 }
 
+bool context::ctor_bindless() const
+{
+	const auto chain = gpu.getFeatures2<
+		::vk::PhysicalDeviceFeatures2, ::vk::PhysicalDeviceDescriptorIndexingFeatures>();
+	const auto& feats = chain.get<::vk::PhysicalDeviceDescriptorIndexingFeatures>();
+
+	const bool ret = feats.runtimeDescriptorArray &&
+					 feats.descriptorBindingPartiallyBound &&
+					 feats.shaderSampledImageArrayNonUniformIndexing &&
+					 feats.descriptorBindingSampledImageUpdateAfterBind &&
+					 bindless_capacity(gpu) > 0;
+
+	if (!ret)
+		MXN_WARN("(VK) Descriptor indexing unsupported; materials will not be bindless.");
+
+	return ret;
+}
+
 ::vk::Device context::ctor_device() const
 {
 	static constexpr float QUEUE_PRIORITY[1] = { 1.0f };
@@ -1802,6 +2767,14 @@ uint32_t context::ctor_get_qfam_trans() const
 
 	::vk::PhysicalDeviceMultiviewFeaturesKHR mvfeats(true, false, true);
 
+	::vk::PhysicalDeviceDescriptorIndexingFeatures difeats = {};
+	difeats.runtimeDescriptorArray = true;
+	difeats.descriptorBindingPartiallyBound = true;
+	difeats.shaderSampledImageArrayNonUniformIndexing = true;
+	difeats.descriptorBindingSampledImageUpdateAfterBind = true;
+
+	if (bindless) mvfeats.pNext = reinterpret_cast<void*>(&difeats);
+
 	::vk::PhysicalDeviceFeatures2 feats2(feats);
 	feats2.pNext = reinterpret_cast<void*>(&mvfeats);
 
@@ -6,14 +6,21 @@
 #pragma once
 
 #include "../ecs.hpp"
+#include "../meshopt.hpp"
 #include "../preproc.hpp"
 #include "buffer.hpp"
 #include "detail.hpp"
 #include "image.hpp"
 #include "pipeline.hpp"
+#include "terrain.hpp"
+#include "texture.hpp"
 #include "ubo.hpp"
 
+#include <atomic>
 #include <filesystem>
+#include <mutex>
+#include <span>
+#include <unordered_map>
 #include <vulkan/vulkan.hpp>
 
 struct SDL_Window;
@@ -25,6 +32,20 @@ namespace mxn::vk
 {
 	struct model;
 	struct material;
+	struct material_gpu;
+	class upload_batch;
+	enum class vertex_format : uint8_t;
+
+	/// @brief How meshes with meshlets are culled; see `context::cull_clusters()`.
+	enum class cluster_cull : uint8_t
+	{
+		/// By a compute pass, whose output is drawn indirectly.
+		gpu,
+		/// On the render thread, while recording draws.
+		cpu,
+		/// Not at all; meshes are drawn whole.
+		off
+	};
 
 	class context final
 	{
@@ -34,12 +55,24 @@ namespace mxn::vk
 		const ::vk::PhysicalDevice gpu;
 		const uint32_t qfam_gfx = INVALID_QUEUE_FAMILY, qfam_pres = INVALID_QUEUE_FAMILY,
 					   qfam_trans = INVALID_QUEUE_FAMILY;
+		/// If the GPU supports descriptor indexing, all materials live in one
+		/// SSBO and all of their textures in one array, selected per draw by a
+		/// push constant. Otherwise, each material has its own descriptor set.
+		const bool bindless;
 		const ::vk::Device device;
 		const ::vk::DispatchLoaderDynamic dispatch_loader;
 		const ::vk::DebugUtilsMessengerEXT debug_messenger;
 		const VmaAllocator vma = nullptr;
 		const ::vk::Queue q_gfx, q_pres, q_comp;
 		const ::vk::CommandPool cmdpool_gfx, cmdpool_trans, cmdpool_comp;
+		texture_loader textures;
+		/// Drawn by `record_terrain()`.
+		terrain_renderer terrain;
+		/// Read once per frame, by `set_camera()`.
+		std::atomic<cluster_cull> cull_mode = cluster_cull::gpu;
+		/// Whether `record_terrain()` subdivides chunks close to the camera.
+		/// Ignored if the GPU lacks tessellation shaders.
+		std::atomic<bool> tessellate_terrain = true;
 
 		context(SDL_Window* const);
 		~context();
@@ -48,8 +81,9 @@ namespace mxn::vk
 		/**
 		 * @brief Start a new frame.
 		 *
-		 * Calls `ImGui::Render()`, resets the context's fence,
-		 * and acquires the next swapchain image.
+		 * Calls `ImGui::Render()`, resets the context's fence, uploads any
+		 * textures which have finished decoding, and acquires the next
+		 * swapchain image.
 		 *
 		 * @returns `false` if the context's swapchain requires re-creation.
 		 */
@@ -57,9 +91,22 @@ namespace mxn::vk
 
 		void set_camera(const ubo<camera>& uniform);
 
+		/// @brief If `cull_mode` is `gpu`, record the culling of each of the
+		/// model's meshlets against the camera given to `set_camera()`.
+		/// @note Call between `set_camera()` and `start_render_record()` for
+		/// every model to be drawn this frame; otherwise, its meshlets are
+		/// drawn according to whichever frame last culled them.
+		void cull_clusters(const mxn::vk::model&) noexcept;
+
 		void start_render_record() noexcept;
 		void bind_material(const mxn::vk::material&) noexcept;
+		/// @brief Binds the pipeline variants for each mesh's vertex format as
+		/// needed, so meshes sharing a format should be drawn consecutively.
 		void record_draw(const mxn::vk::model&) noexcept;
+		/// @brief Draw every chunk resident in `terrain`, in one instanced draw,
+		/// with whichever material is bound. If `tessellate_terrain`, each grid
+		/// cell is a patch, subdivided by its on-screen size and distance.
+		void record_terrain() noexcept;
 		void end_render_record() noexcept;
 
 		[[nodiscard]] const ::vk::Semaphore& submit_prepass(
@@ -98,22 +145,74 @@ namespace mxn::vk
 		/// @brief Rebuild the context's swapchain, framebuffers, and command buffer.
 		void rebuild_swapchain(SDL_Window* const);
 
+		/// @brief Have the next `reload_shaders()` rebuild every pipeline which
+		/// uses this SPIR-V file, e.g. "shaders/fwdplus.frag.spv".
+		/// @note Thread-safe.
+		void request_shader_reload(const std::filesystem::path& spv);
+		/// @brief Rebuild only the pipelines affected by requested shader
+		/// changes. If a rebuild fails, the old pipelines are kept.
+		/// @note Only call on the render thread, between frames.
+		void reload_shaders();
+
 		[[nodiscard]] ::vk::ShaderModule create_shader(
 			const std::filesystem::path&, const std::string& debug_name = "") const;
 
-		[[nodiscard]] material create_material(
+		/// @brief Get the cached material using this texture set, or create it.
+		/// Returns immediately; textures are loaded in the background by
+		/// `textures`, with placeholders bound until they are ready.
+		/// @note Every call must be paired with a call to `release_material()`.
+		[[nodiscard]] const material& acquire_material(
 			const std::filesystem::path& albedo = "",
 			const std::filesystem::path& normal = "",
-			const std::string& debug_name = "") const;
+			const std::string& debug_name = "");
+
+		/// @note Only call on the render thread, while no frame is in flight.
+		void release_material(const material&);
+
+		/// @brief Allocate the set through which `cull_clusters()` reads a
+		/// mesh's meshlets and writes its indirect draws.
+		[[nodiscard]] ::vk::DescriptorSet alloc_cull_descset(
+			const vma_buffer& meshlets, const vma_buffer& draws) const;
+		void free_cull_descset(const ::vk::DescriptorSet&) const;
+
+		/// @brief The 16-bit index buffer shared by every heightmap's mesh.
+		/// See `heightmap_grid_indices()`.
+		[[nodiscard]] constexpr const vma_buffer& heightmap_indices() const noexcept
+		{
+			return heightmap_ibuf;
+		}
+
+		/// @brief The point lights read by light culling, all `MAX_POINTLIGHT_COUNT`
+		/// of them. Never reallocated, so it may be bound as a script view.
+		[[nodiscard]] std::span<point_light> point_lights() noexcept
+		{
+			return ubo_lights.data;
+		}
+
+		/// @returns Whether the GPU has tessellation shaders, and so whether the
+		/// graphics pipelines have tessellated terrain variants.
+		[[nodiscard]] constexpr bool has_tessellation() const noexcept
+		{
+			return tessellation;
+		}
+
+		/// @brief Take ownership of a submitted upload's command buffer and
+		/// staging buffers, to be freed once `fence` signals.
+		/// @note Thread-safe. Used by `upload_batch::submit()`.
+		void retire_upload(
+			const ::vk::Fence& fence, const ::vk::CommandBuffer&,
+			std::vector<vma_buffer>&& stagings) const;
 
 		[[nodiscard]] ::vk::CommandBuffer begin_onetime_buffer() const;
 		/// @brief Ends, submits, and frees the given buffer.
 		/// @remark Only for use with the output of `begin_onetime_buffer()`.
 		void consume_onetime_buffer(::vk::CommandBuffer&&) const;
 
+		/// @param base_mip The first mip level affected by the transition.
+		/// @param mip_c How many mip levels, starting at `base_mip`, are affected.
 		void record_image_layout_change(
 			const ::vk::CommandBuffer&, const ::vk::Image&, ::vk::ImageLayout from,
-			::vk::ImageLayout to) const;
+			::vk::ImageLayout to, uint32_t base_mip = 0, uint32_t mip_c = 1) const;
 
 		[[nodiscard]] size_t swapchain_image_count() const noexcept
 		{
@@ -157,6 +256,7 @@ namespace mxn::vk
 		::vk::DescriptorSetLayout dsl_obj, dsl_cam, dsl_lightcull, dsl_inter, dsl_mat;
 
 		ubo<glm::mat4> ubo_obj;
+		vma_buffer heightmap_ibuf;
 		ubo<std::vector<point_light>, POINTLIGHT_BUFSIZE> ubo_lights;
 
 		pipeline ppl_render, ppl_depth, ppl_comp;
@@ -166,6 +266,28 @@ namespace mxn::vk
 		::vk::DescriptorPool descpool;
 		::vk::DescriptorSet descset_obj, descset_cam, descset_lightcull, descset_inter;
 
+		// Only used if `bindless`
+		::vk::DescriptorSetLayout dsl_bindless;
+		::vk::DescriptorPool descpool_bindless;
+		::vk::DescriptorSet descset_bindless;
+		vma_buffer material_ssbo;
+		std::vector<uint32_t> free_material_slots;
+		std::mutex material_writes_mtx;
+		/// SSBO slots and their new contents, pending `flush_material_writes()`.
+		std::vector<std::pair<uint32_t, material_gpu>> material_writes;
+
+		// Cluster culling
+
+		::vk::DescriptorSetLayout dsl_cull;
+		::vk::DescriptorPool descpool_cull;
+		/// Guards `descpool_cull`, which meshes allocate from as they upload.
+		mutable std::mutex cull_mtx;
+		pipeline ppl_cull;
+		/// Without it, indirect draws are recorded one meshlet at a time.
+		bool multidraw = false;
+		/// Without it, the graphics pipelines have no tessellated terrain variants.
+		bool tessellation = false;
+
 		/// `x` is per row, `y` is per column.
 		glm::uvec2 tile_count;
 		vma_buffer lightvis;
@@ -181,10 +303,47 @@ namespace mxn::vk
 
 		::vk::Fence fence_render;
 
+		// Caches //////////////////////////////////////////////////////////////
+
+		struct cached_material final
+		{
+			std::unique_ptr<material> mat;
+			uint32_t refs = 0;
+		};
+
+		mutable std::mutex materials_mtx;
+		/// Keyed by albedo and normal map paths.
+		std::unordered_map<std::string, cached_material> materials;
+
+		struct retired_upload final
+		{
+			::vk::Fence fence;
+			::vk::CommandBuffer cmdbuf;
+			std::vector<vma_buffer> stagings;
+		};
+
+		mutable std::mutex uploads_mtx;
+		/// See `retire_upload()`; freed by `reap_uploads()`.
+		mutable std::vector<retired_upload> uploads;
+
+		std::mutex shader_reload_mtx;
+		/// File names of changed SPIR-V; see `request_shader_reload()`.
+		std::vector<std::string> shader_reloads;
+
 		// Dynamic data ////////////////////////////////////////////////////////
 
 		size_t frame = 0;
 		uint32_t img_idx = 0;
+		/// Which pipeline variants are bound; see `record_draw()`.
+		vertex_format bound_format = {};
+		/// `cull_mode` as of the last call to `set_camera()`.
+		cluster_cull frame_cull = cluster_cull::gpu;
+		/// In the space of `ubo_obj`, as of the last call to `set_camera()`.
+		meshopt::frustum frustum = {};
+		std::array<float, 3> eye = {};
+		/// Whether the pre-pass command buffer has begun recording this frame,
+		/// and whether any culling has been recorded into it.
+		bool prepass_begun = false, clusters_culled = false;
 
 		// Methods /////////////////////////////////////////////////////////////
 
@@ -194,6 +353,7 @@ namespace mxn::vk
 		[[nodiscard]] uint32_t ctor_get_qfam_gfx() const;
 		[[nodiscard]] uint32_t ctor_get_qfam_pres() const;
 		[[nodiscard]] uint32_t ctor_get_qfam_trans() const;
+		[[nodiscard]] bool ctor_bindless() const;
 		[[nodiscard]] ::vk::Device ctor_device() const;
 		[[nodiscard]] ::vk::DispatchLoaderDynamic ctor_dispatch_loader() const;
 		[[nodiscard]] VmaAllocator ctor_vma() const;
@@ -213,6 +373,7 @@ namespace mxn::vk
 			const;
 		[[nodiscard]] std::pair<pipeline, pipeline> create_graphics_pipelines() const;
 		[[nodiscard]] pipeline create_compute_pipeline() const;
+		[[nodiscard]] pipeline create_cull_pipeline() const;
 		[[nodiscard]] vma_image create_depth_image() const;
 		[[nodiscard]] ::vk::DescriptorPool create_descpool() const;
 		/// @brief Returns object, camera, light culling, and intermediate
@@ -235,7 +396,27 @@ namespace mxn::vk
 		void create_swapchain(SDL_Window* const);
 		void destroy_swapchain();
 
+		void create_bindless_resources();
+		void destroy_bindless_resources();
+
+		void create_cull_resources();
+		void destroy_cull_resources();
+
+		/// @brief Reset and begin the pre-pass command buffer, unless it
+		/// already has been this frame.
+		void begin_prepass_record() noexcept;
+
+		/// @brief Record every pending write to the bindless material SSBO.
+		void flush_material_writes(upload_batch&);
+
+		/// @brief Free every retired upload whose fence has signalled.
+		void reap_uploads() const;
+
 		[[nodiscard]] ::vk::Format depth_format() const;
+
+		[[nodiscard]] material create_material(
+			const std::filesystem::path& albedo, const std::filesystem::path& normal,
+			const std::string& debug_name);
 	};
 } // namespace mxn::vk
 
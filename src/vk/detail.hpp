@@ -56,7 +56,10 @@ namespace mxn::vk
 	};
 
 	static constexpr uint32_t INVALID_QUEUE_FAMILY = std::numeric_limits<uint32_t>::max(),
-							  MAX_POINTLIGHT_COUNT = 2000u;
+							  MAX_POINTLIGHT_COUNT = 2000u,
+							  /// Each bindless material has two texture array slots.
+							  /// Fewer fit if the GPU's descriptor limits are lower.
+							  MAX_BINDLESS_MATERIALS = 1024u;
 	static constexpr size_t POINTLIGHT_BUFSIZE =
 		sizeof(point_light) * MAX_POINTLIGHT_COUNT + sizeof(glm::vec4);
 } // namespace mxn::vk
@@ -8,13 +8,22 @@
 #include "../file.hpp"
 #include "../log.hpp"
 #include "context.hpp"
+#include "upload.hpp"
 
 #include <SOIL2/SOIL2.h>
+#include <Tracy.hpp>
 #include <magic_enum.hpp>
 #include <vk_mem_alloc.h>
 
 using namespace mxn::vk;
 
+/// @brief Fill mips 1 through `mip_c - 1` of `image` by successively blitting each
+/// level down from the last, leaving every level ready for shader reads.
+/// @note Expects all levels in `eTransferDstOptimal`, with level 0 already filled.
+static void record_mip_blits(
+	const context&, const ::vk::CommandBuffer&, const ::vk::Image&, int32_t w, int32_t h,
+	uint32_t mip_c);
+
 vma_image::vma_image(
 	const context& ctxt, const ::vk::ImageCreateInfo& img_create_info,
 	::vk::ImageViewCreateInfo&& view_create_info, const VmaAllocationCreateInfo& vma_info,
@@ -48,87 +57,178 @@ vma_image::vma_image(
 	}
 }
 
-vma_image vma_image::from_file(const context& ctxt, const std::filesystem::path& path)
+std::optional<image_data> image_data::decode(
+	const context& ctxt, const std::filesystem::path& path)
 {
-	if (path.empty()) return {};
+	ZoneScopedN("MXN: Image Decode");
+
+	if (path.empty()) return std::nullopt;
+
+	// Prefer a baked KTX2 file, so long as it is usable on this GPU
+	if (auto baked = path; path.extension() == ".ktx2" ||
+						   vfs_exists(baked.replace_extension(".ktx2")))
+	{
+		image_data ret = { .path = baked, .bytes = vfs_read_async(baked).get() };
+		std::string error = {};
+
+		if (ret.bytes.empty())
+			MXN_ERRF("Failed to read KTX2 file: {}", baked.string());
+		else if (!(ret.ktx = ktx::parse(ret.bytes, error)).has_value())
+			MXN_ERRF("Failed to parse KTX2 file: {}\n\t{}", baked.string(), error);
+		else if (!(ctxt.gpu.getFormatProperties(static_cast<::vk::Format>(ret.ktx->vk_format))
+					   .optimalTilingFeatures &
+				   ::vk::FormatFeatureFlagBits::eSampledImage))
+		{
+			MXN_WARNF(
+				"(VK) GPU cannot sample format {} of KTX2 file: {}",
+				::vk::to_string(static_cast<::vk::Format>(ret.ktx->vk_format)),
+				baked.string());
+		}
+		else
+		{
+			ret.width = ret.ktx->width;
+			ret.height = ret.ktx->height;
+			return ret;
+		}
+
+		if (path.extension() == ".ktx2") return std::nullopt;
 
-	const auto mem = vfs_read(path);
-	assert(!mem.empty());
+		MXN_WARNF("Falling back to decoding unbaked image: {}", path.string());
+	}
+
+	const auto mem = vfs_read_async(path).get();
+
+	if (mem.empty())
+	{
+		MXN_ERRF("Failed to read image file: {}", path.string());
+		return std::nullopt;
+	}
 
 	int w = -1, h = -1, chans = -1;
 	unsigned char* img = SOIL_load_image_from_memory(
 		mem.data(), mem.size(), &w, &h, &chans, SOIL_LOAD_RGBA);
 
-	assert(img != nullptr);
+	if (img == nullptr)
+	{
+		MXN_ERRF("Failed to decode image file: {}\n\t{}", path.string(), SOIL_last_result());
+		return std::nullopt;
+	}
+
+	image_data ret = { .path = path,
+					   .bytes = vfs_mapping(std::vector<unsigned char>(
+						   img, img + static_cast<size_t>(w) * h * 4)),
+					   .width = static_cast<uint32_t>(w),
+					   .height = static_cast<uint32_t>(h) };
+
+	SOIL_free_image_data(img);
+	return ret;
+}
+
+vma_image vma_image::from_data(
+	const context& ctxt, upload_batch& batch, const image_data& data)
+{
+	static constexpr ::vk::Format RGBA8 = ::vk::Format::eR8G8B8A8Unorm;
+
+	const auto format =
+		data.ktx.has_value() ? static_cast<::vk::Format>(data.ktx->vk_format) : RGBA8;
+	const auto w = static_cast<int32_t>(data.width), h = static_cast<int32_t>(data.height);
+
+	uint32_t mip_c = data.ktx.has_value()
+		? static_cast<uint32_t>(data.ktx->levels.size())
+		: static_cast<uint32_t>(std::floor(std::log2(std::max(w, h)))) + 1;
+
+	// Mips are generated by linear-filtered blits, which not every format allows
+	if (!data.ktx.has_value() &&
+		!(ctxt.gpu.getFormatProperties(format).optimalTilingFeatures &
+		  ::vk::FormatFeatureFlagBits::eSampledImageFilterLinear))
+	{
+		MXN_WARNF(
+			"(VK) Linear blitting unsupported; no mips will be generated for: {}",
+			data.path.string());
+		mip_c = 1;
+	}
+
+	auto usage = ::vk::ImageUsageFlagBits::eTransferDst | ::vk::ImageUsageFlagBits::eSampled;
+
+	if (!data.ktx.has_value()) usage |= ::vk::ImageUsageFlagBits::eTransferSrc;
 
 	const ::vk::ImageCreateInfo img_ci(
-		::vk::ImageCreateFlags(), ::vk::ImageType::e2D, ::vk::Format::eR8G8B8A8Unorm,
-		::vk::Extent3D(w, h, 1), 1, 1, ::vk::SampleCountFlagBits::e1,
-		::vk::ImageTiling::eLinear,
-		::vk::ImageUsageFlagBits::eTransferDst | ::vk::ImageUsageFlagBits::eSampled,
+		::vk::ImageCreateFlags(), ::vk::ImageType::e2D, format,
+		::vk::Extent3D(w, h, 1), mip_c, 1, ::vk::SampleCountFlagBits::e1,
+		::vk::ImageTiling::eOptimal, usage,
 		::vk::SharingMode::eExclusive, // One queue family only
-		{},
-		::vk::ImageLayout::ePreinitialized
-	);
+		{}, ::vk::ImageLayout::eUndefined);
 
 	::vk::ImageViewCreateInfo view_ci(
-		::vk::ImageViewCreateFlags(), {}, ::vk::ImageViewType::e2D,
-		::vk::Format::eR8G8B8A8Unorm,
+		::vk::ImageViewCreateFlags(), {}, ::vk::ImageViewType::e2D, format,
 		{}, // Default component mapping; all swizzles identity
-		::vk::ImageSubresourceRange(::vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+		::vk::ImageSubresourceRange(::vk::ImageAspectFlagBits::eColor, 0, mip_c, 0, 1));
+
+	auto ret = vma_image(
+		ctxt, img_ci, std::move(view_ci), VMA_ALLOC_CREATEINFO_GENERAL,
+		fmt::format("MXN: Image, {}", data.path.string()));
 
-	::vk::Image staging_image = {};
-	VmaAllocation staging_alloc = VK_NULL_HANDLE;
+	if (!ret) return {};
+
+	ret.format = format;
+	ret.mip_count = mip_c;
+
+	// A KTX2 file goes up whole; each level is copied out from its own offset
+	auto& staging = batch.staging(data.bytes.size());
 
 	{
-		::vk::ImageCreateInfo staging_ci = img_ci;
-		staging_ci.usage = ::vk::ImageUsageFlagBits::eTransferSrc;
-		const auto& c_ici = static_cast<VkImageCreateInfo>(staging_ci);
-		VkImage img = VK_NULL_HANDLE;
-		VmaAllocationInfo alloc_info = {};
-		const VkResult res = vmaCreateImage(
-			ctxt.vma, &c_ici, &VMA_ALLOC_CREATEINFO_STAGING, &img, &staging_alloc,
-			&alloc_info);
-
-		if (res < VK_SUCCESS)
-		{
-			throw std::runtime_error(fmt::format(
-				"(VK) VMA failed to create/allocate/bind staging image: {}",
-				magic_enum::enum_name(res)));
-		}
+		void* d = nullptr;
+		[[maybe_unused]] const auto res = vmaMapMemory(ctxt.vma, staging.allocation, &d);
+		assert(res == VK_SUCCESS);
+		memcpy(d, data.bytes.data(), data.bytes.size());
+		vmaUnmapMemory(ctxt.vma, staging.allocation);
+	}
 
-		staging_image = ::vk::Image(img);
+	std::vector<::vk::BufferImageCopy> copies;
+
+	for (uint32_t i = 0; i < (data.ktx.has_value() ? mip_c : 1); i++)
+	{
+		copies.emplace_back(
+			data.ktx.has_value() ? data.ktx->levels[i].offset : 0, 0, 0,
+			::vk::ImageSubresourceLayers(::vk::ImageAspectFlagBits::eColor, i, 0, 1),
+			::vk::Offset3D(),
+			::vk::Extent3D(std::max(w >> i, 1), std::max(h >> i, 1), 1));
 	}
 
-	auto ret = vma_image(
-		ctxt, img_ci, std::move(view_ci), VMA_ALLOC_CREATEINFO_GENERAL,
-		fmt::format("MXN: Image, {}", path.string()));
+	const auto& cmdbuf = batch.commands();
 
-	auto cmdbuf = ctxt.begin_onetime_buffer();
 	ctxt.record_image_layout_change(
-		cmdbuf, staging_image, ::vk::ImageLayout::ePreinitialized,
-		::vk::ImageLayout::eTransferSrcOptimal);
-	ctxt.record_image_layout_change(
-		cmdbuf, ret.image, ::vk::ImageLayout::ePreinitialized,
-		::vk::ImageLayout::eTransferDstOptimal);
-
-	const ::vk::ImageSubresourceLayers srl(::vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+		cmdbuf, ret.image, ::vk::ImageLayout::eUndefined,
+		::vk::ImageLayout::eTransferDstOptimal, 0, mip_c);
 
-	cmdbuf.copyImage(
-		staging_image, ::vk::ImageLayout::eTransferSrcOptimal, ret.image,
-		::vk::ImageLayout::eTransferDstOptimal,
-		::vk::ImageCopy(srl, {}, srl, {}, ::vk::Extent3D(w, h, 1)));
+	cmdbuf.copyBufferToImage(
+		staging.buffer, ret.image, ::vk::ImageLayout::eTransferDstOptimal, copies);
 
-	ctxt.record_image_layout_change(
-		cmdbuf, ret.image, ::vk::ImageLayout::eTransferDstOptimal,
-		::vk::ImageLayout::eShaderReadOnlyOptimal);
-	ctxt.consume_onetime_buffer(std::move(cmdbuf));
+	if (data.ktx.has_value())
+	{
+		ctxt.record_image_layout_change(
+			cmdbuf, ret.image, ::vk::ImageLayout::eTransferDstOptimal,
+			::vk::ImageLayout::eShaderReadOnlyOptimal, 0, mip_c);
+	}
+	else
+		record_mip_blits(ctxt, cmdbuf, ret.image, w, h, mip_c);
 
-	vmaDestroyImage(ctxt.vma, staging_image, staging_alloc);
-	SOIL_free_image_data(img);
 	return ret;
 }
 
+vma_image vma_image::from_file(
+	const context& ctxt, upload_batch& batch, const std::filesystem::path& path)
+{
+	const auto data = image_data::decode(ctxt, path);
+	return data.has_value() ? from_data(ctxt, batch, *data) : vma_image();
+}
+
+vma_image vma_image::from_file(const context& ctxt, const std::filesystem::path& path)
+{
+	upload_batch batch(ctxt);
+	return from_file(ctxt, batch, path);
+}
+
 // Copiers, movers, teardown ///////////////////////////////////////////////////
 
 vma_image::vma_image(const vma_image& other)
@@ -137,6 +237,8 @@ vma_image::vma_image(const vma_image& other)
 	view = other.view;
 	memory = other.memory;
 	allocation = other.allocation;
+	format = other.format;
+	mip_count = other.mip_count;
 }
 
 vma_image& vma_image::operator=(const vma_image& other)
@@ -145,6 +247,8 @@ vma_image& vma_image::operator=(const vma_image& other)
 	view = other.view;
 	memory = other.memory;
 	allocation = other.allocation;
+	format = other.format;
+	mip_count = other.mip_count;
 	return *this;
 }
 
@@ -154,6 +258,8 @@ vma_image::vma_image(vma_image&& other)
 	view = other.view;
 	memory = other.memory;
 	allocation = other.allocation;
+	format = other.format;
+	mip_count = other.mip_count;
 	other.image = ::vk::Image(VK_NULL_HANDLE);
 	other.view = ::vk::ImageView(VK_NULL_HANDLE);
 	other.memory = ::vk::DeviceMemory(VK_NULL_HANDLE);
@@ -166,6 +272,8 @@ vma_image& vma_image::operator=(vma_image&& other)
 	view = other.view;
 	memory = other.memory;
 	allocation = other.allocation;
+	format = other.format;
+	mip_count = other.mip_count;
 	other.image = ::vk::Image(VK_NULL_HANDLE);
 	other.view = ::vk::ImageView(VK_NULL_HANDLE);
 	other.memory = ::vk::DeviceMemory(VK_NULL_HANDLE);
@@ -178,3 +286,40 @@ void vma_image::destroy(const context& ctxt)
 	vmaDestroyImage(ctxt.vma, image, allocation);
 	ctxt.device.destroyImageView(view);
 }
+
+// Details ////////////////////////////////////////////////////////////////////
+
+static void record_mip_blits(
+	const context& ctxt, const ::vk::CommandBuffer& cmdbuf, const ::vk::Image& image,
+	int32_t w, int32_t h, const uint32_t mip_c)
+{
+	for (uint32_t i = 1; i < mip_c; i++)
+	{
+		ctxt.record_image_layout_change(
+			cmdbuf, image, ::vk::ImageLayout::eTransferDstOptimal,
+			::vk::ImageLayout::eTransferSrcOptimal, i - 1, 1);
+
+		const int32_t next_w = w > 1 ? w / 2 : 1, next_h = h > 1 ? h / 2 : 1;
+
+		const ::vk::ImageBlit blit(
+			::vk::ImageSubresourceLayers(::vk::ImageAspectFlagBits::eColor, i - 1, 0, 1),
+			{ ::vk::Offset3D(0, 0, 0), ::vk::Offset3D(w, h, 1) },
+			::vk::ImageSubresourceLayers(::vk::ImageAspectFlagBits::eColor, i, 0, 1),
+			{ ::vk::Offset3D(0, 0, 0), ::vk::Offset3D(next_w, next_h, 1) });
+
+		cmdbuf.blitImage(
+			image, ::vk::ImageLayout::eTransferSrcOptimal, image,
+			::vk::ImageLayout::eTransferDstOptimal, blit, ::vk::Filter::eLinear);
+
+		ctxt.record_image_layout_change(
+			cmdbuf, image, ::vk::ImageLayout::eTransferSrcOptimal,
+			::vk::ImageLayout::eShaderReadOnlyOptimal, i - 1, 1);
+
+		w = next_w;
+		h = next_h;
+	}
+
+	ctxt.record_image_layout_change(
+		cmdbuf, image, ::vk::ImageLayout::eTransferDstOptimal,
+		::vk::ImageLayout::eShaderReadOnlyOptimal, mip_c - 1, 1);
+}
@@ -5,7 +5,11 @@
 
 #pragma once
 
+#include "../file.hpp"
+#include "../ktx.hpp"
+
 #include <filesystem>
+#include <optional>
 #include <vulkan/vulkan.hpp>
 
 struct VmaAllocation_T;
@@ -16,6 +20,25 @@ struct VmaAllocationCreateInfo;
 namespace mxn::vk
 {
 	class context;
+	class upload_batch;
+
+	/// @brief An image file read and decoded into memory, but not yet uploaded.
+	/// Producing one touches no Vulkan state, so it can be done on any thread.
+	struct image_data final
+	{
+		std::filesystem::path path;
+		/// Either tightly-packed RGBA8 texels, or a whole KTX2 file.
+		vfs_mapping bytes;
+		/// Only present if `bytes` holds a KTX2 file.
+		std::optional<ktx::texture> ktx;
+		uint32_t width = 0, height = 0;
+
+		/// @brief Read and decode `path`, preferring a baked `.ktx2` sibling
+		/// (see `tools/texbake.cpp`) if one exists and the GPU can sample it.
+		/// Files are read on the VFS's I/O pool, so prefetched ones are reused.
+		[[nodiscard]] static std::optional<image_data> decode(
+			const context&, const std::filesystem::path&);
+	};
 
 	/// @brief Wraps an image allocated using VMA alongside a view its memory.
 	struct vma_image final
@@ -24,6 +47,8 @@ namespace mxn::vk
 		::vk::ImageView view;
 		::vk::DeviceMemory memory;
 		VmaAllocation allocation = VK_NULL_HANDLE;
+		::vk::Format format = ::vk::Format::eUndefined;
+		uint32_t mip_count = 1;
 
 		constexpr vma_image() noexcept = default;
 
@@ -32,6 +57,18 @@ namespace mxn::vk
 			const context&, const ::vk::ImageCreateInfo&, ::vk::ImageViewCreateInfo&&,
 			const VmaAllocationCreateInfo&, const std::string& debug_postfix = "");
 
+		/// @brief Upload decoded image data as an optimally-tiled texture.
+		/// KTX2 level data goes up as-is; RGBA8 texels get a full mip chain,
+		/// generated via blits on the GPU.
+		/// @note Transfers are only recorded into `batch`; the image is not
+		/// ready for sampling until that batch has been submitted.
+		static vma_image from_data(const context&, upload_batch& batch, const image_data&);
+
+		/// @brief Shorthand for `image_data::decode()` followed by `from_data()`.
+		static vma_image from_file(
+			const context&, upload_batch& batch, const std::filesystem::path&);
+
+		/// @brief As above, but submits and waits on its own upload batch.
 		static vma_image from_file(const context&, const std::filesystem::path&);
 
 		vma_image(const vma_image&);
@@ -6,15 +6,30 @@
 #include "model.hpp"
 
 #include "../file.hpp"
+#include "../meshopt.hpp"
 #include "../world.hpp"
 #include "context.hpp"
 #include "detail.hpp"
+#include "upload.hpp"
 
 #include <Tracy.hpp>
+#include <algorithm>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
+#include <cstring>
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+#include <limits>
+#include <span>
 #include <xxhash.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 using namespace mxn::vk;
 
 namespace std
@@ -29,12 +44,135 @@ namespace std
 	};
 } // namespace std
 
+/// @brief A read-only view of a mapped VFS file, for Assimp.
+class vfs_iostream final : public Assimp::IOStream
+{
+	mxn::vfs_mapping data;
+	size_t cursor = 0;
+
+public:
+	explicit vfs_iostream(mxn::vfs_mapping&& data) : data(std::move(data)) {}
+
+	size_t Read(void* const buf, const size_t size, const size_t count) override
+	{
+		if (size == 0) return 0;
+
+		const size_t ret = std::min(count, (data.size() - cursor) / size);
+		memcpy(buf, data.data() + cursor, ret * size);
+		cursor += ret * size;
+		return ret;
+	}
+
+	size_t Write(const void*, size_t, size_t) override { return 0; }
+
+	aiReturn Seek(const size_t offset, const aiOrigin origin) override
+	{
+		size_t target = offset;
+
+		// Offsets from the end arrive negated, and so wrap around to the target
+		if (origin == aiOrigin_CUR)
+			target += cursor;
+		else if (origin == aiOrigin_END)
+			target += data.size();
+
+		if (target > data.size()) return aiReturn_FAILURE;
+
+		cursor = target;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const override { return cursor; }
+	size_t FileSize() const override { return data.size(); }
+	void Flush() override {}
+};
+
+/// @brief Lets Assimp open a model's sibling files (e.g. a glTF file's buffers,
+/// or an OBJ file's materials) through the VFS, as it does the model itself.
+class vfs_iosystem final : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* const path) const override { return mxn::vfs_exists(path); }
+	char getOsSeparator() const override { return '/'; }
+
+	Assimp::IOStream* Open(const char* const path, const char* const mode) override
+	{
+		// The VFS is read-only
+		if (std::strchr(mode, 'w') != nullptr || std::strchr(mode, 'a') != nullptr)
+			return nullptr;
+
+		if (!mxn::vfs_exists(path)) return nullptr;
+
+		auto data = mxn::vfs_read_async(path).get();
+		return new vfs_iostream(std::move(data));
+	}
+
+	void Close(Assimp::IOStream* const stream) override { delete stream; }
+};
+
 using tri = std::array<uint32_t, 3>;
-using mesh_pair = std::pair<std::vector<vertex>, std::vector<vertex::index_t>>;
+using mesh_pair = model_importer::mesh_data;
 
 [[nodiscard]] static std::pair<std::vector<glm::vec3>, std::vector<tri>> polygonise(
 	const std::array<float, 8>&, const glm::vec3);
 
+/// @brief Allocate device-local vertex and index buffers for the given data and
+/// record their uploads into `batch`, packing the vertices into `fmt` first.
+/// Indices are narrowed to 16 bits if there are few enough vertices.
+/// If there are any meshlets, their culling buffers are allocated too.
+[[nodiscard]] static mesh upload_mesh(
+	const context&, upload_batch&, std::span<const vertex>,
+	std::span<const vertex::index_t>, vertex_format fmt = vertex_format::full,
+	std::span<const meshopt::meshlet> meshlets = {});
+/// @brief Split a mesh into meshlets if it has enough triangles to benefit.
+[[nodiscard]] static std::vector<meshopt::meshlet> maybe_build_meshlets(
+	std::span<const vertex>, std::span<const vertex::index_t>);
+/// @brief Quantise `verts` into `m.format`, and set `m`'s dequantisation parameters.
+[[nodiscard]] static std::vector<unsigned char> pack_vertices(
+	std::span<const vertex> verts, mesh& m);
+/// @brief Octahedral encoding of a unit vector, into [-1, 1] on both axes.
+[[nodiscard]] static glm::vec2 oct_encode(glm::vec3);
+/// @brief Octahedral-encoded, signed-normalised normals of every height sample,
+/// from central differences (one-sided at the edges), in row-major order.
+/// @param hscale World-space height of one unit of `heightmap::heights`.
+static void heightmap_normals(
+	const heightmap&, float hscale, std::span<glm::i16vec2> out);
+
+uint32_t mxn::vk::vertex_stride(const vertex_format fmt) noexcept
+{
+	switch (fmt)
+	{
+	case vertex_format::packed: return sizeof(packed_vertex);
+	case vertex_format::terrain: return sizeof(terrain_vertex);
+	default: return sizeof(vertex);
+	}
+}
+
+std::vector<::vk::VertexInputAttributeDescription> mxn::vk::vertex_attributes(
+	const vertex_format fmt)
+{
+	using attr = ::vk::VertexInputAttributeDescription;
+
+	switch (fmt)
+	{
+	case vertex_format::packed:
+		return { attr(0, 0, ::vk::Format::eR16G16B16A16Snorm, offsetof(packed_vertex, pos)),
+				 attr(1, 0, ::vk::Format::eR8G8B8A8Unorm, offsetof(packed_vertex, colour)),
+				 attr(2, 0, ::vk::Format::eR16G16Sfloat, offsetof(packed_vertex, uv)),
+				 attr(3, 0, ::vk::Format::eR16G16Snorm, offsetof(packed_vertex, normal)) };
+	case vertex_format::terrain:
+		return { attr(
+					 0, 0, ::vk::Format::eR16G16B16A16Snorm, offsetof(terrain_vertex, pos)),
+				 attr(
+					 3, 0, ::vk::Format::eR16G16Snorm,
+					 offsetof(terrain_vertex, normal)) };
+	default:
+		return { attr(0, 0, ::vk::Format::eR32G32B32Sfloat, offsetof(vertex, pos)),
+				 attr(1, 0, ::vk::Format::eR32G32B32Sfloat, offsetof(vertex, colour)),
+				 attr(2, 0, ::vk::Format::eR32G32Sfloat, offsetof(vertex, uv)),
+				 attr(3, 0, ::vk::Format::eR32G32B32Sfloat, offsetof(vertex, normal)) };
+	}
+}
+
 void mxn::vk::fill_vertex_buffer(
 	const context& ctxt, vma_buffer& buf, const std::vector<vertex>& verts)
 {
@@ -60,120 +198,106 @@ void mxn::vk::fill_index_buffer(
 void material::destroy(const context& ctxt)
 {
 	info.destroy(ctxt);
-	// TODO: Free descriptor set
-
-	if (albedo) albedo.destroy(ctxt);
-	if (normal) normal.destroy(ctxt);
 }
 
-model model::from_heightmap(const context& ctxt, const heightmap& hmap)
+std::vector<uint16_t> mxn::vk::heightmap_grid_indices()
 {
-	mesh_pair mpair = {};
-	auto& verts = mpair.first;
-	auto& indices = mpair.second;
-
-	static constexpr float HSCALE = .00001f;
-	const glm::vec2 pos_offs = { heightmap::WORLD_SIZE * hmap.position.x,
-								 heightmap::WORLD_SIZE * hmap.position.y };
+	static constexpr size_t WM1 = heightmap::WIDTH - 1;
+	static_assert(heightmap::WIDTH * heightmap::WIDTH <= 65536);
 
-	verts.reserve(heightmap::WIDTH * heightmap::WIDTH);
+	std::vector<uint16_t> ret(WM1 * WM1 * 6);
 
-	for (size_t y = 0; y < heightmap::WIDTH; y++)
+	for (uint16_t ti = 0, vi = 0, z = 0; z < WM1; z++, vi++)
 	{
-		for (size_t x = 0; x < heightmap::WIDTH; x++)
+		for (uint16_t x = 0; x < WM1; x++, ti += 6, vi++)
 		{
-			verts.push_back({ .pos = { static_cast<float>(x + pos_offs.x),
-									   static_cast<float>(y + pos_offs.y),
-									   static_cast<float>(hmap.heights[y][x]) * HSCALE },
-							  .colour = { 1.0f, 1.0f, 1.0f },
-							  .uv = { /* TODO */ },
-							  // Calculated post-hoc
-							  .normal = {},
-							  .binormal = {} });
+			ret[ti] = vi;
+			ret[ti + 3] = ret[ti + 2] = vi + 1;
+			ret[ti + 4] = ret[ti + 1] = vi + WM1 + 1;
+			ret[ti + 5] = vi + WM1 + 2;
 		}
 	}
 
-	static constexpr size_t WM1 = heightmap::WIDTH - 1;
-
-	indices.resize(WM1 * WM1 * 6);
+	return ret;
+}
 
-	for (uint32_t ti = 0, vi = 0, z = 0; z < WM1; z++, vi++)
-	{
-		for (uint32_t x = 0; x < WM1; x++, ti += 6, vi++)
-		{
-			indices[ti] = vi;
-			indices[ti + 3] = indices[ti + 2] = vi + 1;
-			indices[ti + 4] = indices[ti + 1] = vi + WM1 + 1;
-			indices[ti + 5] = vi + WM1 + 2;
-		}
-	}
+model model::from_heightmap(
+	const context& ctxt, upload_batch& batch, const heightmap& hmap)
+{
+	ZoneScopedN("MXN: Heightmap Mesh");
 
-	// Calculate vertex normals
-	for (size_t e = 0; e < indices.size(); e += 3)
-	{
-		const uint32_t e0 = indices[e], e1 = indices[e + 1], e2 = indices[e + 2];
+	static constexpr float HSCALE = heightmap::HEIGHT_SCALE;
+	static constexpr float HALF_EXTENT = (heightmap::WIDTH - 1) * 0.5f;
+	static constexpr size_t VERT_C = heightmap::WIDTH * heightmap::WIDTH,
+							INDEX_C = (heightmap::WIDTH - 1) * (heightmap::WIDTH - 1) * 6;
 
-		const glm::vec3 v1 = verts[e1].pos - verts[e0].pos,
-						v2 = verts[e2].pos - verts[e0].pos;
+	const glm::vec2 pos_offs = { heightmap::WORLD_SIZE * hmap.position.x,
+								 heightmap::WORLD_SIZE * hmap.position.y };
 
-		const glm::vec3 normal = glm::normalize(glm::cross(v1, v2));
+	uint16_t lo = std::numeric_limits<uint16_t>::max(), hi = 0;
 
-		verts[e0].normal += normal;
-		verts[e1].normal += normal;
-		verts[e2].normal += normal;
-		verts[e0].normal = glm::normalize(verts[e0].normal);
-		verts[e1].normal = glm::normalize(verts[e1].normal);
-		verts[e2].normal = glm::normalize(verts[e2].normal);
+	for (const auto& row : hmap.heights)
+	{
+		const auto [rlo, rhi] = std::minmax_element(row.begin(), row.end());
+		lo = std::min(lo, *rlo);
+		hi = std::max(hi, *rhi);
 	}
 
-	const size_t vbsz = (verts.size() * sizeof(vertex)),
-				 ibsz = (indices.size() * sizeof(vertex::index_t));
+	mesh m = { .index_count = static_cast<uint32_t>(INDEX_C),
+			   .index_type = ::vk::IndexType::eUint16,
+			   .format = vertex_format::terrain,
+			   .quant_origin = { pos_offs.x + HALF_EXTENT, pos_offs.y + HALF_EXTENT,
+								 (static_cast<float>(lo) + hi) * 0.5f * HSCALE },
+			   .quant_scale = { HALF_EXTENT, HALF_EXTENT,
+								std::max((static_cast<float>(hi) - lo) * 0.5f * HSCALE,
+										 1e-6f) },
+			   .shared_indices = true };
 
-	model ret = { .meshes = {
-					  { .verts = vma_buffer(
-							ctxt,
-							::vk::BufferCreateInfo(
-								::vk::BufferCreateFlags(), vbsz,
-								::vk::BufferUsageFlagBits::eTransferDst |
-									::vk::BufferUsageFlagBits::eVertexBuffer |
-									::vk::BufferUsageFlagBits::eIndexBuffer),
-							VMA_ALLOC_CREATEINFO_GENERAL),
-						.indices = vma_buffer(
-							ctxt,
-							::vk::BufferCreateInfo(
-								::vk::BufferCreateFlags(), ibsz,
-								::vk::BufferUsageFlagBits::eTransferDst |
-									::vk::BufferUsageFlagBits::eVertexBuffer |
-									::vk::BufferUsageFlagBits::eIndexBuffer),
-							VMA_ALLOC_CREATEINFO_GENERAL),
-						.index_count = static_cast<uint32_t>(indices.size()) } } };
+	m.indices = ctxt.heightmap_indices();
 
-	{
-		vma_buffer staging = vma_buffer::staging_preset(ctxt, vbsz);
-		fill_vertex_buffer(ctxt, staging, verts);
-		staging.copy_to(ctxt, ret.meshes.back().verts, { ::vk::BufferCopy(0, 0, vbsz) });
-		staging.destroy(ctxt);
-	}
+	std::array<glm::i16vec2, VERT_C> normals;
+	heightmap_normals(hmap, HSCALE, normals);
+
+	std::vector<terrain_vertex> verts(VERT_C);
 
+	for (size_t y = 0, i = 0; y < heightmap::WIDTH; y++)
 	{
-		vma_buffer staging = vma_buffer::staging_preset(ctxt, ibsz);
-		fill_index_buffer(ctxt, staging, indices);
-		staging.copy_to(
-			ctxt, ret.meshes.back().indices, { ::vk::BufferCopy(0, 0, ibsz) });
-		staging.destroy(ctxt);
+		for (size_t x = 0; x < heightmap::WIDTH; x++, i++)
+		{
+			const glm::vec3 pos = { static_cast<float>(x) + pos_offs.x,
+									static_cast<float>(y) + pos_offs.y,
+									static_cast<float>(hmap.heights[y][x]) * HSCALE };
+
+			verts[i] = { .pos = glm::packSnorm<int16_t>(
+							 glm::vec4((pos - m.quant_origin) / m.quant_scale, 0.0f)),
+						 .normal = normals[i] };
+		}
 	}
 
+	const ::vk::DeviceSize vbsz = verts.size() * sizeof(terrain_vertex);
+
+	m.verts = vma_buffer(
+		ctxt,
+		::vk::BufferCreateInfo(
+			::vk::BufferCreateFlags(), vbsz,
+			::vk::BufferUsageFlagBits::eTransferDst |
+				::vk::BufferUsageFlagBits::eVertexBuffer),
+		VMA_ALLOC_CREATEINFO_GENERAL);
+
+	batch.copy_to_buffer(verts.data(), vbsz, m.verts);
+
 	ctxt.set_debug_name(
-		ret.meshes[0].verts.buffer,
+		m.verts.buffer,
 		fmt::format("MXN: Buffer (V), Chunk {}, {}", hmap.position.x, hmap.position.y));
-	ctxt.set_debug_name(
-		ret.meshes[0].indices.buffer,
-		fmt::format("MXN: Buffer (I), Chunk {}, {}", hmap.position.x, hmap.position.y));
 
+	model ret = {};
+	ret.meshes.push_back(std::move(m));
 	return ret;
 }
 
-model model::from_world_chunk(const context& ctxt, const world_chunk& chunk)
+model model::from_world_chunk(
+	const context& ctxt, upload_batch& batch, const world_chunk& chunk,
+	const vertex_format fmt)
 {
 	static constexpr float HALFCHUNK = mxn::world_chunk::WORLD_SIZE * 0.5f,
 						   HALFCELL = mxn::world_chunk::CELL_SIZE * 0.5f;
@@ -253,42 +377,15 @@ model model::from_world_chunk(const context& ctxt, const world_chunk& chunk)
 		verts[e2].normal = glm::normalize(verts[e2].normal);
 	}
 
-	const size_t vbsz = (verts.size() * sizeof(vertex)),
-				 ibsz = (indices.size() * sizeof(vertex::index_t));
+	[[maybe_unused]] const auto opt = meshopt::optimise(verts, indices);
 
-	model ret = { .meshes = {
-					  { .verts = vma_buffer(
-							ctxt,
-							::vk::BufferCreateInfo(
-								::vk::BufferCreateFlags(), vbsz,
-								::vk::BufferUsageFlagBits::eTransferDst |
-									::vk::BufferUsageFlagBits::eVertexBuffer |
-									::vk::BufferUsageFlagBits::eIndexBuffer),
-							VMA_ALLOC_CREATEINFO_GENERAL),
-						.indices = vma_buffer(
-							ctxt,
-							::vk::BufferCreateInfo(
-								::vk::BufferCreateFlags(), ibsz,
-								::vk::BufferUsageFlagBits::eTransferDst |
-									::vk::BufferUsageFlagBits::eVertexBuffer |
-									::vk::BufferUsageFlagBits::eIndexBuffer),
-							VMA_ALLOC_CREATEINFO_GENERAL),
-						.index_count = static_cast<uint32_t>(indices.size()) } } };
+	MXN_DEBUGF(
+		"Optimised chunk {}, {}, {}; ACMR {:.3f} -> {:.3f}", chunk.position.x,
+		chunk.position.y, chunk.position.z, opt.acmr_before, opt.acmr_after);
 
-	{
-		vma_buffer staging = vma_buffer::staging_preset(ctxt, vbsz);
-		fill_vertex_buffer(ctxt, staging, verts);
-		staging.copy_to(ctxt, ret.meshes.back().verts, { ::vk::BufferCopy(0, 0, vbsz) });
-		staging.destroy(ctxt);
-	}
-
-	{
-		vma_buffer staging = vma_buffer::staging_preset(ctxt, ibsz);
-		fill_index_buffer(ctxt, staging, indices);
-		staging.copy_to(
-			ctxt, ret.meshes.back().indices, { ::vk::BufferCopy(0, 0, ibsz) });
-		staging.destroy(ctxt);
-	}
+	model ret = {};
+	ret.meshes.push_back(upload_mesh(
+		ctxt, batch, verts, indices, fmt, maybe_build_meshlets(verts, indices)));
 
 	ctxt.set_debug_name(
 		ret.meshes[0].verts.buffer,
@@ -309,147 +406,468 @@ void model::destroy(const context& ctxt)
 	for (auto& mesh : meshes)
 	{
 		mesh.verts.destroy(ctxt);
-		mesh.indices.destroy(ctxt);
+
+		if (!mesh.shared_indices) mesh.indices.destroy(ctxt);
+
+		if (mesh.meshlets.empty()) continue;
+
+		ctxt.free_cull_descset(mesh.cull_descset);
+		mesh.meshlet_buf.destroy(ctxt);
+		mesh.draw_buf.destroy(ctxt);
+	}
+}
+
+void model_importer::import_file(const size_t index)
+{
+	const auto& path = files[index];
+
+	if (auto baked = path; path.extension() == ".mxmesh" ||
+						   vfs_exists(baked.replace_extension(".mxmesh")))
+	{
+		if (!import_baked(index, baked) && path.extension() != ".mxmesh")
+		{
+			MXN_WARNF("Falling back to importing the unbaked model: {}", path.string());
+			import_unbaked(index);
+		}
 	}
+	else
+		import_unbaked(index);
+
+	{
+		std::lock_guard lock(done_mtx);
+		done++;
+	}
+
+	done_cv.notify_all();
 }
 
-void model_importer::import_file(const std::filesystem::path& path)
+void model_importer::import_unbaked(const size_t index)
 {
+	ZoneScopedN("MXN: Model Import");
+
+	// Importers aren't thread-safe, but are expensive to construct; one per worker
+	static thread_local Assimp::Importer importer;
+
+	// Takes ownership of the handler
+	if (importer.IsDefaultIOHandler()) importer.SetIOHandler(new vfs_iosystem());
+
+	const auto& path = files[index];
+
 	const aiScene* scene = importer.ReadFile(
-		path.string(), aiProcess_CalcTangentSpace | aiProcess_Triangulate |
-						   aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
+		path.generic_string(), aiProcess_CalcTangentSpace | aiProcess_Triangulate |
+								   aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
 
 	if (scene == nullptr)
 	{
 		MXN_ERRF(
 			"Model import failed: {}\n\t{}", path.string(), importer.GetErrorString());
-		return;
 	}
+	else
+	{
+		auto& meshes = parsed[index].meshes;
+		auto& meshlets = parsed[index].meshlets;
 
-	std::vector<mesh_pair> mesh_pairs;
+		for (size_t i = 0; i < scene->mNumMeshes; i++)
+		{
+			const auto m = scene->mMeshes[i];
+			auto& [verts, indices] = meshes.emplace_back();
+			meshlets.emplace_back();
 
-	auto& model = output.emplace_back();
-	::vk::DeviceSize total_size = 0, offset = 0;
+			// `SortByPType` may leave point and line meshes, which aren't drawn
+			if (m->mPrimitiveTypes != aiPrimitiveType_TRIANGLE) continue;
 
-	for (size_t i = 0; i < scene->mNumMeshes; i++)
-	{
-		auto& pair = mesh_pairs.emplace_back();
-		auto& verts = pair.first;
-		auto& indices = pair.second;
-		const auto m = scene->mMeshes[i];
+			verts.reserve(m->mNumVertices);
+			indices.reserve(static_cast<size_t>(m->mNumFaces) * 3);
 
-		for (unsigned int j = 0; j < m->mNumVertices; j++)
-		{
-			const auto &v = m->mVertices[j], &bt = m->mBitangents[j];
-			const auto colour = m->mColors[j];
-			const auto uv = m->mTextureCoords[j];
-			const auto& norm = m->mNormals[j];
-
-			verts.push_back({ .pos = { v.x, v.y, v.z },
-							  .colour = { colour->r, colour->g, colour->b },
-							  .uv = { uv->x, uv->y },
-							  .normal = { norm.x, norm.y, norm.z },
-							  .binormal = { bt.x, bt.y, bt.z } });
+			for (unsigned int j = 0; j < m->mNumVertices; j++)
+			{
+				const auto& v = m->mVertices[j];
+				const auto colour =
+					m->HasVertexColors(0) ? m->mColors[0][j] : aiColor4D(1.0f);
+				const auto uv =
+					m->HasTextureCoords(0) ? m->mTextureCoords[0][j] : aiVector3D();
+				const auto norm = m->HasNormals() ? m->mNormals[j] : aiVector3D();
+				const auto bt =
+					m->HasTangentsAndBitangents() ? m->mBitangents[j] : aiVector3D();
+
+				verts.push_back({ .pos = { v.x, v.y, v.z },
+								  .colour = { colour.r, colour.g, colour.b },
+								  .uv = { uv.x, uv.y },
+								  .normal = { norm.x, norm.y, norm.z },
+								  .binormal = { bt.x, bt.y, bt.z } });
+			}
+
+			for (unsigned int j = 0; j < m->mNumFaces; j++)
+				for (unsigned int k = 0; k < m->mFaces[j].mNumIndices; k++)
+					indices.push_back(m->mFaces[j].mIndices[k]);
+
+			[[maybe_unused]] const auto opt = meshopt::optimise(verts, indices);
+
+			MXN_DEBUGF(
+				"Optimised mesh {} of {}; ACMR {:.3f} -> {:.3f}", i, path.string(),
+				opt.acmr_before, opt.acmr_after);
+
+			meshlets.back() = maybe_build_meshlets(verts, indices);
 		}
 
-		for (unsigned int j = 0; j < m->mNumFaces; j++)
-			for (unsigned int k = 0; k < m->mFaces[j].mNumIndices; k++)
-				indices.push_back(m->mFaces[j].mIndices[k]);
+		importer.FreeScene();
+	}
+}
+
+bool model_importer::import_baked(const size_t index, const std::filesystem::path& path)
+{
+	ZoneScopedN("MXN: Baked Model Import");
 
-		const ::vk::DeviceSize vbsz = verts.size() * sizeof(vertex),
-							   ibsz = indices.size() * sizeof(vertex::index_t);
+	auto& file = parsed[index];
+	file.blob = vfs_read_async(path).get();
+	std::string error;
 
-		offset += vbsz + ibsz;
-		total_size += vbsz + ibsz;
+	if (file.blob.empty())
+		error = "file could not be read";
+	else if (auto table = mxmesh::parse(
+				 file.blob, sizeof(vertex), sizeof(vertex::index_t), error);
+			 table.has_value())
+	{
+		file.baked = std::move(table.value());
+		return true;
 	}
 
-	for (auto& pair : mesh_pairs)
+	MXN_ERRF("Baked model import failed: {}\n\t{}", path.string(), error);
+	file.blob = {};
+	return false;
+}
+
+PHYSFS_EnumerateCallbackResult model_importer::import_dir(
+	void* data, const char* orig_dir, const char* fname)
+{
+	auto importer = reinterpret_cast<model_importer*>(data);
+	const std::filesystem::path path = std::filesystem::path(orig_dir) / fname;
+
+	if (vfs_isdir(path))
 	{
-		if (pair.second.size() <= 0) continue;
+		vfs_recur(path, data, import_dir);
+		return PHYSFS_ENUM_OK;
+	}
 
-		const ::vk::DeviceSize vbsz = pair.first.size() * sizeof(vertex),
-							   ibsz = pair.second.size() * sizeof(vertex::index_t);
+	// Any importer will do for checking extensions
+	static const Assimp::Importer CHECKER;
 
-		model.meshes.push_back(
-			mesh { .verts = vma_buffer(
-					   ctxt,
-					   ::vk::BufferCreateInfo(
-						   ::vk::BufferCreateFlags(), vbsz,
-						   ::vk::BufferUsageFlagBits::eTransferDst |
-							   ::vk::BufferUsageFlagBits::eVertexBuffer |
-							   ::vk::BufferUsageFlagBits::eIndexBuffer),
-					   VMA_ALLOC_CREATEINFO_GENERAL),
-				   .indices = vma_buffer(
-					   ctxt,
-					   ::vk::BufferCreateInfo(
-						   ::vk::BufferCreateFlags(), ibsz,
-						   ::vk::BufferUsageFlagBits::eTransferDst |
-							   ::vk::BufferUsageFlagBits::eVertexBuffer |
-							   ::vk::BufferUsageFlagBits::eIndexBuffer),
-					   VMA_ALLOC_CREATEINFO_GENERAL),
-				   .index_count = static_cast<uint32_t>(pair.second.size()) });
+	if (path.extension() == ".mxmesh")
+		importer->files.push_back(path);
+	// The baked sibling is enumerated too; don't import the model twice
+	else if (auto baked = path; CHECKER.IsExtensionSupported(path.extension().string()) &&
+								!vfs_exists(baked.replace_extension(".mxmesh")))
+		importer->files.push_back(path);
 
+	return PHYSFS_ENUM_OK;
+}
+
+model_importer::model_importer(
+	const context& ctxt, std::vector<std::filesystem::path>&& paths,
+	const vertex_format format, const size_t thread_c)
+	: ctxt(ctxt), format(format), pool("Model Import", thread_c)
+{
+	for (const auto& path : paths)
+	{
+		if (vfs_isdir(path))
+			vfs_recur(path, reinterpret_cast<void*>(this), import_dir);
+		else
+			files.push_back(path);
+	}
+
+	parsed.resize(files.size());
+
+	for (size_t i = 0; i < files.size(); i++)
+		pool.push([this, i]() -> void { import_file(i); });
+}
+
+std::vector<model>&& model_importer::join()
+{
+	{
+		std::unique_lock lock(done_mtx);
+		done_cv.wait(lock, [this]() -> bool { return done == files.size(); });
+	}
+
+	ZoneScopedN("MXN: Model Import Upload");
+
+	upload_batch batch(ctxt);
+	output.resize(files.size());
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		for (size_t j = 0; j < parsed[i].meshes.size(); j++)
 		{
-			vma_buffer staging = vma_buffer::staging_preset(ctxt, vbsz);
-			fill_vertex_buffer(ctxt, staging, pair.first);
-			staging.copy_to(
-				ctxt, model.meshes.back().verts, { ::vk::BufferCopy(0, 0, vbsz) });
-			staging.destroy(ctxt);
+			const auto& [verts, indices] = parsed[i].meshes[j];
+
+			if (indices.empty()) continue;
+
+			output[i].meshes.push_back(upload_mesh(
+				ctxt, batch, verts, indices, format, parsed[i].meshlets[j]));
 		}
 
+		// Blobs already have the layout of `vertex`; they go straight to staging
+		const auto& blob = parsed[i].blob;
+
+		for (const auto& m : parsed[i].baked)
 		{
-			vma_buffer staging = vma_buffer::staging_preset(ctxt, vbsz);
-			fill_index_buffer(ctxt, staging, pair.second);
-			staging.copy_to(
-				ctxt, model.meshes.back().indices, { ::vk::BufferCopy(0, 0, ibsz) });
-			staging.destroy(ctxt);
+			if (m.index_count == 0) continue;
+
+			output[i].meshes.push_back(upload_mesh(
+				ctxt, batch,
+				{ reinterpret_cast<const vertex*>(blob.data() + m.vert_offset),
+				  m.vert_count },
+				{ reinterpret_cast<const vertex::index_t*>(blob.data() + m.index_offset),
+				  m.index_count },
+				format,
+				{ reinterpret_cast<const meshopt::meshlet*>(blob.data() + m.meshlet_offset),
+				  m.meshlet_count }));
 		}
 	}
+
+	batch.submit();
+	parsed.clear();
+	return std::move(output);
 }
 
-PHYSFS_EnumerateCallbackResult model_importer::import_dir(
-	void* data, const char* orig_dir, const char* fname)
+// Details ////////////////////////////////////////////////////////////////////
+
+static mesh upload_mesh(
+	const context& ctxt, upload_batch& batch, const std::span<const vertex> verts,
+	const std::span<const vertex::index_t> indices, const vertex_format fmt,
+	const std::span<const meshopt::meshlet> meshlets)
 {
-	auto importer = reinterpret_cast<model_importer*>(data);
+	mesh ret = { .index_count = static_cast<uint32_t>(indices.size()), .format = fmt };
 
-	char p[256];
-	strcpy(p, orig_dir);
-	strcat(p, "/");
-	strcat(p, fname);
+	std::vector<unsigned char> packed;
 
-	const std::filesystem::path path(p);
+	if (fmt != vertex_format::full) packed = pack_vertices(verts, ret);
 
-	if (vfs_isdir(p)) vfs_recur(p, data, import_dir);
+	std::vector<uint16_t> narrow;
 
-	if (!importer->importer.IsExtensionSupported(path.extension().string()))
-		return PHYSFS_ENUM_OK;
+	if (verts.size() <= std::numeric_limits<uint16_t>::max() + size_t(1))
+	{
+		ret.index_type = ::vk::IndexType::eUint16;
+		narrow.assign(indices.begin(), indices.end());
+	}
 
-	importer->import_file(path);
-	return PHYSFS_ENUM_STOP;
+	const ::vk::DeviceSize vbsz = verts.size() * vertex_stride(fmt),
+						   ibsz = narrow.empty()
+							   ? indices.size() * sizeof(vertex::index_t)
+							   : narrow.size() * sizeof(uint16_t);
+
+	ret.verts = vma_buffer(
+		ctxt,
+		::vk::BufferCreateInfo(
+			::vk::BufferCreateFlags(), vbsz,
+			::vk::BufferUsageFlagBits::eTransferDst |
+				::vk::BufferUsageFlagBits::eVertexBuffer),
+		VMA_ALLOC_CREATEINFO_GENERAL);
+	ret.indices = vma_buffer(
+		ctxt,
+		::vk::BufferCreateInfo(
+			::vk::BufferCreateFlags(), ibsz,
+			::vk::BufferUsageFlagBits::eTransferDst |
+				::vk::BufferUsageFlagBits::eIndexBuffer),
+		VMA_ALLOC_CREATEINFO_GENERAL);
+
+	batch.copy_to_buffer(
+		packed.empty() ? reinterpret_cast<const void*>(verts.data()) : packed.data(), vbsz,
+		ret.verts);
+	batch.copy_to_buffer(
+		narrow.empty() ? reinterpret_cast<const void*>(indices.data()) : narrow.data(),
+		ibsz, ret.indices);
+
+	if (meshlets.empty()) return ret;
+
+	ret.meshlets.assign(meshlets.begin(), meshlets.end());
+
+	// Everything starts out visible, so that meshes draw correctly before
+	// (or without) ever being culled
+	std::vector<::vk::DrawIndexedIndirectCommand> draws;
+	draws.reserve(meshlets.size());
+
+	for (const auto& m : meshlets) draws.emplace_back(m.index_count, 1, m.first_index, 0, 0);
+
+	const ::vk::DeviceSize mbsz = meshlets.size_bytes(),
+						   dbsz = draws.size() * sizeof(::vk::DrawIndexedIndirectCommand);
+
+	ret.meshlet_buf = vma_buffer(
+		ctxt,
+		::vk::BufferCreateInfo(
+			::vk::BufferCreateFlags(), mbsz,
+			::vk::BufferUsageFlagBits::eTransferDst |
+				::vk::BufferUsageFlagBits::eStorageBuffer),
+		VMA_ALLOC_CREATEINFO_GENERAL);
+	ret.draw_buf = vma_buffer(
+		ctxt,
+		::vk::BufferCreateInfo(
+			::vk::BufferCreateFlags(), dbsz,
+			::vk::BufferUsageFlagBits::eTransferDst |
+				::vk::BufferUsageFlagBits::eStorageBuffer |
+				::vk::BufferUsageFlagBits::eIndirectBuffer),
+		VMA_ALLOC_CREATEINFO_GENERAL);
+
+	batch.copy_to_buffer(meshlets.data(), mbsz, ret.meshlet_buf);
+	batch.copy_to_buffer(draws.data(), dbsz, ret.draw_buf);
+	ret.cull_descset = ctxt.alloc_cull_descset(ret.meshlet_buf, ret.draw_buf);
+	return ret;
 }
 
-model_importer::model_importer(
-	const context& ctxt, std::vector<std::filesystem::path>&& p)
-	: ctxt(ctxt), paths(std::move(p))
+static std::vector<meshopt::meshlet> maybe_build_meshlets(
+	const std::span<const vertex> verts, const std::span<const vertex::index_t> indices)
 {
-	thread = std::thread([&]() -> void {
-		tracy::SetThreadName(
-			fmt::format("MXN: Model Import, {}", reinterpret_cast<void*>(this)).c_str());
+	if (indices.size() / 3 < meshopt::MESHLET_MIN_MESH_TRIS) return {};
+
+	ZoneScopedN("MXN: Meshlet Building");
+
+	return meshopt::build_meshlets(
+		indices, &verts[0].pos.x, sizeof(vertex), verts.size());
+}
+
+static std::vector<unsigned char> pack_vertices(
+	const std::span<const vertex> verts, mesh& m)
+{
+	ZoneScopedN("MXN: Vertex Packing");
+
+	glm::vec3 lo(std::numeric_limits<float>::max()),
+		hi(std::numeric_limits<float>::lowest());
+
+	for (const auto& v : verts)
+	{
+		lo = glm::min(lo, v.pos);
+		hi = glm::max(hi, v.pos);
+	}
+
+	// Centre the range on the mesh's bounds, so that the full span of a
+	// signed-normalised integer covers them; flat axes mustn't divide by zero
+	m.quant_origin = verts.empty() ? glm::vec3() : (lo + hi) * 0.5f;
+	m.quant_scale = verts.empty() ? glm::vec3(1.0f)
+								  : glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
 
-		for (const auto& path : paths)
+	const auto quant_pos = [&m](const glm::vec3& p) -> glm::i16vec4 {
+		return glm::packSnorm<int16_t>(glm::vec4((p - m.quant_origin) / m.quant_scale, 0.0f));
+	};
+
+	std::vector<unsigned char> ret(verts.size() * vertex_stride(m.format));
+
+	for (size_t i = 0; i < verts.size(); i++)
+	{
+		const auto& v = verts[i];
+		const auto normal = glm::packSnorm<int16_t>(oct_encode(v.normal));
+		unsigned char* const dst = ret.data() + i * vertex_stride(m.format);
+
+		if (m.format == vertex_format::packed)
+		{
+			const packed_vertex pv = {
+				.pos = quant_pos(v.pos),
+				.normal = normal,
+				.colour = glm::packUnorm<uint8_t>(glm::vec4(v.colour, 1.0f)),
+				.uv = glm::packHalf(v.uv)
+			};
+
+			memcpy(dst, &pv, sizeof(pv));
+		}
+		else
 		{
-			if (vfs_isdir(path))
-				vfs_recur(path, reinterpret_cast<void*>(this), import_dir);
-			else
-				import_file(path);
+			const terrain_vertex tv = { .pos = quant_pos(v.pos), .normal = normal };
+			memcpy(dst, &tv, sizeof(tv));
 		}
-	});
+	}
+
+	return ret;
 }
 
-std::vector<model>&& model_importer::join()
+static glm::vec2 oct_encode(const glm::vec3 n)
 {
-	thread.join();
-	return std::move(output);
+	const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+
+	// Meshes whose normals are computed post-hoc may leave some at zero
+	if (l1 <= 0.0f) return { 0.0f, 0.0f };
+
+	const glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+
+	if (n.z >= 0.0f) return p;
+
+	// Fold the lower hemisphere over the diagonals
+	return { (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+			 (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f) };
+}
+
+static void heightmap_normals(
+	const heightmap& hmap, const float hscale, const std::span<glm::i16vec2> out)
+{
+	static constexpr size_t W = heightmap::WIDTH, PW = W + 2;
+
+	assert(out.size() == W * W);
+
+	// Pad by linear extrapolation, so that central differences across the
+	// padding are one-sided differences within the heightmap
+	std::array<float, PW * PW> p;
+
+	const auto at = [&p](const size_t x, const size_t y) -> float& {
+		return p[y * PW + x];
+	};
+
+	for (size_t y = 0; y < W; y++)
+		for (size_t x = 0; x < W; x++)
+			at(x + 1, y + 1) = static_cast<float>(hmap.heights[y][x]) * hscale;
+
+	for (size_t i = 1; i <= W; i++)
+	{
+		at(0, i) = 2.0f * at(1, i) - at(2, i);
+		at(W + 1, i) = 2.0f * at(W, i) - at(W - 1, i);
+		at(i, 0) = 2.0f * at(i, 1) - at(i, 2);
+		at(i, W + 1) = 2.0f * at(i, W) - at(i, W - 1);
+	}
+
+	// With a grid spacing of 1, the normal is `(-dx, -dy, 1)`, normalised. Its
+	// Z is always positive, and octahedral encoding divides by the L1 norm, so
+	// normalising first would cancel out; `(-dx, -dy) / (|dx| + |dy| + 1)`
+	// suffices, with no square roots
+#if defined(__SSE2__) || defined(_M_X64)
+	static_assert(W % 4 == 0);
+
+	const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f),
+				 sign = _mm_set1_ps(-0.0f), snorm = _mm_set1_ps(32767.0f);
+
+	for (size_t y = 0; y < W; y++)
+	{
+		for (size_t x = 0; x < W; x += 4)
+		{
+			const __m128 dx = _mm_mul_ps(
+				_mm_sub_ps(_mm_loadu_ps(&at(x + 2, y + 1)), _mm_loadu_ps(&at(x, y + 1))),
+				half);
+			const __m128 dy = _mm_mul_ps(
+				_mm_sub_ps(_mm_loadu_ps(&at(x + 1, y + 2)), _mm_loadu_ps(&at(x + 1, y))),
+				half);
+			const __m128 l1 = _mm_add_ps(
+				_mm_add_ps(_mm_andnot_ps(sign, dx), _mm_andnot_ps(sign, dy)), one);
+
+			// Both components already lie within [-1, 1]
+			const __m128i ox = _mm_cvtps_epi32(
+				_mm_mul_ps(_mm_div_ps(_mm_xor_ps(dx, sign), l1), snorm));
+			const __m128i oy = _mm_cvtps_epi32(
+				_mm_mul_ps(_mm_div_ps(_mm_xor_ps(dy, sign), l1), snorm));
+
+			// Interleave into X/Y pairs, then saturate down to 16 bits
+			const __m128i packed = _mm_packs_epi32(
+				_mm_unpacklo_epi32(ox, oy), _mm_unpackhi_epi32(ox, oy));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&out[y * W + x]), packed);
+		}
+	}
+#else
+	for (size_t y = 0; y < W; y++)
+	{
+		for (size_t x = 0; x < W; x++)
+		{
+			const float dx = (at(x + 2, y + 1) - at(x, y + 1)) * 0.5f,
+						dy = (at(x + 1, y + 2) - at(x + 1, y)) * 0.5f;
+
+			out[y * W + x] = glm::packSnorm<int16_t>(
+				glm::vec2(-dx, -dy) / (std::abs(dx) + std::abs(dy) + 1.0f));
+		}
+	}
+#endif
 }
 
 // The following marching cubes implementation is courtesy of Matthew Fisher
@@ -5,16 +5,23 @@
 
 #pragma once
 
+#include "../meshopt.hpp"
+#include "../mxmesh.hpp"
+#include "../thread_pool.hpp"
 #include "buffer.hpp"
 #include "image.hpp"
+#include "texture.hpp"
 #include "ubo.hpp"
 
-#include <assimp/Importer.hpp>
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
+#include <glm/gtc/type_precision.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <memory>
+#include <mutex>
 #include <physfs.h>
-#include <thread>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 
@@ -30,6 +37,7 @@ namespace mxn::vk
 
 	struct vertex final
 	{
+		/// What meshes are built with; uploads may narrow it (see `mesh::index_type`).
 		using index_t = uint32_t;
 
 		glm::vec3 pos, colour;
@@ -43,6 +51,53 @@ namespace mxn::vk
 		}
 	};
 
+	/// @brief Layouts which a mesh's vertex buffer may take. Each has its own
+	/// pipeline variants; see `context::record_draw()`.
+	enum class vertex_format : uint8_t
+	{
+		/// `vertex`; 56 bytes.
+		full,
+		/// `packed_vertex`; 20 bytes.
+		packed,
+		/// `terrain_vertex`; 12 bytes.
+		terrain
+	};
+
+	/// @brief Quantised counterpart to `vertex`, without the binormal.
+	struct packed_vertex final
+	{
+		/// Signed-normalised within the mesh's bounds; see `mesh::quant_origin`.
+		/// `w` is padding, since there is no 3-component 16-bit vertex format
+		/// with mandatory support.
+		glm::i16vec4 pos;
+		/// Octahedral-encoded and signed-normalised.
+		glm::i16vec2 normal;
+		/// Unsigned-normalised; alpha is unused.
+		glm::u8vec4 colour;
+		/// Half-precision floats.
+		glm::u16vec2 uv;
+	};
+
+	/// @brief Like `packed_vertex`, but without colour or UVs, which no terrain has.
+	struct terrain_vertex final
+	{
+		glm::i16vec4 pos;
+		glm::i16vec2 normal;
+	};
+
+	static_assert(sizeof(packed_vertex) == 20);
+	static_assert(sizeof(terrain_vertex) == 12);
+
+	[[nodiscard]] uint32_t vertex_stride(vertex_format) noexcept;
+	/// @brief Descriptions of the given layout's attributes, all from binding 0.
+	/// Locations are 0 for position, 1 for colour, 2 for UV, and 3 for normal;
+	/// formats without colour or UVs omit those locations.
+	[[nodiscard]] std::vector<::vk::VertexInputAttributeDescription> vertex_attributes(
+		vertex_format);
+
+	/// @brief The triangle list every heightmap chunk's grid of vertices shares.
+	[[nodiscard]] std::vector<uint16_t> heightmap_grid_indices();
+
 	void fill_vertex_buffer(
 		const context&, vma_buffer&, const std::vector<vertex>&);
 	void fill_index_buffer(
@@ -50,15 +105,32 @@ namespace mxn::vk
 
 	struct material_info final
 	{
+		/// `has_normal` is 2 if the normal map only stores X and Y (i.e. BC5).
+		int has_albedo = 0, has_normal = 0;
+	};
+
+	/// @brief One element of the bindless material SSBO; see fwdplus_bindless.frag.
+	struct material_gpu final
+	{
+		uint32_t albedo_index = 0, normal_index = 0;
 		int has_albedo = 0, has_normal = 0;
 	};
 
 	struct material final
 	{
+		/// Only used if the context is not bindless.
 		ubo<material_info> info;
+		/// Only used if the context is not bindless.
 		::vk::DescriptorSet descset;
-		vma_image albedo, normal;
-
+		/// Only used if the context is bindless.
+		uint32_t bindless_index = 0;
+		/// Cleared upon release, so that late texture callbacks know to do nothing.
+		std::shared_ptr<std::atomic_bool> alive = std::make_shared<std::atomic_bool>(true);
+		/// Null if the material was created without the corresponding map.
+		texture_handle albedo, normal;
+
+		/// @note The descriptor set and textures belong to pools and caches owned
+		/// by the context, which frees them in `context::release_material()`.
 		void destroy(const context&);
 	};
 
@@ -66,33 +138,107 @@ namespace mxn::vk
 	{
 		vma_buffer verts, indices;
 		uint32_t index_count;
+		/// `eUint16` wherever every index fits, halving the index buffer.
+		::vk::IndexType index_type = ::vk::IndexType::eUint32;
+		vertex_format format = vertex_format::full;
+		/// For formats other than `full`, positions are decoded as
+		/// `quant_origin + pos * quant_scale`.
+		glm::vec3 quant_origin = {}, quant_scale = glm::vec3(1.0f);
+		/// Empty for meshes too small to be worth culling piecemeal, which are
+		/// always drawn whole. See `context::cull_clusters()`.
+		std::vector<meshopt::meshlet> meshlets;
+		/// Only allocated if `meshlets` isn't empty. `draw_buf` holds one
+		/// `VkDrawIndexedIndirectCommand` per meshlet, with an index count of
+		/// 0 for those culled this frame.
+		vma_buffer meshlet_buf, draw_buf;
+		::vk::DescriptorSet cull_descset;
+		/// If set, `indices` belongs to the context, not to this mesh.
+		/// See `context::heightmap_indices()`.
+		bool shared_indices = false;
 	};
 
 	struct model final
 	{
 		std::vector<mesh> meshes;
 
-		static model from_heightmap(const context&, const heightmap&);
-		static model from_world_chunk(const context&, const world_chunk&);
+		/// @brief Always in the `terrain` vertex format, and drawn with the
+		/// context's shared grid index buffer.
+		/// @note For drawing, prefer `terrain_renderer`, which needs no
+		/// per-chunk vertex buffer; this is for when the mesh is needed as such.
+		/// @note Uploads are recorded into `batch`, so that a whole world can go
+		/// through one submission; don't draw the model until it is submitted.
+		static model from_heightmap(const context&, upload_batch&, const heightmap&);
+		static model from_world_chunk(
+			const context&, upload_batch&, const world_chunk&,
+			vertex_format = vertex_format::terrain);
 
 		void destroy(const context&);
 	};
 
+	/// @brief Imports model files in parallel, each worker thread parsing with
+	/// its own Assimp importer. Directories are searched recursively.
+	/// A baked `.mxmesh` sibling is preferred over any other model file, and
+	/// bypasses Assimp entirely. GPU uploads all happen in `join()`, through a
+	/// single submission.
 	class model_importer final
 	{
-		const context& ctxt;
-		std::vector<std::filesystem::path> paths;
+	public:
+		/// @brief Vertex and index data of one mesh, not yet uploaded.
+		using mesh_data = std::pair<std::vector<vertex>, std::vector<vertex::index_t>>;
 
-		Assimp::Importer importer;
-		std::thread thread;
+	private:
+		const context& ctxt;
+		/// Every file to import, with directories already expanded.
+		std::vector<std::filesystem::path> files;
+		struct parsed_file final
+		{
+			/// Only used if the file went through Assimp.
+			std::vector<mesh_data> meshes;
+			/// Parallel to `meshes`.
+			std::vector<std::vector<meshopt::meshlet>> meshlets;
+			/// Only used if the file was baked. The mesh table points into `blob`.
+			vfs_mapping blob;
+			std::vector<mxmesh::mesh> baked;
+		};
+
+		/// Filled by workers; each only ever writes to its own file's element.
+		std::vector<parsed_file> parsed;
 		std::vector<model> output;
-
-		void import_file(const std::filesystem::path&);
+		/// What every imported mesh gets packed into when uploaded.
+		const vertex_format format;
+
+		std::atomic_size_t done = 0;
+		std::mutex done_mtx;
+		std::condition_variable done_cv;
+
+		/// Declared last so that it is destroyed (i.e. joined) first.
+		thread_pool pool;
+
+		/// @note This and the other `import_` methods run on worker threads.
+		void import_file(size_t index);
+		/// @brief Parse the file through Assimp.
+		void import_unbaked(size_t index);
+		/// @returns `false` if the `.mxmesh` file is unreadable or invalid.
+		[[nodiscard]] bool import_baked(size_t index, const std::filesystem::path&);
 		static PHYSFS_EnumerateCallbackResult import_dir(
 			void* data, const char* orig_dir, const char* fname);
 
 	public:
-		model_importer(const context&, std::vector<std::filesystem::path>&&);
+		/// @param thread_c If 0, one less than the hardware concurrency.
+		model_importer(
+			const context&, std::vector<std::filesystem::path>&&,
+			vertex_format = vertex_format::full, size_t thread_c = 0);
+		DELETE_COPIERS_AND_MOVERS(model_importer)
+
+		/// @returns How many files have been parsed, out of how many in total.
+		[[nodiscard]] std::pair<size_t, size_t> progress() const noexcept
+		{
+			return { done.load(), files.size() };
+		}
+
+		/// @brief Wait for all files to be parsed, then upload them.
+		/// @returns One model per file, in the order the files were found.
+		/// Files which failed to import produce a model with no meshes.
 		std::vector<model>&& join();
 	};
 } // namespace mxn::vk
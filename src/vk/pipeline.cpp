@@ -24,6 +24,7 @@ pipeline::pipeline(const pipeline& other)
 	handle = other.handle;
 	layout = other.layout;
 	shaders = other.shaders;
+	variants = other.variants;
 }
 
 pipeline& pipeline::operator=(const pipeline& other)
@@ -31,15 +32,18 @@ pipeline& pipeline::operator=(const pipeline& other)
 	handle = other.handle;
 	layout = other.layout;
 	shaders = other.shaders;
+	variants = other.variants;
 	return *this;
 }
 
 pipeline::pipeline(pipeline&& other)
-	: handle(other.handle), layout(other.layout), shaders(other.shaders)
+	: handle(other.handle), layout(other.layout), shaders(other.shaders),
+	  variants(other.variants)
 {
 	other.handle = ::vk::Pipeline(nullptr);
 	other.layout = ::vk::PipelineLayout(nullptr);
 	other.shaders = {};
+	other.variants = {};
 }
 
 pipeline& pipeline::operator=(pipeline&& other)
@@ -47,15 +51,20 @@ pipeline& pipeline::operator=(pipeline&& other)
 	handle = other.handle;
 	layout = other.layout;
 	shaders = other.shaders;
+	variants = other.variants;
 	other.handle = ::vk::Pipeline(nullptr);
 	other.layout = ::vk::PipelineLayout(nullptr);
 	other.shaders = {};
+	other.variants = {};
 	return *this;
 }
 
 void pipeline::destroy(const context& ctxt)
 {
 	ctxt.device.destroyPipeline(handle);
+
+	for (const auto& v : variants) ctxt.device.destroyPipeline(v);
+
 	ctxt.device.destroyPipelineLayout(layout);
 
 	for (const auto& sm : shaders) ctxt.device.destroyShaderModule(sm);
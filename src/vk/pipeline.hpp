@@ -17,6 +17,9 @@ namespace mxn::vk
 		::vk::Pipeline handle;
 		::vk::PipelineLayout layout;
 		std::vector<::vk::ShaderModule> shaders;
+		/// Pipelines sharing `layout` but differing from `handle` in some other
+		/// state, e.g. vertex input. Destroyed along with `handle`.
+		std::vector<::vk::Pipeline> variants;
 
 		pipeline() noexcept = default;
 
@@ -29,6 +32,12 @@ namespace mxn::vk
 		pipeline(pipeline&&);
 		pipeline& operator=(pipeline&&);
 
+		/// @returns `handle` if `i` is 0, and otherwise `variants[i - 1]`.
+		[[nodiscard]] const ::vk::Pipeline& variant(const size_t i) const noexcept
+		{
+			return i == 0 ? handle : variants[i - 1];
+		}
+
 		void destroy(const context&);
 	};
 } // namespace mxn::vk
@@ -0,0 +1,258 @@
+/**
+ * @file vk/terrain.cpp
+ * @brief Heightmap terrain, displaced on the GPU from a texture array.
+ */
+
+#include "terrain.hpp"
+
+#include "../world.hpp"
+#include "context.hpp"
+#include "upload.hpp"
+
+#include <Tracy.hpp>
+#include <vk_mem_alloc.h>
+
+using namespace mxn::vk;
+
+/// @returns Every stage which may sample the height array. Tessellation stages
+/// are only valid in barriers if the GPU supports them.
+[[nodiscard]] static ::vk::PipelineStageFlags height_readers(const context&) noexcept;
+
+void terrain_renderer::init(const context& ctxt)
+{
+	static constexpr ::vk::Format FORMAT = ::vk::Format::eR16Uint;
+	static constexpr auto W = static_cast<uint32_t>(heightmap::WIDTH);
+
+	heights = vma_image(
+		ctxt,
+		::vk::ImageCreateInfo(
+			::vk::ImageCreateFlags(), ::vk::ImageType::e2D, FORMAT,
+			::vk::Extent3D(W, W, 1), 1, MAX_CHUNKS, ::vk::SampleCountFlagBits::e1,
+			::vk::ImageTiling::eOptimal,
+			::vk::ImageUsageFlagBits::eTransferDst | ::vk::ImageUsageFlagBits::eSampled,
+			::vk::SharingMode::eExclusive, {}, ::vk::ImageLayout::eUndefined),
+		::vk::ImageViewCreateInfo(
+			::vk::ImageViewCreateFlags(), {}, ::vk::ImageViewType::e2DArray, FORMAT,
+			::vk::ComponentMapping(),
+			::vk::ImageSubresourceRange(
+				::vk::ImageAspectFlagBits::eColor, 0, 1, 0, MAX_CHUNKS)),
+		VMA_ALLOC_CREATEINFO_GENERAL, "MXN: Image, Terrain Heights");
+	heights.format = FORMAT;
+
+	// Heights are only ever read with `texelFetch()`, so filtering is moot
+	sampler = ctxt.device.createSampler(::vk::SamplerCreateInfo(
+		::vk::SamplerCreateFlags(), ::vk::Filter::eNearest, ::vk::Filter::eNearest,
+		::vk::SamplerMipmapMode::eNearest, ::vk::SamplerAddressMode::eClampToEdge,
+		::vk::SamplerAddressMode::eClampToEdge, ::vk::SamplerAddressMode::eClampToEdge));
+
+	// Tessellated terrain displaces its subdivided vertices after the fact
+	const ::vk::DescriptorSetLayoutBinding bind(
+		0, ::vk::DescriptorType::eCombinedImageSampler, 1,
+		::vk::ShaderStageFlagBits::eVertex |
+			::vk::ShaderStageFlagBits::eTessellationEvaluation);
+
+	dsl = ctxt.device.createDescriptorSetLayout(
+		::vk::DescriptorSetLayoutCreateInfo(::vk::DescriptorSetLayoutCreateFlags(), bind));
+
+	const ::vk::DescriptorPoolSize pool_size(
+		::vk::DescriptorType::eCombinedImageSampler, 1);
+
+	descpool = ctxt.device.createDescriptorPool(
+		::vk::DescriptorPoolCreateInfo(::vk::DescriptorPoolCreateFlags(), 1, pool_size));
+	set = ctxt.device.allocateDescriptorSets(
+		::vk::DescriptorSetAllocateInfo(descpool, dsl))[0];
+
+	const ::vk::DescriptorImageInfo dii(
+		sampler, heights.view, ::vk::ImageLayout::eShaderReadOnlyOptimal);
+
+	ctxt.device.updateDescriptorSets(
+		::vk::WriteDescriptorSet(
+			set, 0, 0, ::vk::DescriptorType::eCombinedImageSampler, dii, {}, {}),
+		{});
+
+	instance_buf = vma_buffer(
+		ctxt,
+		::vk::BufferCreateInfo(
+			::vk::BufferCreateFlags(), sizeof(instance) * MAX_CHUNKS,
+			::vk::BufferUsageFlagBits::eTransferDst |
+				::vk::BufferUsageFlagBits::eVertexBuffer),
+		VMA_ALLOC_CREATEINFO_GENERAL);
+
+	// Hand out low layers first
+	free_layers.resize(MAX_CHUNKS);
+
+	for (uint32_t i = 0; i < MAX_CHUNKS; i++) free_layers[i] = MAX_CHUNKS - 1 - i;
+
+	// Every layer is readable from the start, so that uploads needn't track
+	// which layers have been written before
+	upload_batch batch(ctxt);
+
+	batch.commands().pipelineBarrier(
+		::vk::PipelineStageFlagBits::eTopOfPipe, height_readers(ctxt),
+		::vk::DependencyFlags(), {}, {},
+		::vk::ImageMemoryBarrier(
+			::vk::AccessFlags(), ::vk::AccessFlagBits::eShaderRead,
+			::vk::ImageLayout::eUndefined, ::vk::ImageLayout::eShaderReadOnlyOptimal,
+			VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, heights.image,
+			::vk::ImageSubresourceRange(
+				::vk::ImageAspectFlagBits::eColor, 0, 1, 0, MAX_CHUNKS)));
+
+	ctxt.set_debug_name(sampler, "MXN: Sampler, Terrain Heights");
+	ctxt.set_debug_name(dsl, "MXN: Desc. Set Layout, Terrain");
+	ctxt.set_debug_name(descpool, "MXN: Descriptor Pool, Terrain");
+	ctxt.set_debug_name(set, "MXN: Desc. Set, Terrain");
+	ctxt.set_debug_name(instance_buf.buffer, "MXN: Buffer (V), Terrain Instances");
+}
+
+void terrain_renderer::destroy(const context& ctxt)
+{
+	instance_buf.destroy(ctxt);
+	ctxt.device.destroyDescriptorPool(descpool);
+	ctxt.device.destroyDescriptorSetLayout(dsl);
+	ctxt.device.destroySampler(sampler);
+	heights.destroy(ctxt);
+	instances.clear();
+	free_layers.clear();
+	index_of.clear();
+}
+
+bool terrain_renderer::set(
+	const context& ctxt, upload_batch& batch, const heightmap& hmap)
+{
+	ZoneScopedN("MXN: Terrain Chunk Upload");
+
+	static constexpr glm::uvec2 WHOLE = { heightmap::WIDTH, heightmap::WIDTH };
+
+	if (const auto iter = index_of.find(chunk_key(hmap.position)); iter != index_of.end())
+	{
+		upload_heights(ctxt, batch, hmap, instances[iter->second].layer, {}, WHOLE);
+		return true;
+	}
+
+	if (free_layers.empty()) return false;
+
+	const uint32_t layer = free_layers.back();
+	free_layers.pop_back();
+
+	index_of.emplace(chunk_key(hmap.position), instances.size());
+	instances.push_back({ .position = hmap.position, .layer = layer });
+
+	upload_heights(ctxt, batch, hmap, layer, {}, WHOLE);
+	upload_instances(ctxt, batch);
+	return true;
+}
+
+void terrain_renderer::update(
+	const context& ctxt, upload_batch& batch, const heightmap& hmap,
+	const glm::uvec2 offset, const glm::uvec2 extent)
+{
+	assert(offset.x + extent.x <= heightmap::WIDTH);
+	assert(offset.y + extent.y <= heightmap::WIDTH);
+
+	const auto iter = index_of.find(chunk_key(hmap.position));
+
+	if (iter == index_of.end() || extent.x == 0 || extent.y == 0) return;
+
+	upload_heights(ctxt, batch, hmap, instances[iter->second].layer, offset, extent);
+}
+
+void terrain_renderer::remove(
+	const context& ctxt, upload_batch& batch, const glm::ivec2 position)
+{
+	const auto iter = index_of.find(chunk_key(position));
+
+	if (iter == index_of.end()) return;
+
+	const size_t index = iter->second;
+	free_layers.push_back(instances[index].layer);
+	index_of.erase(iter);
+
+	// Swap with the last instance, so that the live instances stay contiguous
+	if (index != instances.size() - 1)
+	{
+		instances[index] = instances.back();
+		index_of[chunk_key(instances[index].position)] = index;
+	}
+
+	instances.pop_back();
+	upload_instances(ctxt, batch);
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+static ::vk::PipelineStageFlags height_readers(const context& ctxt) noexcept
+{
+	::vk::PipelineStageFlags ret = ::vk::PipelineStageFlagBits::eVertexShader;
+
+	if (ctxt.has_tessellation())
+		ret |= ::vk::PipelineStageFlagBits::eTessellationEvaluationShader;
+
+	return ret;
+}
+
+uint64_t terrain_renderer::chunk_key(const glm::ivec2 position) noexcept
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(position.x)) << 32) |
+		   static_cast<uint32_t>(position.y);
+}
+
+void terrain_renderer::upload_instances(const context&, upload_batch& batch) const
+{
+	if (instances.empty()) return;
+
+	batch.copy_to_buffer(
+		instances.data(), instances.size() * sizeof(instance), instance_buf);
+}
+
+void terrain_renderer::upload_heights(
+	const context& ctxt, upload_batch& batch, const heightmap& hmap,
+	const uint32_t layer, const glm::uvec2 offset, const glm::uvec2 extent) const
+{
+	const ::vk::DeviceSize size = extent.x * extent.y * sizeof(uint16_t);
+	auto& stg = batch.staging(size);
+
+	void* d = nullptr;
+	[[maybe_unused]] const auto res = vmaMapMemory(ctxt.vma, stg.allocation, &d);
+	assert(res == VK_SUCCESS);
+
+	// Tightly pack the rectangle, row by row
+	for (uint32_t y = 0; y < extent.y; y++)
+	{
+		memcpy(
+			static_cast<uint16_t*>(d) + y * extent.x,
+			hmap.heights[offset.y + y].data() + offset.x, extent.x * sizeof(uint16_t));
+	}
+
+	vmaUnmapMemory(ctxt.vma, stg.allocation);
+
+	const ::vk::ImageSubresourceRange range(
+		::vk::ImageAspectFlagBits::eColor, 0, 1, layer, 1);
+	const auto& cmdbuf = batch.commands();
+
+	cmdbuf.pipelineBarrier(
+		height_readers(ctxt), ::vk::PipelineStageFlagBits::eTransfer,
+		::vk::DependencyFlags(), {}, {},
+		::vk::ImageMemoryBarrier(
+			::vk::AccessFlagBits::eShaderRead, ::vk::AccessFlagBits::eTransferWrite,
+			::vk::ImageLayout::eShaderReadOnlyOptimal,
+			::vk::ImageLayout::eTransferDstOptimal, VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED, heights.image, range));
+
+	cmdbuf.copyBufferToImage(
+		stg.buffer, heights.image, ::vk::ImageLayout::eTransferDstOptimal,
+		::vk::BufferImageCopy(
+			0, 0, 0,
+			::vk::ImageSubresourceLayers(::vk::ImageAspectFlagBits::eColor, 0, layer, 1),
+			::vk::Offset3D(
+				static_cast<int32_t>(offset.x), static_cast<int32_t>(offset.y), 0),
+			::vk::Extent3D(extent.x, extent.y, 1)));
+
+	cmdbuf.pipelineBarrier(
+		::vk::PipelineStageFlagBits::eTransfer, height_readers(ctxt),
+		::vk::DependencyFlags(), {}, {},
+		::vk::ImageMemoryBarrier(
+			::vk::AccessFlagBits::eTransferWrite, ::vk::AccessFlagBits::eShaderRead,
+			::vk::ImageLayout::eTransferDstOptimal,
+			::vk::ImageLayout::eShaderReadOnlyOptimal, VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED, heights.image, range));
+}
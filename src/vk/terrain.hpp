@@ -0,0 +1,110 @@
+/**
+ * @file vk/terrain.hpp
+ * @brief Heightmap terrain, displaced on the GPU from a texture array.
+ */
+
+#pragma once
+
+#include "../preproc.hpp"
+#include "buffer.hpp"
+#include "image.hpp"
+
+#include <glm/vec2.hpp>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace mxn
+{
+	struct heightmap;
+}
+
+namespace mxn::vk
+{
+	class context;
+	class upload_batch;
+
+	/// @brief Keeps every resident `heightmap` on the GPU, for drawing all of
+	/// them with one instanced draw of a shared grid; see `context::record_terrain()`.
+	///
+	/// Heights live in an `R16_UINT` texture array, one layer per chunk, and
+	/// are displaced in the vertex shader, so no chunk has a vertex buffer of
+	/// its own and editing one only re-uploads the edited texels. The grid's
+	/// triangles are `context::heightmap_indices()`; its vertices are implied
+	/// by `gl_VertexIndex`.
+	/// @note Only use on the render thread, while no frame is in flight.
+	class terrain_renderer final
+	{
+	public:
+		/// How many chunks can be resident at once; one array layer each.
+		static constexpr uint32_t MAX_CHUNKS = 256;
+
+		/// @brief Per-instance vertex input; see fwdplus_heightmap.vert.
+		struct instance final
+		{
+			glm::ivec2 position = {};
+			uint32_t layer = 0, padding = 0;
+		};
+
+		terrain_renderer() = default;
+		DELETE_COPIERS_AND_MOVERS(terrain_renderer)
+
+		void init(const context&);
+		void destroy(const context&);
+
+		// Each of these records its uploads into `batch`, so that many chunks can
+		// change in one submission. Submit `batch` before the next frame.
+
+		/// @brief Upload a chunk's heights, replacing any chunk at its position.
+		/// @returns `false` if all `MAX_CHUNKS` layers are taken.
+		bool set(const context&, upload_batch& batch, const heightmap&);
+		/// @brief Re-upload a rectangle of an already-resident chunk's heights.
+		/// Does nothing if no chunk is resident at the heightmap's position.
+		void update(
+			const context&, upload_batch& batch, const heightmap&, glm::uvec2 offset,
+			glm::uvec2 extent);
+		void remove(const context&, upload_batch& batch, glm::ivec2 position);
+
+		[[nodiscard]] uint32_t chunk_count() const noexcept
+		{
+			return static_cast<uint32_t>(instances.size());
+		}
+
+		[[nodiscard]] constexpr const ::vk::DescriptorSetLayout& descset_layout()
+			const noexcept
+		{
+			return dsl;
+		}
+
+		[[nodiscard]] constexpr const ::vk::DescriptorSet& descset() const noexcept
+		{
+			return set;
+		}
+
+		[[nodiscard]] constexpr const vma_buffer& instance_buffer() const noexcept
+		{
+			return instance_buf;
+		}
+
+	private:
+		vma_image heights;
+		::vk::Sampler sampler;
+		::vk::DescriptorSetLayout dsl;
+		::vk::DescriptorPool descpool;
+		::vk::DescriptorSet set;
+		/// Sized for `MAX_CHUNKS`; only the first `chunk_count()` are drawn.
+		vma_buffer instance_buf;
+		/// Mirrors the live part of `instance_buf`.
+		std::vector<instance> instances;
+		std::vector<uint32_t> free_layers;
+		/// Indices into `instances`, keyed by `chunk_key()`.
+		std::unordered_map<uint64_t, size_t> index_of;
+
+		[[nodiscard]] static uint64_t chunk_key(glm::ivec2 position) noexcept;
+
+		void upload_instances(const context&, upload_batch&) const;
+		void upload_heights(
+			const context&, upload_batch&, const heightmap&, uint32_t layer,
+			glm::uvec2 offset, glm::uvec2 extent) const;
+	};
+} // namespace mxn::vk
@@ -0,0 +1,227 @@
+/**
+ * @file vk/texture.cpp
+ * @brief Textures which load in the background, and the cache which loads them.
+ */
+
+#include "texture.hpp"
+
+#include "../log.hpp"
+#include "context.hpp"
+#include "upload.hpp"
+
+#include <Tracy.hpp>
+#include <vk_mem_alloc.h>
+#include <xxhash.h>
+
+using namespace mxn::vk;
+
+/// @brief Create a 1x1 RGBA8 texture of the given colour.
+[[nodiscard]] static vma_image solid_colour(
+	const context&, upload_batch&, std::array<unsigned char, 4> rgba,
+	const std::string& debug_name);
+
+texture_loader::texture_loader() : pool("Texture Decode") {}
+
+void texture_loader::init(const context& ctxt)
+{
+	upload_batch batch(ctxt);
+	white = solid_colour(ctxt, batch, { 255, 255, 255, 255 }, "Placeholder Albedo");
+	flat_normal = solid_colour(ctxt, batch, { 128, 128, 255, 255 }, "Placeholder Normal");
+}
+
+void texture_loader::destroy(const context& ctxt)
+{
+	// Workers may still be reading the context; wait them out, discarding results
+	while (in_flight > 0)
+	{
+		decoded dc = {};
+
+		if (queue.try_dequeue(dc))
+			in_flight--;
+		else
+			std::this_thread::yield();
+	}
+
+	std::lock_guard lock(mtx);
+
+	for (auto& kvp : by_hash) kvp.second->image.destroy(ctxt);
+
+	by_hash.clear();
+	by_path.clear();
+
+	white.destroy(ctxt);
+	flat_normal.destroy(ctxt);
+}
+
+texture_handle texture_loader::acquire(
+	const context& ctxt, const std::filesystem::path& path, const placeholder ph,
+	texture_callback on_ready)
+{
+	std::lock_guard lock(mtx);
+
+	if (auto iter = by_path.find(path.string()); iter != by_path.end())
+	{
+		auto& tex = iter->second;
+		tex->refs++;
+
+		if (!tex->ready && !tex->failed && on_ready)
+			tex->callbacks.push_back(std::move(on_ready));
+
+		return tex;
+	}
+
+	auto ret = std::make_shared<texture>(
+		path, ph == placeholder::albedo ? white.view : flat_normal.view);
+
+	if (on_ready) ret->callbacks.push_back(std::move(on_ready));
+
+	by_path.emplace(path.string(), ret);
+	in_flight++;
+
+	pool.push([this, &ctxt, tex = ret]() mutable -> void {
+		if (tex->abandoned) // Don't waste time decoding
+		{
+			queue.enqueue({ .tex = std::move(tex) });
+			return;
+		}
+
+		auto data = image_data::decode(ctxt, tex->path);
+		uint64_t hash = 0;
+
+		if (data.has_value())
+		{
+			const uint64_t seed = (static_cast<uint64_t>(data->width) << 32) | data->height;
+			hash = XXH64(data->bytes.data(), data->bytes.size(), seed);
+		}
+
+		queue.enqueue({ .tex = std::move(tex), .data = std::move(data), .hash = hash });
+	});
+
+	return ret;
+}
+
+void texture_loader::release(const context& ctxt, const texture_handle& tex)
+{
+	std::lock_guard lock(mtx);
+	release_locked(ctxt, tex);
+}
+
+void texture_loader::flush(const context& ctxt, upload_batch& batch)
+{
+	ZoneScopedN("MXN: Texture Loader Flush");
+
+	std::vector<decoded> ready_list(queue.size_approx());
+	ready_list.resize(queue.try_dequeue_bulk(ready_list.begin(), ready_list.size()));
+
+	if (ready_list.empty()) return;
+
+	std::vector<std::pair<texture_handle, std::vector<texture_callback>>> callbacks;
+
+	{
+		std::lock_guard lock(mtx);
+
+		for (auto& dc : ready_list)
+		{
+			auto& tex = dc.tex;
+
+			if (tex->abandoned) continue;
+
+			if (!dc.data.has_value())
+			{
+				tex->failed = true;
+				continue;
+			}
+
+			tex->hash = dc.hash;
+
+			// Same content under another path; share its image instead
+			if (auto iter = by_hash.find(dc.hash); iter != by_hash.end())
+			{
+				tex->alias_of = iter->second;
+				tex->alias_of->refs++;
+				tex->image = tex->alias_of->image;
+				continue;
+			}
+
+			tex->image = vma_image::from_data(ctxt, batch, *dc.data);
+
+			if (!tex->image)
+			{
+				MXN_ERRF("Failed to upload texture: {}", tex->path.string());
+				tex->failed = true;
+				continue;
+			}
+
+			by_hash.emplace(dc.hash, tex);
+		}
+
+		for (auto& dc : ready_list)
+		{
+			in_flight--;
+
+			if (dc.tex->abandoned || dc.tex->failed)
+			{
+				dc.tex->callbacks.clear();
+				continue;
+			}
+
+			dc.tex->ready = true;
+			callbacks.emplace_back(dc.tex, std::move(dc.tex->callbacks));
+		}
+	}
+
+	// Outside the lock, so that callbacks may acquire or release textures
+	for (const auto& [tex, cbs] : callbacks)
+		for (const auto& cb : cbs) cb(*tex);
+}
+
+std::pair<size_t, size_t> texture_loader::counts() const
+{
+	std::lock_guard lock(mtx);
+	return { by_path.size(), by_hash.size() };
+}
+
+void texture_loader::release_locked(const context& ctxt, const texture_handle& tex)
+{
+	assert(tex->refs > 0);
+
+	if (--tex->refs > 0) return;
+
+	if (auto iter = by_path.find(tex->path.string());
+		iter != by_path.end() && iter->second == tex)
+		by_path.erase(iter);
+
+	// Still decoding or awaiting upload; `flush()` will discard it
+	if (!tex->ready && !tex->failed)
+	{
+		tex->abandoned = true;
+		return;
+	}
+
+	if (tex->alias_of)
+	{
+		const auto canon = std::move(tex->alias_of);
+		release_locked(ctxt, canon);
+		return;
+	}
+
+	if (auto iter = by_hash.find(tex->hash); iter != by_hash.end() && iter->second == tex)
+		by_hash.erase(iter);
+
+	if (tex->image) tex->image.destroy(ctxt);
+}
+
+// Details ////////////////////////////////////////////////////////////////////
+
+static vma_image solid_colour(
+	const context& ctxt, upload_batch& batch, const std::array<unsigned char, 4> rgba,
+	const std::string& debug_name)
+{
+	const image_data data = { .path = debug_name,
+							  .bytes = mxn::vfs_mapping(
+								  std::vector<unsigned char>(rgba.begin(), rgba.end())),
+							  .width = 1,
+							  .height = 1 };
+
+	return vma_image::from_data(ctxt, batch, data);
+}
@@ -0,0 +1,135 @@
+/**
+ * @file vk/texture.hpp
+ * @brief Textures which load in the background, and the cache which loads them.
+ */
+
+#pragma once
+
+#include "../preproc.hpp"
+#include "../thread_pool.hpp"
+#include "image.hpp"
+
+#include <atomic>
+#include <concurrentqueue/concurrentqueue.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace mxn::vk
+{
+	class upload_batch;
+
+	/// @brief What a texture should look like while it is still loading.
+	enum class placeholder : uint8_t
+	{
+		/// Opaque white, i.e. the same as having no albedo map at all.
+		albedo,
+		/// A flat tangent-space normal, i.e. the same as having no normal map.
+		normal
+	};
+
+	struct texture;
+
+	/// @brief Invoked on the thread calling `texture_loader::flush()`, once the
+	/// texture's upload has been submitted ahead of any frame which could read
+	/// it. Typically used to re-write descriptors.
+	using texture_callback = std::function<void(const texture&)>;
+
+	struct texture final
+	{
+		const std::filesystem::path path;
+		/// Only valid once `ready`; use `view()` to get something always bindable.
+		vma_image image;
+		const ::vk::ImageView placeholder_view;
+		std::atomic_bool ready = false, failed = false;
+		/// Set if released while still loading; the loader then discards the result.
+		std::atomic_bool abandoned = false;
+
+		texture(const std::filesystem::path& path, const ::vk::ImageView& placeholder)
+			: path(path), placeholder_view(placeholder)
+		{
+		}
+
+		[[nodiscard]] const ::vk::ImageView& view() const noexcept
+		{
+			return ready ? image.view : placeholder_view;
+		}
+
+	private:
+		friend class texture_loader;
+
+		// The rest is guarded by the owning loader's mutex
+
+		uint32_t refs = 1;
+		/// XXH64 of the decoded texels (or KTX2 file); 0 until decoded.
+		uint64_t hash = 0;
+		/// If non-null, `image` is borrowed from this texture with identical content.
+		std::shared_ptr<texture> alias_of;
+		std::vector<texture_callback> callbacks;
+	};
+
+	using texture_handle = std::shared_ptr<texture>;
+
+	/// @brief Reads and decodes textures on a thread pool, then uploads whatever
+	/// has finished decoding whenever `flush()` is called.
+	///
+	/// Textures are reference-counted and cached by VFS path. Once decoded,
+	/// they are also deduplicated by content, so two paths holding the same
+	/// image share one allocation.
+	class texture_loader final
+	{
+		struct decoded final
+		{
+			texture_handle tex;
+			std::optional<image_data> data;
+			uint64_t hash = 0;
+		};
+
+		thread_pool pool;
+		moodycamel::ConcurrentQueue<decoded> queue;
+		std::atomic_size_t in_flight = 0;
+		vma_image white, flat_normal;
+
+		mutable std::mutex mtx;
+		std::unordered_map<std::string, texture_handle> by_path;
+		/// Only holds textures which own their image (i.e. which are not aliases).
+		std::unordered_map<uint64_t, texture_handle> by_hash;
+
+		/// @note Expects `mtx` to be locked.
+		void release_locked(const context&, const texture_handle&);
+
+	public:
+		texture_loader();
+		DELETE_COPIERS_AND_MOVERS(texture_loader)
+
+		/// @brief Upload placeholder textures; call once the context is usable.
+		void init(const context&);
+		void destroy(const context&);
+
+		/// @brief Get a cached texture, or start loading it in the background.
+		/// Every call must be paired with a call to `release()`.
+		/// @param on_ready Only invoked if the texture is not ready yet.
+		/// @returns A handle which is bindable immediately, via its placeholder.
+		[[nodiscard]] texture_handle acquire(
+			const context&, const std::filesystem::path&, placeholder,
+			texture_callback on_ready = {});
+
+		/// @brief Drop a reference; the texture is freed when none remain.
+		/// @note Only call on the render thread, while no frame is in flight.
+		void release(const context&, const texture_handle&);
+
+		/// @brief Record the upload of every texture decoded so far into `batch`,
+		/// then run their callbacks, which may record into it too.
+		/// @note Only call on the render thread, while no frame is in flight.
+		/// Submit `batch` before the next frame.
+		void flush(const context&, upload_batch& batch);
+
+		/// @returns How many textures are still decoding or awaiting upload.
+		[[nodiscard]] size_t pending() const noexcept { return in_flight; }
+
+		/// @returns How many distinct paths are cached, and how many images
+		/// actually back them.
+		[[nodiscard]] std::pair<size_t, size_t> counts() const;
+	};
+} // namespace mxn::vk
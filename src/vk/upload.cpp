@@ -0,0 +1,70 @@
+/**
+ * @file vk/upload.cpp
+ * @brief `upload_batch`, for recording many staged transfers into one submission.
+ */
+
+#include "upload.hpp"
+
+#include "context.hpp"
+
+#include <Tracy.hpp>
+#include <vk_mem_alloc.h>
+
+using namespace mxn::vk;
+
+upload_batch::upload_batch(const context& ctxt)
+	: ctxt(ctxt), cmdbuf(ctxt.begin_onetime_buffer())
+{
+}
+
+upload_batch::~upload_batch()
+{
+	if (!empty()) submit();
+
+	cmdbuf.end();
+	ctxt.device.freeCommandBuffers(ctxt.cmdpool_gfx, cmdbuf);
+}
+
+vma_buffer& upload_batch::staging(const ::vk::DeviceSize size)
+{
+	return stagings.emplace_back(vma_buffer::staging_preset(ctxt, size));
+}
+
+void upload_batch::copy_to_buffer(
+	const void* const src, const ::vk::DeviceSize size, const vma_buffer& dst,
+	const ::vk::DeviceSize dst_offset)
+{
+	auto& stg = staging(size);
+
+	void* d = nullptr;
+	[[maybe_unused]] const auto res = vmaMapMemory(ctxt.vma, stg.allocation, &d);
+	assert(res == VK_SUCCESS);
+	memcpy(d, src, size);
+	vmaUnmapMemory(ctxt.vma, stg.allocation);
+
+	cmdbuf.copyBuffer(stg.buffer, dst.buffer, ::vk::BufferCopy(0, dst_offset, size));
+	recorded = true;
+}
+
+void upload_batch::submit()
+{
+	ZoneScopedN("MXN: Upload Batch Submit");
+
+	// Images transition themselves for shader reads; this covers buffers (e.g.
+	// vertex fetches and uniform reads) in whatever is submitted next
+	cmdbuf.pipelineBarrier(
+		::vk::PipelineStageFlagBits::eTransfer, ::vk::PipelineStageFlagBits::eAllCommands,
+		::vk::DependencyFlags(),
+		::vk::MemoryBarrier(
+			::vk::AccessFlagBits::eTransferWrite, ::vk::AccessFlagBits::eMemoryRead),
+		{}, {});
+	cmdbuf.end();
+
+	const ::vk::Fence fence = ctxt.device.createFence({}, nullptr);
+	ctxt.q_gfx.submit(::vk::SubmitInfo({}, {}, cmdbuf, {}), fence);
+	ctxt.retire_upload(fence, cmdbuf, std::move(stagings));
+
+	stagings.clear();
+	recorded = false;
+	cmdbuf = ctxt.begin_onetime_buffer();
+}
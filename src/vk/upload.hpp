@@ -0,0 +1,65 @@
+/**
+ * @file vk/upload.hpp
+ * @brief `upload_batch`, for recording many staged transfers into one submission.
+ */
+
+#pragma once
+
+#include "../preproc.hpp"
+#include "buffer.hpp"
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace mxn::vk
+{
+	class context;
+
+	/// @brief Records staged transfers from any number of asset loads into one
+	/// command buffer, so that they share a single submission.
+	/// @note Staging buffers handed out by `staging()` live until the GPU has
+	/// finished with the submission which reads them.
+	class upload_batch final
+	{
+		const context& ctxt;
+		::vk::CommandBuffer cmdbuf;
+		std::vector<vma_buffer> stagings;
+		/// Whether anything may have been recorded into `cmdbuf` since it began.
+		bool recorded = false;
+
+	public:
+		upload_batch(const context&);
+		/// @brief Submits anything recorded or staged since the last `submit()`.
+		~upload_batch();
+		DELETE_COPIERS_AND_MOVERS(upload_batch)
+
+		/// @brief Allocate a host-visible buffer which lives until the GPU has
+		/// finished with the next `submit()`.
+		[[nodiscard]] vma_buffer& staging(::vk::DeviceSize);
+
+		/// @brief Allocate a staging buffer, fill it with `size` bytes from `src`,
+		/// and record a copy of those bytes into `dst` at `dst_offset`.
+		void copy_to_buffer(
+			const void* src, ::vk::DeviceSize size, const vma_buffer& dst,
+			::vk::DeviceSize dst_offset = 0);
+
+		/// @brief For recording commands other than copies (e.g. barriers).
+		/// The batch is then submitted even if nothing was staged.
+		[[nodiscard]] const ::vk::CommandBuffer& commands() noexcept
+		{
+			recorded = true;
+			return cmdbuf;
+		}
+
+		[[nodiscard]] bool empty() const noexcept
+		{
+			return !recorded && stagings.empty();
+		}
+
+		/// @brief Submits all recorded transfers to the graphics queue without
+		/// waiting, hands the staging buffers to the context to free once they
+		/// complete, and begins recording anew. Later submissions to the graphics
+		/// queue see the transfers' results.
+		void submit();
+	};
+} // namespace mxn::vk
@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
 namespace mxn
@@ -45,6 +48,10 @@ namespace mxn
 		/// World space distance from edge to edge.
 		static constexpr float WORLD_SIZE = static_cast<float>(WIDTH);
 
+		/// World space height of one unit of `heights`.
+		/// Mirrored by the heightmap shaders (e.g. fwdplus_heightmap.vert).
+		static constexpr float HEIGHT_SCALE = .00001f;
+
 		using arr_t = std::array<std::array<uint16_t, WIDTH>, WIDTH>;
 
 		/// The position of this chunk on the "grid" of chunks.